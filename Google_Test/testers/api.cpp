@@ -6,6 +6,10 @@
 #include "gtest/gtest.h"
 #include "api/API.h"
 #include "logger/logger.hpp"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <sstream>
 
 TEST(API, time_watcher) {
     auto tw = ifr::API::registerTimePoint("test", 1, 2, 2);
@@ -27,3 +31,423 @@ TEST(API, time_watcher) {
     tw->start(0), tw->start(1);
     ifr::logger::log("API", tw->getTime());
 }
+
+/**
+ * 发送一个http请求
+ * @param req 请求报文
+ * @return 响应报文, 失败时为空
+ */
+static std::string httpRequest(const std::string &req) {
+    std::string resp;
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(18000);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr *) &addr, sizeof(addr)) == 0) {
+        send(fd, req.c_str(), req.length(), 0);
+        char buf[4096];
+        for (ssize_t n; (n = recv(fd, buf, sizeof(buf), 0)) > 0;) {//服务器不主动关闭连接, 按Content-Length读取
+            resp.append(buf, n);
+            const auto head = resp.find("\r\n\r\n"), len = resp.find("Content-Length:");
+            if (head != std::string::npos && len != std::string::npos &&
+                resp.length() >= head + 4 + std::stoul(resp.substr(len + 15)))
+                break;
+        }
+    }
+    close(fd);
+    return resp;
+}
+
+enum class Color {
+    RED, BLUE
+};
+IFRAPI_ENUM(Color, "RED", "BLUE")
+
+static ifr::API::Tunable<int> bulk_a(1), bulk_b(2);//批量读写测试变量, 需在API初始化前注册
+static ifr::API::Tunable<Color> desc_color(Color::RED);//类型描述测试变量
+static ifr::API::Tunable<std::array<Color, 2>> desc_colors({Color::RED, Color::BLUE});
+
+/**启动测试服务器 (仅一次)*/
+static void startServer() {
+    static std::once_flag flag;
+    std::call_once(flag, []() {
+        IFRAPI_TUNABLE(test, bulk_a, 0, 10)
+        IFRAPI_TUNABLE(test, bulk_b, 0, 10)
+        IFRAPI_TUNABLE(test, desc_color, Color::RED, Color::BLUE)
+        IFRAPI_TUNABLE_NR(test, desc_colors)
+        ifr::Plans::init();
+        ifr::API::init("127.0.0.1:18000", true);
+    });
+}
+
+TEST(API, async_route) {
+    startServer();
+    std::string resp;
+    for (int i = 0; i < 50 && resp.empty(); i++) {
+        SLEEP(SLEEP_TIME(0.05));
+        resp = httpRequest("GET /plan/running HTTP/1.0\r\n\r\n");//mongoose线程中执行
+    }
+    ASSERT_NE(resp.find("200 OK"), std::string::npos);
+
+    resp = httpRequest("GET /plan/start?pname=test-none HTTP/1.0\r\n\r\n");//工作线程中执行
+    ASSERT_NE(resp.find("200 OK"), std::string::npos);
+    ASSERT_EQ(resp.substr(resp.length() - 5), "false");
+    resp = httpRequest("DELETE /plan/remove HTTP/1.0\r\n\r\n");
+    ASSERT_NE(resp.find("400"), std::string::npos);
+}
+
+TEST(API, route_table) {
+    ifr::API::RouteTable<int> table;
+    std::vector<std::tuple<std::string, std::string, int>> linear;//对照: 按注册顺序逐个匹配
+    const auto add = [&](const std::string &method, const std::string &pattern, int id) {
+        table.add(method, pattern, id);
+        linear.emplace_back(method, pattern, id);
+    };
+    for (int i = 0; i < 128; i++)add(i % 2 ? "POST" : "GET", "/bench/r" + std::to_string(i) + "/get", i);
+    add("GET", "/bench/*/item", 1000);
+    add("GET", "/files/#", 1001);
+    add("GET", "/glob/a*", 1002);
+
+    const auto find = [&](const std::string &method, const std::string &uri) {
+        const auto h = table.find(method, uri);
+        return h ? *h : -1;
+    };
+    ASSERT_EQ(find("GET", "/bench/r0/get"), 0);
+    ASSERT_EQ(find("POST", "/bench/r127/get"), 127);
+    ASSERT_EQ(find("GET", "/bench/r127/get"), -1);//请求类型不匹配
+    ASSERT_EQ(find("GET", "/bench/x/item"), 1000);
+    ASSERT_EQ(find("GET", "/files/a/b/c"), 1001);
+    ASSERT_EQ(find("GET", "/glob/abc"), 1002);
+    ASSERT_EQ(find("GET", "/none"), -1);
+    ASSERT_EQ(find("GET", "/bench/x/y/item"), -1);//"*"只匹配一段
+
+    const auto findLinear = [&](const std::string &method, const std::string &uri) {
+        for (const auto &e: linear)
+            if (mg_globmatch(std::get<1>(e).c_str(), std::get<1>(e).length(), uri.c_str(), uri.length()) &&
+                std::get<0>(e) == method)
+                return std::get<2>(e);
+        return -1;
+    };
+    for (const auto &method: {"GET", "POST"}) {//与逐个匹配的结果一致
+        for (int i = 0; i < 130; i++) {
+            const auto uri = "/bench/r" + std::to_string(i) + "/get";
+            ASSERT_EQ(find(method, uri), findLinear(method, uri)) << method << " " << uri;
+        }
+        for (const auto &uri: {"/bench/x/item", "/bench/x/", "/files/", "/files/a/b", "/glob/a", "/glob/b"})
+            ASSERT_EQ(find(method, uri), findLinear(method, uri)) << method << " " << uri;
+    }
+
+    //微基准: 最后注册的普通路由, 线性查找的最坏情况 (仅输出耗时, 不作为判断条件)
+    const std::string method = "POST", uri = "/bench/r127/get";
+    const int n = 100000;
+    int64_t sum = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)sum += *table.find(method, uri);
+    auto t1 = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)sum += findLinear(method, uri);
+    auto t2 = std::chrono::steady_clock::now();
+    ASSERT_EQ(sum, 127LL * n * 2);
+    const auto table_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / n;
+    const auto linear_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count() / n;
+    ifr::logger::log("API", "route dispatch (ns), table", table_ns);
+    ifr::logger::log("API", "route dispatch (ns), linear", linear_ns);
+}
+
+TEST(API, ws_queue) {
+    startServer();
+    struct Data {
+        bool open = false;
+        int frames = 0;
+        std::vector<std::string> lines;
+    } data;
+    mg_mgr mgr{};
+    mg_mgr_init(&mgr);
+    mg_ws_connect(&mgr, "ws://127.0.0.1:18000/ws", [](mg_connection *c, int ev, void *ev_data, void *fn_data) {
+        auto &d = *(Data *) fn_data;
+        if (ev == MG_EV_WS_OPEN)d.open = true;
+        if (ev != MG_EV_WS_MSG)return;
+        const auto wm = (mg_ws_message *) ev_data;
+        std::stringstream ss(std::string(wm->data.ptr, wm->data.len));
+        d.frames++;
+        for (std::string line; std::getline(ss, line);)d.lines.push_back(line);
+    }, &data, nullptr);
+    for (int i = 0; i < 100 && (!data.open || data.lines.empty()); i++)mg_mgr_poll(&mgr, 10);
+    ASSERT_TRUE(data.open);
+    data.lines.clear(), data.frames = 0;
+
+    std::vector<std::thread> threads;//多个线程同时发送
+    for (int t = 0; t < 4; t++)
+        threads.emplace_back([t]() {
+            for (int i = 0; i < 50; i++)
+                ifr::API::sendWs(ifr::Plans::LOG, "test", std::to_string(t), std::to_string(i));
+        });
+    for (auto &t: threads)t.join();
+    for (int i = 0; i < 200 && data.lines.size() < 200; i++)mg_mgr_poll(&mgr, 10);
+    ifr::logger::log("API", "ws frames", data.frames);
+    ASSERT_EQ(data.lines.size(), 200);
+    mg_mgr_free(&mgr);
+}
+
+TEST(API, telemetry) {
+    startServer();
+    auto tw = ifr::API::registerTimePoint("telemetry", 1, 2, 1);
+    tw->start(0), tw->setTime(0, 0, 10), tw->setTime(1, 0, 20);
+    ifr::API::setTelemetryInterval(20);
+
+    struct Data {
+        mg_connection *c = nullptr;
+        bool open = false;
+        std::map<uint8_t, std::string> frames;//主题 - 最近一帧
+    } data;
+    mg_mgr mgr{};
+    mg_mgr_init(&mgr);
+    data.c = mg_ws_connect(&mgr, "ws://127.0.0.1:18000/ws", [](mg_connection *c, int ev, void *ev_data, void *fn_data) {
+        auto &d = *(Data *) fn_data;
+        if (ev == MG_EV_WS_OPEN)d.open = true;
+        if (ev != MG_EV_WS_MSG)return;
+        const auto wm = (mg_ws_message *) ev_data;
+        if ((wm->flags & 0x0F) == WEBSOCKET_OP_BINARY && wm->data.len > 0)
+            d.frames[wm->data.ptr[0]] = std::string(wm->data.ptr, wm->data.len);
+    }, &data, nullptr);
+    for (int i = 0; i < 100 && !data.open; i++)mg_mgr_poll(&mgr, 10);
+    ASSERT_TRUE(data.open);
+    const std::string sub = R"({"sub":["time","plan"]})";
+    mg_ws_send(data.c, sub.c_str(), sub.length(), WEBSOCKET_OP_TEXT);
+    for (int i = 0; i < 100 && data.frames.size() < 2; i++)mg_mgr_poll(&mgr, 10);
+    ASSERT_TRUE(data.frames.count(1));//time
+    ASSERT_TRUE(data.frames.count(3));//plan, 新订阅时立即推送
+    ASSERT_FALSE(data.frames.count(2));//未订阅vars
+    ASSERT_NE(data.frames[1].find("telemetry"), std::string::npos);
+    ifr::logger::log("API", "telemetry time frame bytes", data.frames[1].length());
+    mg_mgr_free(&mgr);
+    ifr::API::setTelemetryInterval(100);
+}
+
+TEST(API, time_histogram) {
+    ifr::API::TimeWatcher tw("histogram", 1, 2, 2, 5000);//单位1 tick = 1ms, 窗口5s
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < 2; w++)
+        threads.emplace_back([&tw, w]() {
+            for (int i = 1; i <= 1000; i++) {
+                tw.start(w);
+                tw.setTime(0, w, 10000);
+                tw.setTime(1, w, 10000 + i);//耗时 1..1000 ms
+            }
+        });
+    for (auto &t: threads)t.join();
+    auto st = tw.stats(0);
+    ifr::logger::log("API", "histogram", tw.getTime());
+    ASSERT_EQ(st.n, 2000);
+    ASSERT_NEAR(st.p50, 500, 500 * 0.125);
+    ASSERT_NEAR(st.p99, 990, 990 * 0.125);
+    ASSERT_EQ(st.max, 1000);
+    ASSERT_EQ(tw.stats(0, 1).n, 1000);
+
+    //超出滑动窗口的数据不再计入
+    tw.start(0), tw.setTime(0, 0, 20000), tw.setTime(1, 0, 20002);
+    st = tw.stats(0);
+    ASSERT_EQ(st.n, 1);
+    ASSERT_EQ(st.max, 2);
+
+    //大量记录: 计数不丢失 (耗时仅输出, 不作为判断条件)
+    const int n = 1000000;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)tw.start(0), tw.setTime(0, 0, 20000), tw.setTime(1, 0, 20000 + i % 100);
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0);
+    ifr::logger::log("API", "histogram record (ns)", ns.count() / n);
+    st = tw.stats(0);
+    ASSERT_EQ(st.n, n + 1);
+    ASSERT_EQ(st.max, 99);
+    ASSERT_NEAR(st.p50, 49, 49 * 0.125);
+}
+
+TEST(API, probe) {
+    static constexpr ifr::API::PointNames points{"begin", "detect", "end"};
+    static_assert(IFRAPI_PROBE_INDEX(points, "detect") == 1);
+    const auto tw = ifr::API::registerTimePoint("probe", points, 1);
+    ASSERT_GT(tw->unit_ms, 0);
+
+    const auto c0 = ifr::API::FastClock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    const auto elapsed = (double) (ifr::API::FastClock::now() - c0) / ifr::API::FastClock::ticksPerMs();
+    ASSERT_GE(elapsed, 4.5);//与steady_clock的校准一致
+    ASSERT_LT(elapsed, 500);
+
+    //耗时仅输出, 不作为判断条件
+    const int n = 100000;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) {
+        IFRAPI_PROBE_SCOPE(tw, points, "begin", "end", 0);
+        IFRAPI_PROBE(tw, points, "detect", 0);
+    }
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0);
+    ifr::logger::log("API", "probe round (ns)", ns.count() / n);
+    ifr::logger::log("API", "probe", tw->getTime());
+    ASSERT_EQ(tw->stats(0).n, n);//begin -> detect
+    ASSERT_EQ(tw->stats(1).n, n);//detect -> end
+
+    {//耗时约2ms
+        IFRAPI_PROBE_SCOPE(tw, points, "begin", "end", 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        IFRAPI_PROBE(tw, points, "detect", 0);
+    }
+    ASSERT_NEAR(tw->stats(0).max, 2, 1.5);
+    ASSERT_NE(tw->getTime().find("\"names\":[\"begin\",\"detect\",\"end\"]"), std::string::npos);
+}
+
+TEST(API, tunable) {
+    ifr::API::Tunable<int> gain(3);
+    static_assert(ifr::API::Tunable<int>::lock_free);
+    int derived = gain * 2, hooked = 0;
+    uint64_t seen = gain.version();
+    gain.onChange([&hooked](const int &v) { hooked = v; });
+
+    ifr::API::Variable var("test", "gain", &gain, 3, 0, 10);
+    var.setValue("7");
+    ASSERT_EQ(var.getValue(), "7");
+    ASSERT_EQ(hooked, 7);
+    if (gain.changed(seen))derived = gain * 2;
+    ASSERT_EQ(derived, 14);
+    ASSERT_FALSE(gain.changed(seen));
+    gain = 7;//值未变化
+    ASSERT_FALSE(gain.changed(seen));
+    ifr::API::Tunable<int> limit(5);
+    gain.onChange([&gain, &limit](const int &v) { if (v > limit)gain = limit.get(); });//钩子中读写可调变量
+    gain = 9;
+    ASSERT_EQ(gain.get(), 5);
+    ASSERT_EQ(hooked, 5);
+
+    struct Roi {
+        double x, y, w, h;
+    };
+    static_assert(!ifr::API::Tunable<Roi>::lock_free);
+    ifr::API::Tunable<Roi> roi({0, 0, 0, 0});
+    std::atomic_bool stop{false};
+    std::thread writer([&]() {
+        for (int i = 1; !stop; i++)roi.set({(double) i, (double) i, (double) i, (double) i});
+    });
+    for (int i = 0; i < 100000; i++) {
+        const Roi r = roi;
+        ASSERT_TRUE(r.x == r.y && r.y == r.w && r.w == r.h);//不会读到写了一半的值
+    }
+    stop = true;
+    writer.join();
+}
+
+TEST(API, vars_bulk) {
+    startServer();
+    std::string resp;
+    for (int i = 0; i < 50 && resp.find("200 OK") == std::string::npos; i++) {
+        SLEEP(SLEEP_TIME(0.05));
+        resp = httpRequest("GET /vars/values?keys=test%20bulk_a,test%20bulk_b HTTP/1.0\r\n\r\n");
+    }
+    ASSERT_NE(resp.find("200 OK"), std::string::npos);
+
+    const auto post = [](const std::string &path, const std::string &body) {
+        return httpRequest("POST " + path + " HTTP/1.0\r\nContent-Length: " + std::to_string(body.length()) +
+                           "\r\n\r\n" + body);
+    };
+    resp = post("/vars/values", R"({"test bulk_a":3,"test bulk_b":"11"})");//超出范围: 全部不写入
+    ASSERT_NE(resp.find("400"), std::string::npos);
+    ASSERT_EQ(bulk_a.get(), 1);
+    resp = post("/vars/values", R"({"test bulk_a":3,"test bulk_b":"4"})");
+    ASSERT_NE(resp.find(R"({"test bulk_a":"3","test bulk_b":"4"})"), std::string::npos);
+    ASSERT_EQ(bulk_a + bulk_b, 7);
+
+    //单个变量
+    ASSERT_EQ(post("/vars/var?key=test%20bulk_a", "11").find("200 OK"), std::string::npos);//超出范围
+    resp = post("/vars/var?key=test%20bulk_a", "5");
+    ASSERT_EQ(resp.substr(resp.length() - 1), "5");
+    resp = httpRequest("GET /vars/var?key=test%20bulk_a HTTP/1.0\r\n\r\n");
+    ASSERT_EQ(resp.substr(resp.length() - 1), "5");
+    ASSERT_NE(httpRequest("GET /vars/var?key=none HTTP/1.0\r\n\r\n").find("404"), std::string::npos);
+    bulk_a = 3;
+
+    //类型描述: 包含已注册变量的类型
+    resp = httpRequest("GET /vars/descriptions HTTP/1.0\r\n\r\n");
+    ASSERT_NE(resp.find(R"("int":"int")"), std::string::npos);
+    ASSERT_NE(resp.find(R"("enum{RED,BLUE}":{"base":"enum","names":["RED","BLUE"]})"), std::string::npos);
+    ASSERT_NE(resp.find(R"("array<enum{RED,BLUE},2>":{"base":"array","element":{"base":"enum","names":["RED","BLUE"]},"size":2})"),
+              std::string::npos);
+
+    ASSERT_NE(post("/vars/preset?name=test-preset", "").find("204"), std::string::npos);
+    bulk_a = 9, bulk_b = 9;
+    resp = httpRequest("GET /vars/preset/apply?name=test-preset HTTP/1.0\r\n\r\n");
+    ASSERT_NE(resp.find("200 OK"), std::string::npos);
+    ASSERT_EQ(bulk_a + bulk_b, 7);
+    ASSERT_NE(httpRequest("GET /vars/presets HTTP/1.0\r\n\r\n").find("test-preset"), std::string::npos);
+    resp = httpRequest("DELETE /vars/preset?name=test-preset HTTP/1.0\r\n\r\n");
+    ASSERT_EQ(resp.substr(resp.length() - 4), "true");
+    resp = httpRequest("GET /vars/preset/apply?name=test-preset HTTP/1.0\r\n\r\n");
+    ASSERT_NE(resp.find("404"), std::string::npos);
+}
+
+TEST(API, var_traits) {
+    typedef std::array<int, 6> Hsv;
+    ifr::API::Tunable<Hsv> hsv({0, 43, 46, 10, 255, 255});
+    ifr::API::Variable hv("test", "hsv", &hsv, hsv.get(), Hsv{}, Hsv{180, 255, 255, 180, 255, 255});
+    ASSERT_EQ(hv.type_, "array<int,6>");
+    ASSERT_EQ(hv.getValue(), "[0,43,46,10,255,255]");
+    ASSERT_TRUE(hv.checkValue("100, 43, 46, 124, 255, 255"));
+    ASSERT_FALSE(hv.checkValue("[0,43,46,10,255,256]"));//超出范围
+    ASSERT_FALSE(hv.checkValue("[0,43,46,10,255]"));//数量不足
+    hv.setValue("[100,43,46,124,255,255]");
+    ASSERT_EQ(hsv.get()[3], 124);
+
+    ifr::API::Tunable<Color> color(Color::RED);
+    ifr::API::Variable cv("test", "color", &color, Color::RED, Color::RED, Color::BLUE);
+    ASSERT_EQ(cv.type_, "enum{RED,BLUE}");
+    cv.setValue("BLUE");
+    ASSERT_EQ(color.get(), Color::BLUE);
+    ASSERT_EQ(cv.getValue(), "BLUE");
+    ASSERT_FALSE(cv.checkValue("GREEN"));
+
+    ifr::API::Tunable<std::string> model(std::string("armor.onnx"));
+    ifr::API::Variable mv("test", "model", &model, model.get(), model.get(), model.get(), false);
+    ASSERT_EQ(mv.type_, "string");
+    ASSERT_EQ(mv.min_, "");
+    mv.setValue("armor-v2.onnx");
+    ASSERT_EQ(*model.share(), "armor-v2.onnx");
+
+    ASSERT_EQ(ifr::API::VarTraits<double>::type(), "double");
+    ASSERT_FALSE(ifr::API::Variable("test", "i", &bulk_a, 1, 0, 10).checkValue("3abc"));
+}
+
+TEST(API, log_stream) {
+    startServer();
+    struct Data {
+        mg_connection *c = nullptr;
+        bool open = false;
+        std::vector<std::string> msgs;
+    } data;
+    mg_mgr mgr{};
+    mg_mgr_init(&mgr);
+    data.c = mg_ws_connect(&mgr, "ws://127.0.0.1:18000/ws", [](mg_connection *c, int ev, void *ev_data, void *fn_data) {
+        auto &d = *(Data *) fn_data;
+        if (ev == MG_EV_WS_OPEN)d.open = true;
+        if (ev != MG_EV_WS_MSG)return;
+        const auto wm = (mg_ws_message *) ev_data;
+        rapidjson::Document doc;
+        doc.Parse(wm->data.ptr, wm->data.len);
+        if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("logs"))return;
+        for (const auto &e: doc["logs"].GetArray())
+            d.msgs.push_back(std::string(e["level"].GetString()) + " " + e["sub-type"].GetString() + e["msg"].GetString());
+    }, &data, nullptr);
+    for (int i = 0; i < 100 && !data.open; i++)mg_mgr_poll(&mgr, 10);
+    ASSERT_TRUE(data.open);
+    const std::string sub = R"({"log":{"types":["wslog"],"level":"WARN","regex":"keep"}})";
+    mg_ws_send(data.c, sub.c_str(), sub.length(), WEBSOCKET_OP_TEXT);
+    for (int i = 0; i < 20; i++)mg_mgr_poll(&mgr, 10);//等待服务器处理订阅
+
+    ifr::logger::log("wslog", "keep 1");//级别不足
+    ifr::logger::err("wslog", "keep 2");
+    ifr::logger::err("wslog", "drop 3");//不匹配regex
+    ifr::logger::err("other", "keep 4");//分类不匹配
+    IFR_WARNF("wslog", "keep {}", 5);
+    ifr::logger::flush();
+    for (int i = 0; i < 100 && data.msgs.size() < 2; i++)mg_mgr_poll(&mgr, 10);
+    const std::vector<std::string> expect = {"ERROR keep 2", "WARN keep 5"};
+    ASSERT_EQ(data.msgs, expect);
+    mg_mgr_free(&mgr);
+}
@@ -5,7 +5,11 @@
 
 #include "gtest/gtest.h"
 #include "config/config.h"
+#include "config/schema.h"
 #include "logger/logger.hpp"
+#include <atomic>
+#include <thread>
+#include <sys/stat.h>
 
 TEST(CONFIG, basic) {
     struct Point {
@@ -38,3 +42,223 @@ TEST(CONFIG, basic) {
     ifr::logger::log("Test", "no save and read value: " + std::to_string(point.x) + ", " + std::to_string(point.y));
 }
 
+
+TEST(CONFIG, persist) {//原子写入, 合并写入及跳过未变化的内容
+    struct Point {
+        int x, y;
+    } point{1, 2};
+    static ifr::Config::ConfigInfo<Point> info = {
+            [](auto *a, auto &w) {
+                w.StartObject();
+                w.Key("x"), w.Int(a->x);
+                w.Key("y"), w.Int(a->y);
+                w.EndObject();
+            },
+            [](auto *a, auto &d) {
+                a->x = d["x"].GetInt();
+                a->y = d["y"].GetInt();
+            }
+    };
+    const auto path = std::filesystem::absolute(ifr::Config::dir + "persist.json");
+    std::filesystem::remove(path);
+    const auto read = [&path]() {
+        std::ifstream in(path);
+        return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    };
+    const auto inode = [&path]() {
+        struct stat st{};
+        return stat(path.c_str(), &st) == 0 ? st.st_ino : 0;
+    };
+
+    auto cc = ifr::Config::createConfig("persist", &point, info);
+    cc.save();
+    cc.flush();
+    ASSERT_EQ(read(), R"({"x":1,"y":2})");
+    const auto ino = inode();
+
+    cc.save();//内容未变化: 不写入
+    cc.flush();
+    ASSERT_EQ(inode(), ino);
+
+    ifr::Config::Persist::setDelay(60000);
+    for (int i = 0; i < 100; i++)point.x = i, cc.save();//合并为一次写入
+    ASSERT_EQ(read(), R"({"x":1,"y":2})");
+    point.x = -1;
+    cc.load();//先写入未完成的保存
+    ASSERT_EQ(point.x, 99);
+    ASSERT_EQ(read(), R"({"x":99,"y":2})");
+    ASSERT_NE(inode(), ino);//重命名替换
+    ASSERT_FALSE(std::filesystem::exists(path.string() + ".tmp"));
+
+    ifr::Config::Persist::setDelay(20);
+    point.y = 3;
+    cc.save();
+    for (int i = 0; i < 100 && read() != R"({"x":99,"y":3})"; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(read(), R"({"x":99,"y":3})");
+    ifr::Config::Persist::setDelay(200);
+    std::filesystem::remove(path);
+}
+
+TEST(CONFIG, watch) {//外部修改后重新加载, 忽略自身写入
+    struct Point {
+        int x, y;
+    } point{1, 2};
+    static std::atomic_int loads{0};
+    static ifr::Config::ConfigInfo<Point> info = {
+            [](auto *a, auto &w) {
+                w.StartObject();
+                w.Key("x"), w.Int(a->x);
+                w.Key("y"), w.Int(a->y);
+                w.EndObject();
+            },
+            [](auto *a, auto &d) {
+                a->x = d["x"].GetInt();
+                a->y = d["y"].GetInt();
+                loads++;
+            }
+    };
+    const auto path = std::filesystem::absolute(ifr::Config::dir + "watch.json").string();
+    const auto write = [&path](const std::string &content) {
+        std::ofstream(path, std::ios::trunc) << content;
+    };
+    const auto wait = [](int n) {
+        for (int i = 0; i < 200 && loads < n; i++)std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        return loads.load();
+    };
+    ifr::Config::Watch::setDebounce(50);
+    write(R"({"x":1,"y":2})");
+    auto cc = ifr::Config::createConfig("watch", &point, info);
+    cc.load();
+    ASSERT_EQ(loads, 1);
+
+    point.x = 5;
+    cc.save();
+    cc.flush();
+    ASSERT_EQ(wait(2), 1);//自身写入
+
+    write(R"({"x":7,"y":8})");//直接写入
+    ASSERT_EQ(wait(2), 2);
+    ASSERT_EQ(point.x, 7);
+    ASSERT_EQ(point.y, 8);
+
+    write(R"({"x":9,)");//格式错误
+    ASSERT_EQ(wait(3), 2);
+    ASSERT_EQ(point.x, 7);
+
+    ifr::Config::Persist::writeAtomic(path, R"({"x":10,"y":11})");//重命名替换
+    ASSERT_EQ(wait(3), 3);
+    ASSERT_EQ(point.x, 10);
+
+    cc.watch.reset();//停止监视
+    write(R"({"x":12,"y":13})");
+    ASSERT_EQ(wait(4), 3);
+    ifr::Config::Watch::setDebounce(300);
+    std::filesystem::remove(path);
+}
+
+namespace {
+    enum class Mode {
+        OFF, AUTO, MANUAL
+    };
+
+    struct Camera {
+        std::string name;
+        int exposure = 1000;
+        double gain = 1;
+        bool enable = false;
+        std::vector<int> roi;
+        Mode mode = Mode::OFF;
+
+        static auto schema() {
+            using ifr::Config::Schema::field;
+            return std::make_tuple(
+                    field("name", &Camera::name).required(),
+                    field("exposure", &Camera::exposure).range(1, 100000).def(2000),
+                    field("gain", &Camera::gain).range(0, 16),
+                    field("enable", &Camera::enable),
+                    field("roi", &Camera::roi).check([](const auto &v) { return v.empty() || v.size() == 4; },
+                                                     "roi should have 4 values"),
+                    field("mode", &Camera::mode)
+            );
+        }
+    };
+
+    struct Settings {
+        int version = 0;
+        Camera main;
+        std::map<std::string, Camera> cams;
+        std::vector<std::string> tags;
+
+        static auto schema() {
+            using ifr::Config::Schema::field;
+            return std::make_tuple(
+                    field("version", &Settings::version).required(),
+                    field("main", &Settings::main),
+                    field("cams", &Settings::cams),
+                    field("tags", &Settings::tags)
+            );
+        }
+    };
+}
+
+TEST(CONFIG, schema) {//声明式绑定: 读写, 默认值, 校验
+    namespace S = ifr::Config::Schema;
+    Settings s;
+    std::string error;
+    ASSERT_TRUE(S::read(R"({"version":2,"main":{"name":"a","gain":2.5,"enable":true,"roi":[1,2,3,4],"mode":1},
+                           "cams":{"b":{"name":"b","exposure":50}},"tags":["x","y"],
+                           "unknown":{"deep":[1,{"a":[]}]}})", s, error)) << error;
+    ASSERT_EQ(s.version, 2);
+    ASSERT_EQ(s.main.name, "a");
+    ASSERT_EQ(s.main.exposure, 2000);//默认值
+    ASSERT_EQ(s.main.gain, 2.5);
+    ASSERT_TRUE(s.main.enable);
+    ASSERT_EQ(s.main.roi, std::vector<int>({1, 2, 3, 4}));
+    ASSERT_EQ(s.main.mode, Mode::AUTO);
+    ASSERT_EQ(s.cams["b"].exposure, 50);
+    ASSERT_EQ(s.cams["b"].gain, 1);//结构体的初始值
+    ASSERT_EQ(s.tags, std::vector<std::string>({"x", "y"}));
+
+    rapidjson::StringBuffer buf;
+    rapidjson::Writer<rapidjson::StringBuffer> w(buf);
+    S::write(w, s);
+    Settings s2;
+    ASSERT_TRUE(S::read(buf.GetString(), s2, error)) << error;
+    rapidjson::StringBuffer buf2;
+    rapidjson::Writer<rapidjson::StringBuffer> w2(buf2);
+    S::write(w2, s2);
+    ASSERT_STREQ(buf.GetString(), buf2.GetString());
+
+    const auto fail = [](const std::string &json) {
+        Settings t;
+        std::string err;
+        EXPECT_FALSE(S::read(json, t, err));
+        return err;
+    };
+    ASSERT_EQ(fail(R"({"main":{"name":"a"}})"), "version: missing");
+    ASSERT_EQ(fail(R"({"version":1,"cams":{"c":{"exposure":5}}})"), "cams.c.name: missing");
+    ASSERT_EQ(fail(R"({"version":1,"main":{"name":"a","exposure":0}})").find("main.exposure: out of range"), 0);
+    ASSERT_EQ(fail(R"({"version":1,"main":{"name":"a","roi":[1]}})"), "main.roi: roi should have 4 values");
+    ASSERT_EQ(fail(R"({"version":"1"})"), "version: type mismatch");
+    ASSERT_EQ(fail(R"({"version":1,"tags":["a",2]})"), "tags[1]: type mismatch");
+    ASSERT_EQ(fail(R"({"version":1,"main":[]})"), "main: unexpected array");
+    ASSERT_NE(fail(R"({"version":1,)"), "");
+
+    static std::mutex mtx;
+    static const auto info = S::info<Settings>(&mtx);
+    const auto path = std::filesystem::absolute(ifr::Config::dir + "schema.json");
+    Settings data;
+    auto cc = ifr::Config::createConfig("schema", &data, info);
+    data = s;
+    cc.save();
+    data = {};
+    cc.load();
+    ASSERT_EQ(data.main.name, "a");
+    ASSERT_EQ(data.cams.size(), 1);
+    std::ofstream(path, std::ios::trunc) << R"({"version":-1)";
+    cc.load();//格式错误: 保留当前数据
+    ASSERT_EQ(data.version, 2);
+    std::filesystem::remove(path);
+}
@@ -3,7 +3,8 @@
 //
 
 #include "gtest/gtest.h"
-#include "logger/logger.hpp"
+#include "logger/rotating.hpp"
+#include <filesystem>
 
 TEST(LOGGER, basic) {
     ifr::logger::log("type", "sub", "some str");
@@ -24,4 +25,195 @@ TEST(LOGGER, n_thread) {
     for (const auto &x: ts)while (!x.joinable());
     for (auto &x: ts)x.join();
 
-}
\ No newline at end of file
+}
+TEST(LOGGER, async) {
+    std::mutex mtx;
+    std::vector<ifr::logger::Entry> got;
+    ifr::logger::flush();
+    ifr::logger::addSink([&](const std::vector<ifr::logger::Entry> &entries) {
+        std::unique_lock<std::mutex> lock(mtx);
+        for (const auto &e: entries)if (e.type == "async")got.push_back(e);
+    });
+    const int threads = 8, loop = 5000;
+    std::vector<std::thread> ts;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < threads; i++)
+        ts.emplace_back([i]() { for (int j = 0; j < loop; j++)ifr::logger::log("async", i, "loop", j); });
+    for (auto &x: ts)x.join();
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0);
+    ifr::logger::flush();
+    ifr::logger::clearSinks();
+    ifr::logger::log("LOGGER", "async log (ns)", ns.count() / threads / loop);
+
+    ASSERT_EQ(got.size(), threads * loop);
+    std::vector<int> next(threads, 0);
+    for (const auto &e: got) {
+        ASSERT_EQ(std::to_string(next[e.id]++), e.text);//同一线程内保持顺序
+        ASSERT_EQ(e.line(), "[async " + std::to_string(e.id) + "] loop: " + e.text);
+    }
+}
+
+TEST(LOGGER, deferred) {
+    std::mutex mtx;
+    std::vector<ifr::logger::Entry> got;
+    const auto path = (std::filesystem::temp_directory_path() / "ifr-logger-test.ifrlog").string();
+    ifr::logger::flush();
+    ifr::logger::addSink([&](const std::vector<ifr::logger::Entry> &entries) {
+        std::unique_lock<std::mutex> lock(mtx);
+        for (const auto &e: entries)if (e.type == "deferred")got.push_back(e);
+    });
+    ifr::logger::addSink(ifr::logger::Binary::fileSink(path));
+
+    const std::string name = "armor";
+    const auto t0 = std::chrono::steady_clock::now();
+    const int n = 1000;
+    for (int i = 0; i < n; i++)IFR_LOGF("deferred", "i={} x={} {} ok={}", i, 2.5, name, i % 2 == 0);
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0);
+    IFR_ERRF("deferred", "no args");
+    ifr::logger::log("deferred", "sub", "text");
+    ifr::logger::flush();
+    ifr::logger::clearSinks();
+    ifr::logger::log("LOGGER", "deferred log (ns)", ns.count() / n);
+
+    ASSERT_EQ(got.size(), n + 2);
+    ASSERT_EQ(got[0].line(), "[deferred] i=0 x=2.5 armor ok=true");
+    ASSERT_EQ(got[n - 1].line(), "[deferred] i=999 x=2.5 armor ok=false");
+    ASSERT_TRUE(got[n].error);
+    ASSERT_EQ(got[n].line(), "[deferred] no args");
+
+    std::ifstream in(path, std::ios::binary);
+    const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::vector<std::string> lines;
+    ASSERT_TRUE(ifr::logger::Binary::decode(data, [&](const ifr::logger::Entry &e) {
+        if (e.type == "deferred")lines.push_back(e.line());
+    }));
+    ASSERT_EQ(lines.size(), n + 2);
+    for (size_t i = 0; i < lines.size(); i++)ASSERT_EQ(lines[i], got[i].line());
+    std::filesystem::remove(path);
+}
+
+TEST(LOGGER, level) {
+    std::vector<std::string> got;
+    std::mutex mtx;
+    ifr::logger::addSink([&](const std::vector<ifr::logger::Entry> &entries) {
+        std::unique_lock<std::mutex> lock(mtx);
+        for (const auto &e: entries)
+            if (e.type == "level")got.push_back(std::string(ifr::logger::levelName(e.level)) + " " + e.sub_type + e.message());
+    });
+
+    const auto round = [](int i) {
+        IFR_LOG_DEBUG("level", "debug ", i);
+        IFR_LOGF_DEBUG("level", "debugf {}", i);
+        ifr::logger::log("level", "info ", i);
+        IFR_WARNF("level", "warnf {}", i);
+        ifr::logger::err("level", "error ", i);
+    };
+    round(0);//默认INFO
+    ifr::logger::Levels::set("level", ifr::logger::LV_DEBUG);
+    round(1);
+    ifr::logger::Levels::set("level", ifr::logger::LV_ERROR);
+    round(2);
+    ASSERT_TRUE(ifr::logger::Levels::reset("level"));
+    round(3);
+    ifr::logger::flush();
+    ifr::logger::clearSinks();
+
+    const std::vector<std::string> expect = {
+            "INFO info 0", "WARN warnf 0", "ERROR error 0",
+            "DEBUG debug 1", "DEBUG debugf 1", "INFO info 1", "WARN warnf 1", "ERROR error 1",
+            "ERROR error 2",
+            "INFO info 3", "WARN warnf 3", "ERROR error 3",
+    };
+    ASSERT_EQ(got, expect);
+
+    ifr::logger::Level l;
+    ASSERT_TRUE(ifr::logger::parseLevel("WARN", l));
+    ASSERT_EQ(l, ifr::logger::LV_WARN);
+    ASSERT_FALSE(ifr::logger::parseLevel("LOUD", l));
+
+    //定位打印同样受级别控制
+    int loc = 0;
+    ifr::logger::addSink([&](const std::vector<ifr::logger::Entry> &entries) {
+        for (const auto &e: entries)if (e.message().find("loc_probe") != std::string::npos)loc++;
+    });
+    const int loc_probe = 1;
+    ifr::logger::Levels::set("", ifr::logger::LV_WARN);
+    IFR_LOC_LOGGER(loc_probe);
+    ifr::logger::Levels::set("", ifr::logger::LV_INFO);
+    IFR_LOC_LOGGER(loc_probe);
+    ifr::logger::flush();
+    ifr::logger::clearSinks();
+    ASSERT_EQ(loc, 1);
+}
+
+TEST(LOGGER, rotating) {
+    const auto dir = (std::filesystem::temp_directory_path() / "ifr-logger-rotating").string();
+    std::filesystem::remove_all(dir);
+    ifr::logger::Rotating::Options opt;
+    opt.dir = dir, opt.segment_size = 64 << 10, opt.max_segments = 3;
+
+    std::vector<std::string> lines;
+    const auto decodeAll = [&]() {
+        lines.clear();
+        return ifr::logger::Rotating::decodeDir(dir, [&](const ifr::logger::Entry &e) {
+            if (e.type == "rotating")lines.push_back(e.message());
+        });
+    };
+
+    //未结束的分段: 文件为预分配的大小, 末尾为0填充
+    auto w = std::make_unique<ifr::logger::Rotating::Writer>(opt);
+    ifr::logger::Entry e{ifr::logger::Async::now(), false, -1, "rotating", "", "open segment"};
+    w->write({e});
+    ASSERT_EQ(ifr::logger::Rotating::list(dir).size(), 1);
+    ASSERT_EQ(std::filesystem::file_size(ifr::logger::Rotating::list(dir)[0]), opt.segment_size);
+    ASSERT_TRUE(decodeAll());
+    ASSERT_EQ(lines, std::vector<std::string>{"open segment"});
+    w.reset();
+    ASSERT_LT(std::filesystem::file_size(ifr::logger::Rotating::list(dir)[0]), 100);
+
+    ifr::logger::addSink(ifr::logger::Rotating::fileSink(opt));
+    const int n = 10000;
+    for (int i = 0; i < n; i++)IFR_LOGF("rotating", "record {}", i);
+    ifr::logger::flush();
+    ifr::logger::clearSinks();
+
+    const auto files = ifr::logger::Rotating::list(dir);
+    ASSERT_EQ(files.size(), opt.max_segments);
+    for (const auto &f: files)ASSERT_LE(std::filesystem::file_size(f), opt.segment_size);
+    ASSERT_TRUE(decodeAll());
+    ASSERT_GT(lines.size(), 100);
+    const auto first = n - (int) lines.size();
+    for (size_t i = 0; i < lines.size(); i++)ASSERT_EQ(lines[i], "record " + std::to_string(first + i));
+    std::filesystem::remove_all(dir);
+}
+
+TEST(LOGGER, limit) {
+    std::vector<std::string> got;
+    std::mutex mtx;
+    ifr::logger::addSink([&](const std::vector<ifr::logger::Entry> &entries) {
+        std::unique_lock<std::mutex> lock(mtx);
+        for (const auto &e: entries)if (e.type == "limit")got.push_back(e.sub_type + e.message());
+    });
+
+    //等待进入新的一秒, 保证以下循环在同一个窗口内
+    const auto sec = ifr::logger::Limit::clock() / 1000000000;
+    while (ifr::logger::Limit::clock() / 1000000000 == sec)std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    for (int i = 0; i < 100; i++)IFR_LOGF_LIMIT(ifr::logger::LV_INFO, 3, "limit", "rate {}", i);
+    int allowed = 0;
+    for (int i = 0; i < 100; i++)allowed += IFR_RATE_LIMIT(5);
+
+    const auto dedup = [](int v) { IFR_LOGF_DEDUP(ifr::logger::LV_INFO, "limit", "value {}", v); };
+    for (int v: {1, 1, 1, 2, 2, 1})dedup(v);
+    const auto text = [](const std::string &v) { IFR_LOG_DEDUP(ifr::logger::LV_WARN, "limit", "text ", v); };
+    for (const char *v: {"a", "a", "b"})text(v);
+    ifr::logger::flush();
+    ifr::logger::clearSinks();
+
+    const std::vector<std::string> expect = {
+            "rate 0", "rate 1", "rate 2",
+            "value 1", "last message repeated 2 times", "value 2", "last message repeated 1 times", "value 1",
+            "text a", "last message repeated 1 times", "text b",
+    };
+    ASSERT_EQ(got, expect);
+    ASSERT_EQ(allowed, 5);
+}
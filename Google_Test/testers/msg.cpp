@@ -162,6 +162,20 @@ TEST(MSG, no_lock) {//未锁定测试
     }
 }
 
+TEST(MSG, sub_before_pub) {//订阅者先于发布者注册, 且在发布者注册前被销毁
+    {
+        ifr::Msg::Subscriber<std::string> sub("early");
+    }
+    ifr::Msg::Subscriber<std::string> live("early");
+    {
+        ifr::Msg::Subscriber<std::string> sub("early");
+    }
+    ifr::Msg::Publisher<std::string> pub("early");
+    pub.lock(true);
+    pub.push("data");//只分发给仍存在的订阅者
+    ASSERT_EQ(live.pop(), "data");
+}
+
 TEST(MSG, reuse_channel) {//频道重用测试
     log("logic", "use 1");
     test_basic();
@@ -5,6 +5,7 @@
 #include "gtest/gtest.h"
 #include "plan/Plans.h"
 #include "logger/logger.hpp"
+#include "msg/msg.hpp"
 
 TEST(PLAN, basic) {
     ifr::Plans::registerTask("task-1", {
@@ -13,4 +14,270 @@ TEST(PLAN, basic) {
 
     });
     ifr::logger::log("task", "Descriptions", ifr::Plans::getTaskDescriptionsJson());
-}
\ No newline at end of file
+}
+
+TEST(PLAN, budget) {
+    ifr::Plans::init();
+    ifr::Plans::TaskDescription description{"test group", "budget task"};
+    description.budget = {3, 0};
+    ifr::Plans::registerTask("task-budget", description, [](auto io, auto args, auto state, auto cb) {});
+
+    ifr::Plans::PlanInfo plan;
+    plan.loaded = true;
+    plan.name = "test-budget";
+    plan.tasks["task-budget"].enable = true;
+    ifr::Plans::savePlanInfo(plan);
+
+    ifr::Plans::setBudgetCapacity(4, 0);
+    ASSERT_TRUE(ifr::Plans::checkPlanBudget("test-budget").empty());
+
+    plan.tasks["task-budget"].budget.cpu = 8;//覆盖默认预算
+    ifr::Plans::savePlanInfo(plan);
+    const auto reject = ifr::Plans::checkPlanBudget("test-budget");
+    ifr::logger::log("task", "Over budget", reject);
+    ASSERT_FALSE(reject.empty());
+
+    ifr::logger::log("task", "Usage", ifr::Plans::getPlanUsageJson());
+    ifr::Plans::removePlanInfo("test-budget");
+    ifr::Plans::setBudgetCapacity(0, 0);
+}
+
+TEST(PLAN, typed_args) {
+    ifr::Plans::init();
+    ifr::Plans::TaskDescription description{"test group", "typed args task"};
+    description.args["threads"] = {"线程数", "4", ifr::Plans::TaskArgType::NUMBER};
+    description.args["debug"] = {"调试", "false", ifr::Plans::TaskArgType::BOOL};
+    description.args["path"] = {"路径", "a.mp4", ifr::Plans::TaskArgType::STR};
+
+    auto args = ifr::Plans::TaskArgs::parse("task-args", description, {{"threads", "8"}});
+    const auto threads = args.index("threads");
+    ASSERT_EQ(args[threads].integer, 8);
+    ASSERT_EQ(args["debug"].boolean, false);
+    ASSERT_EQ(args["path"].str, "a.mp4");
+    ASSERT_EQ(args.toMap().at("threads"), "8");
+    ASSERT_THROW((void) args.index("none"), ifr::Plans::PlanError);
+    ASSERT_THROW(ifr::Plans::TaskArgs::parse("task-args", description, {{"threads", "8x"}}),
+                 ifr::Plans::PlanError);
+
+    ifr::Plans::registerTypedTask("task-args", description, [](auto &io, auto &args, auto state, auto &cb) {});
+    ifr::Plans::PlanInfo plan;
+    plan.loaded = true;
+    plan.name = "test-args";
+    plan.tasks["task-args"].enable = true;
+    plan.tasks["task-args"].args["debug"] = "maybe";
+    ifr::Plans::savePlanInfo(plan);
+    ifr::Plans::usePlanInfo("test-args");
+    ASSERT_FALSE(ifr::Plans::startPlan());//参数错误, 不会启动任何任务
+    ASSERT_FALSE(ifr::Plans::isRunning());
+    ifr::Plans::removePlanInfo("test-args");
+}
+
+TEST(PLAN, multi_plan) {
+    ifr::Plans::init();
+    static std::atomic_int received;
+    ifr::Plans::TaskDescription src{"test group", "source task"};
+    src.io["out"] = {"int", "输出", false};
+    ifr::Plans::registerTypedTask("task-src", src, [](auto &io, auto &args, auto state, auto &cb) {
+        ifr::Plans::Tools::waitState(state, 1);
+        ifr::Msg::Publisher<int> pub(io.at("out").channel);
+        ifr::Plans::Tools::finishAndWait(cb, state, 1);
+        pub.lock();
+        cb(2);
+        for (int i = 0; *state < 3; i++) pub.push(i), SLEEP(SLEEP_TIME(0.005));
+        ifr::Plans::Tools::finishAndWait(cb, state, 3);
+    });
+    ifr::Plans::TaskDescription sink{"test group", "sink task"};
+    sink.io["in"] = {"int", "输入", true};
+    ifr::Plans::registerTypedTask("task-sink", sink, [](auto &io, auto &args, auto state, auto &cb) {
+        ifr::Plans::Tools::waitState(state, 1);
+        ifr::Msg::Subscriber<int> sub(io.at("in").channel);
+        ifr::Plans::Tools::finishAndWait(cb, state, 1);
+        cb(2);
+        while (*state < 3) {
+            try {
+                sub.pop_for(50);
+                received++;
+            } catch (ifr::Msg::MessageError_NoMsg &) {}
+        }
+        ifr::Plans::Tools::finishAndWait(cb, state, 3);
+    });
+
+    ifr::Plans::PlanInfo a, b;
+    a.loaded = b.loaded = true;
+    a.name = "test-multi-a", b.name = "test-multi-b";
+    a.tasks["task-src"].enable = true;
+    a.tasks["task-src"].io["out"] = {"test-shared"};
+    b.tasks["task-sink"].enable = true;
+    b.tasks["task-sink"].io["in"] = {"test-shared"};
+    ifr::Plans::savePlanInfo(a);
+    ifr::Plans::savePlanInfo(b);
+
+    const auto waitState = [](const std::string &name, int state) {
+        for (int i = 0; i < 100 && ifr::Plans::getState(name) != state; i++)SLEEP(SLEEP_TIME(0.05));
+        return ifr::Plans::getState(name) == state;
+    };
+    ASSERT_TRUE(ifr::Plans::startPlan("test-multi-a"));
+    ASSERT_TRUE(waitState("test-multi-a", 2));
+    ASSERT_TRUE(ifr::Plans::startPlan("test-multi-b"));//在运行中的计划上订阅
+    ASSERT_TRUE(waitState("test-multi-b", 2));
+    ASSERT_EQ(ifr::Plans::getRunningPlans().size(), 2);
+    SLEEP(SLEEP_TIME(0.2));
+    ifr::logger::log("Plan", "state", ifr::Plans::getPlanStateJson());
+
+    ifr::Plans::stopPlan("test-multi-b");
+    ASSERT_GT(received.load(), 0);
+    ASSERT_TRUE(ifr::Plans::isRunning("test-multi-a"));//订阅者退出不影响上游计划
+    ifr::Plans::stopPlan("test-multi-a");
+    ASSERT_FALSE(ifr::Plans::isRunning("test-multi-a"));
+
+    ifr::Plans::removePlanInfo("test-multi-a");
+    ifr::Plans::removePlanInfo("test-multi-b");
+}
+
+TEST(PLAN, shadow) {
+    ifr::Plans::init();
+    ifr::Plans::TaskDescription relay{"test group", "relay task"};
+    relay.io["in"] = {"int", "输入", true};
+    relay.io["out"] = {"int", "输出", false};
+    const auto body = [](auto &io, auto &args, auto state, auto &cb) {
+        ifr::Plans::Tools::waitState(state, 1);
+        ifr::Msg::Subscriber<int> sub(io.at("in").channel);
+        ifr::Msg::Publisher<int> pub(io.at("out").channel);
+        ifr::Plans::Tools::finishAndWait(cb, state, 1);
+        pub.lock();
+        cb(2);
+        while (*state < 3) {
+            try {
+                pub.push(sub.pop_for(50) + 1);
+            } catch (ifr::Msg::MessageError_NoMsg &) {}
+        }
+        ifr::Plans::Tools::finishAndWait(cb, state, 3);
+    };
+    ifr::Plans::TaskDescription src{"test group", "source task"};
+    src.io["out"] = {"int", "输出", false};
+    ifr::Plans::registerTypedTask("task-shadow-src", src, [](auto &io, auto &args, auto state, auto &cb) {
+        ifr::Plans::Tools::waitState(state, 1);
+        ifr::Msg::Publisher<int> pub(io.at("out").channel);//默认same分发, 两个任务收到相同的数据
+        ifr::Plans::Tools::finishAndWait(cb, state, 1);
+        pub.lock();
+        cb(2);
+        for (int i = 0; *state < 3; i++) pub.push(i), SLEEP(SLEEP_TIME(0.005));
+        ifr::Plans::Tools::finishAndWait(cb, state, 3);
+    });
+    ifr::Plans::registerTypedTask("task-relay", relay, body);
+    ifr::Plans::registerTypedTask("task-relay-new", relay, body);
+
+    ifr::Plans::PlanInfo plan;
+    plan.loaded = true;
+    plan.name = "test-shadow";
+    plan.tasks["task-shadow-src"].enable = true;
+    plan.tasks["task-shadow-src"].io["out"] = {"test-shadow-in"};
+    plan.tasks["task-relay"].enable = true;
+    plan.tasks["task-relay"].io["in"] = {"test-shadow-in"};
+    plan.tasks["task-relay"].io["out"] = {"test-shadow-out"};
+    plan.tasks["task-relay-new"].enable = true;
+    plan.tasks["task-relay-new"].shadow = "task-relay";//IO跟随被比较的任务
+    ifr::Plans::savePlanInfo(plan);
+
+    ASSERT_TRUE(ifr::Plans::startPlan("test-shadow"));
+    for (int i = 0; i < 100 && ifr::Plans::getState("test-shadow") != 2; i++)SLEEP(SLEEP_TIME(0.05));
+    ASSERT_EQ(ifr::Plans::getState("test-shadow"), 2);
+    SLEEP(SLEEP_TIME(0.2));
+
+    rapidjson::Document doc;
+    doc.Parse(ifr::Plans::getTaskLatencyJson("test-shadow").c_str());
+    ifr::logger::log("Plan", "latency", ifr::Plans::getTaskLatencyJson("test-shadow"));
+    ASSERT_GT(doc["tasks"]["task-relay"]["frames"].GetUint64(), 0);
+    ASSERT_GT(doc["tasks"]["task-relay-new"]["frames"].GetUint64(), 0);
+    ASSERT_STREQ(doc["shadows"]["task-relay-new"].GetString(), "task-relay");
+    ifr::Plans::stopPlan("test-shadow");
+
+    plan.tasks["task-relay"].enable = false;//被比较的任务未启用
+    ifr::Plans::savePlanInfo(plan);
+    ASSERT_FALSE(ifr::Plans::startPlan("test-shadow"));
+    ifr::Plans::removePlanInfo("test-shadow");
+}
+
+TEST(PLAN, watchdog) {
+    ifr::Plans::init();
+    static std::atomic_int runs;
+    static std::atomic_bool release;
+    ifr::Plans::TaskDescription hang{"test group", "hang task"};
+    ifr::Plans::registerTypedTask("task-hang", hang, [](auto &io, auto &args, auto state, auto &cb) {
+        ifr::Plans::Tools::waitState(state, 1);
+        runs++;
+        while (!release)SLEEP(SLEEP_TIME(0.01));//卡在初始化阶段
+    });
+
+    ifr::Plans::PlanInfo plan;
+    plan.loaded = true;
+    plan.name = "test-watchdog";
+    plan.tasks["task-hang"].enable = true;
+    ifr::Plans::savePlanInfo(plan);
+
+    ifr::Plans::setWatchdogDeadline(1, 0.3);
+    ifr::Plans::setWatchdogRestarts(1);
+    ASSERT_TRUE(ifr::Plans::startPlan("test-watchdog"));
+    for (int i = 0; i < 100 && runs < 2; i++)SLEEP(SLEEP_TIME(0.05));
+    ASSERT_EQ(runs.load(), 2);//卡死后被重启一次
+    for (int i = 0; i < 100 && ifr::Plans::isRunning("test-watchdog"); i++)SLEEP(SLEEP_TIME(0.05));
+    ASSERT_FALSE(ifr::Plans::isRunning("test-watchdog"));//超过重启次数后停止
+    ASSERT_EQ(runs.load(), 2);
+
+    release = true;
+    ifr::Plans::setWatchdogDeadline(1, 30);
+    ifr::Plans::setWatchdogRestarts(3);
+    ifr::Plans::removePlanInfo("test-watchdog");
+}
+
+TEST(PLAN, watchdog_budget) {//卡死的任务仍占用预算, 重启超出预算
+    ifr::Plans::init();
+    static std::atomic_int runs;
+    static std::atomic_bool release;
+    ifr::Plans::TaskDescription hang{"test group", "hang task"};
+    hang.budget = {3, 0};
+    ifr::Plans::registerTypedTask("task-hang-budget", hang, [](auto &io, auto &args, auto state, auto &cb) {
+        ifr::Plans::Tools::waitState(state, 1);
+        runs++;
+        while (!release)SLEEP(SLEEP_TIME(0.01));//卡在初始化阶段
+    });
+
+    ifr::Plans::PlanInfo plan;
+    plan.loaded = true;
+    plan.name = "test-watchdog-budget";
+    plan.tasks["task-hang-budget"].enable = true;
+    ifr::Plans::savePlanInfo(plan);
+
+    ifr::Plans::setBudgetCapacity(4, 0);
+    ifr::Plans::setWatchdogDeadline(1, 0.3);
+    ASSERT_TRUE(ifr::Plans::startPlan("test-watchdog-budget"));
+    for (int i = 0; i < 100 && ifr::Plans::isRunning("test-watchdog-budget"); i++)SLEEP(SLEEP_TIME(0.05));
+    ASSERT_FALSE(ifr::Plans::isRunning("test-watchdog-budget"));//卡死后被放弃
+    SLEEP(SLEEP_TIME(0.5));
+    ASSERT_FALSE(ifr::Plans::isRunning("test-watchdog-budget"));//3 + 3 > 4, 未被重启
+    ASSERT_EQ(runs.load(), 1);
+
+    release = true;
+    ifr::Plans::setWatchdogDeadline(1, 30);
+    ifr::Plans::setBudgetCapacity(0, 0);
+    ifr::Plans::removePlanInfo("test-watchdog-budget");
+}
+
+TEST(PLAN, info_schema) {//计划文件的读写及校验
+    const std::string json = R"({"name":"p1","description":"d","tasks":{"t1":{"enable":true,"io":{"in":{"channel":"c1"}},)"
+                             R"("args":{"a":"1"},"budget":{"cpu":1.5,"memory":0.0},"shadow":""}}})";
+    std::string error;
+    const auto info = ifr::Plans::PlanInfo::read(json, error);
+    ASSERT_TRUE(info.loaded) << error;
+    ASSERT_EQ(info.tasks.at("t1").io.at("in").channel, "c1");
+    ASSERT_EQ(info.tasks.at("t1").budget.cpu, 1.5);
+    rapidjson::StringBuffer buf;
+    rapidjson::Writer<rapidjson::StringBuffer> w(buf);
+    info(w);
+    ASSERT_EQ(std::string(buf.GetString()), json);
+
+    ASSERT_FALSE(ifr::Plans::PlanInfo::read(R"({"name":"p1","description":"","tasks":{"t1":{"io":{}}}})", error).loaded);
+    ASSERT_EQ(error, "tasks.t1.enable: missing");
+    ASSERT_FALSE(ifr::Plans::PlanInfo::read(R"({"name":"../x","description":"","tasks":{}})", error).loaded);
+    ASSERT_EQ(error, "name: bad plan name");
+}
@@ -0,0 +1,71 @@
+#include "gtest/gtest.h"
+#include "recorder/recorder.hpp"
+#include "logger/logger.hpp"
+#include "msg/msg.hpp"
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+static void crash(const std::string &path) {
+    ifr::Recorder::install(path);
+    ifr::Msg::Publisher<int> pub("recorder-channel");
+    ifr::Msg::Subscriber<int> sub("recorder-channel");
+    pub.lock();
+    for (int i = 0; i < 3; i++)pub.push(i), sub.pop();
+    for (size_t i = 0; i < ifr::Recorder::slot_amount + 10; i++)IFR_LOGF("recorder", "frame {} ok={}", i, true);
+    ifr::logger::err("recorder", "sub", "last words");
+    ifr::Recorder::record(ifr::Recorder::PLAN, 2, {"plan-a", " nextStep state=2"});
+    std::abort();
+}
+
+TEST(RECORDER, crash_dump) {
+    const auto path = (std::filesystem::temp_directory_path() / "ifr-recorder-test.txt").string();
+    std::filesystem::remove(path);
+    testing::FLAGS_gtest_death_test_style = "threadsafe";
+    EXPECT_DEATH(crash(path), "");
+
+    std::ifstream in(path);
+    ASSERT_TRUE(in.is_open());
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(in, line);)lines.push_back(line);
+    ASSERT_GE(lines.size(), ifr::Recorder::slot_amount);
+    EXPECT_NE(lines[0].find("SIGABRT"), std::string::npos);
+    //最早的记录被覆盖, 最后的记录按顺序保留
+    EXPECT_EQ(lines[1].find("frame 0 "), std::string::npos);
+    EXPECT_NE(lines[lines.size() - 4].find("log INFO [recorder] frame " +
+                                           std::to_string(ifr::Recorder::slot_amount + 9) + " ok=true"),
+              std::string::npos);
+    EXPECT_NE(lines[lines.size() - 3].find("log ERROR [recorder] sub: last words"), std::string::npos);
+    EXPECT_NE(lines[lines.size() - 2].find("plan plan-a nextStep state=2"), std::string::npos);
+    EXPECT_NE(lines.back().find("msg recorder-channel push=3 pop=3"), std::string::npos);
+    std::filesystem::remove(path);
+}
+
+static int overflow(int n) {
+    volatile char buf[4096];
+    buf[0] = (char) n;
+    if (n < 0)return 0;
+    return overflow(n + 1) + buf[0];
+}
+
+TEST(RECORDER, stack_overflow) {//栈溢出的线程通过备用信号栈输出
+    const auto path = (std::filesystem::temp_directory_path() / "ifr-recorder-overflow.txt").string();
+    std::filesystem::remove(path);
+    testing::FLAGS_gtest_death_test_style = "threadsafe";
+    EXPECT_DEATH(([&path]() {
+        ifr::Recorder::install(path);
+        ifr::Recorder::record(ifr::Recorder::USER, 2, {"before overflow"});
+        std::thread([]() {
+            ifr::Recorder::altStack();
+            overflow(0);
+        }).join();
+    })(), "");
+
+    std::ifstream in(path);
+    ASSERT_TRUE(in.is_open());
+    std::string first, second;
+    std::getline(in, first), std::getline(in, second);
+    EXPECT_NE(first.find("SIGSEGV"), std::string::npos);
+    EXPECT_NE(second.find("user before overflow"), std::string::npos);
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,65 @@
+#include "gtest/gtest.h"
+#include "trace/trace.hpp"
+#include "msg/msg.hpp"
+#include "rapidjson/document.h"
+#include <thread>
+
+TEST(TRACE, ring) {
+    std::thread([]() {
+        ifr::Trace::setThreadName("trace-test");
+        for (size_t i = 0; i < ifr::Trace::ring_size + 100; i++)ifr::Trace::counter(ifr::Trace::USER, "cnt", (double) i);
+        {
+            IFR_TRACE_SCOPE("scope");
+        }
+        ifr::Msg::Publisher<int> pub("trace-channel");
+        ifr::Msg::Subscriber<int> sub("trace-channel");
+        pub.lock();
+        pub.push(1);
+        sub.pop();
+    }).join();
+
+    rapidjson::Document d;
+    d.Parse(ifr::Trace::dump(60).c_str());
+    ASSERT_TRUE(d.IsObject());
+    const auto &events = d["traceEvents"];
+    int64_t tid = -1;
+    for (const auto &e: events.GetArray())
+        if (std::string(e["ph"].GetString()) == "M" && std::string(e["args"]["name"].GetString()) == "trace-test")
+            tid = e["tid"].GetInt64();
+    ASSERT_GE(tid, 0);
+
+    size_t counters = 0;
+    double last = -1;
+    bool scope = false, push = false, pop = false;
+    for (const auto &e: events.GetArray()) {
+        if (e["tid"].GetInt64() != tid)continue;
+        const std::string ph = e["ph"].GetString(), name = e["name"].GetString();
+        if (ph == "C") {
+            const auto v = e["args"]["value"].GetDouble();
+            EXPECT_GT(v, last);//环形缓冲区内按时间顺序
+            last = v, counters++;
+        } else if (ph == "X" && name == "scope")scope = true;
+        else if (ph == "i" && name == "push:trace-channel")push = true;
+        else if (ph == "i" && name == "pop:trace-channel")pop = true;
+    }
+    EXPECT_TRUE(scope && push && pop);
+    EXPECT_EQ(counters, ifr::Trace::ring_size - 4);//保留最近ring_size-1个事件(最早的一个可能正被覆盖), 其中3个为非计数器事件
+    EXPECT_EQ(last, (double) (ifr::Trace::ring_size + 99));
+}
+
+TEST(TRACE, disabled) {
+    ifr::Trace::setEnabled(false);
+    std::thread([]() {
+        ifr::Trace::setThreadName("trace-disabled");
+        ifr::Trace::counter(ifr::Trace::USER, "off", 1);
+        ifr::Trace::instant(ifr::Trace::USER, "off");
+        IFR_TRACE_SCOPE("off");
+        ifr::Trace::setEnabled(true);//作用域开始时未开启, 不记录
+    }).join();
+
+    rapidjson::Document d;
+    d.Parse(ifr::Trace::dump(60).c_str());
+    ASSERT_TRUE(d.IsObject());
+    for (const auto &e: d["traceEvents"].GetArray())
+        EXPECT_NE(std::string(e["name"].GetString()), "off");
+}
@@ -6,6 +6,12 @@
 
 #include <memory>
 #include <utility>
+#include <deque>
+#include <condition_variable>
+#include <limits>
+#include <chrono>
+#include <regex>
+#include <set>
 
 using namespace std;
 namespace ifr {
@@ -16,24 +22,60 @@ namespace ifr {
 #define STR_RBUF2MG(buf) mg_str_n((buf).GetString(),(buf).GetLength())
         const size_t npos = -1;
 
+        /**异步处理的请求 (复制自mg_http_message, 可在工作线程中使用)*/
+        struct Request {
+            std::string method;//请求类型
+            std::string uri;//路径
+            std::string query;//query参数
+            std::string body;//请求体
+
+            static Request of(const mg_http_message *hm) {
+                return {STR_MG2STD(hm->method), STR_MG2STD(hm->uri), STR_MG2STD(hm->query), STR_MG2STD(hm->body)};
+            }
+
+            /**
+             * 获取query的值
+             * @param key 要查找的键
+             * @return 键对应的值
+             */
+            std::string get(const std::string &key) const {
+                return STR_MG2STD(mgx_getquery(mg_str_n(query.c_str(), query.length()), key));
+            }
+        };
+
+        /**异步处理的响应*/
+        struct Reply {
+            int code;//状态码
+            std::string headers;//响应头
+            std::string body;//响应体
+        };
+
+        typedef std::function<Reply(const Request &)> async_handler_t;
+
         struct handler_data {
             const char *pattern;//匹配模式串
             const char *method;//限定请求类型
-            mg_event_handler_t fn;//处理器
+            mg_event_handler_t fn;//处理器 (在mongoose线程中执行)
+            async_handler_t async = nullptr;//异步处理器 (在工作线程中执行, 不为空时忽略fn), 用于耗时较长的路由
         };
 
-        vector <handler_data> http_route; //所有的路由
+        vector <handler_data> http_route; //所有的路由 (按注册顺序)
+        RouteTable<handler_data> routes;//路由表, 在所有路由注册后构建
 
-        map<unsigned long, struct mg_connection *> wsClients;//ws客户端
-        mutex ws_mtx;//websocket 同步锁
+        int wake_pipe = -1;//唤醒mongoose线程的管道
+
+        /**唤醒mongoose线程, 处理异步响应及websocket发送队列*/
+        void wakeLoop() {
+            if (wake_pipe >= 0)send(wake_pipe, "", 1, 0);
+        }
 
 
         namespace TimeWatcherHelper {
-            const constexpr static clock_t max_cache = 300;
+            const constexpr static auto max_cache = std::chrono::milliseconds(300);
 
             struct Data {
                 std::weak_ptr<TimeWatcher> tw;//
-                clock_t cache_lst = -1;//上次缓存时间
+                std::chrono::steady_clock::time_point cache_lst;//上次缓存时间
                 std::string cache;//缓存
             };
 
@@ -45,8 +87,8 @@ namespace ifr {
                 if (!datas.count(type))return "";
                 auto &data = datas[type];
                 if (auto sp = data.tw.lock()) {
-                    auto now = clock();
-                    if (now - data.cache_lst > max_cache) {
+                    auto now = std::chrono::steady_clock::now();
+                    if (data.cache.empty() || now - data.cache_lst > max_cache) {
                         data.cache_lst = now;
                         return data.cache = sp->getTime();
                     } else return data.cache;
@@ -72,6 +114,17 @@ namespace ifr {
                 return buf.GetString();
             }
 
+            /**
+             * 遍历所有有效的耗时监控器
+             * @param f 回调函数(类型名称, 监控器)
+             */
+            template<class F>
+            void forEach(F &&f) {
+                std::unique_lock<std::mutex> lock(mtx);
+                for (const auto &x: datas)
+                    if (auto sp = x.second.tw.lock())f(x.first, sp);
+            }
+
             void registerTimeWatcher(const shared_ptr <TimeWatcher> &tw) {
                 std::unique_lock<std::mutex> lock(mtx);
                 if (datas.count(tw->type) && !datas[tw->type].tw.expired())
@@ -82,14 +135,92 @@ namespace ifr {
         }
 
 
-        void sendWsReal(const std::string &str) {
-            std::unique_lock<mutex> lock(ws_mtx);
-            for (const auto &client: wsClients) {
-                mg_ws_send(client.second, str.c_str(), str.length(), WEBSOCKET_OP_TEXT);
+        /**
+         * 路由执行器
+         * @details 耗时较长的路由在工作线程中执行, 响应通过管道唤醒mongoose线程后发送, 不阻塞其他客户端
+         */
+        namespace Executor {
+            std::mutex job_mtx;//访问锁: 任务队列
+            std::condition_variable &job_cv = *new std::condition_variable;//不析构: 程序退出时工作线程仍在等待, 析构会阻塞
+            std::deque<std::function<void()>> jobs;//任务队列
+
+            std::mutex done_mtx;//访问锁: 响应队列
+            std::vector<std::pair<unsigned long, Reply>> done;//已完成的响应 (连接ID - 响应)
+
+            /**
+             * 提交一个请求
+             * @param id 连接ID
+             * @param req 请求
+             * @param fn 处理器
+             */
+            void submit(unsigned long id, Request &&req, const async_handler_t &fn) {
+                std::unique_lock<std::mutex> lock(job_mtx);
+                jobs.emplace_back([id, req = std::move(req), fn]() {
+                    Reply reply;
+                    try {
+                        reply = fn(req);
+                    } catch (exception &e) {
+                        reply = {500, COMMON_TEXT_HEADER, e.what()};
+                    } catch (...) {
+                        reply = {500, COMMON_TEXT_HEADER, "An unknown error has occurred"};
+                    }
+                    std::unique_lock<std::mutex> lock(done_mtx);
+                    const bool wake = done.empty();//已有未处理的唤醒时不再重复唤醒
+                    done.emplace_back(id, std::move(reply));
+                    lock.unlock();
+                    if (wake)wakeLoop();
+                });
+                lock.unlock();
+                job_cv.notify_one();
+            }
+
+            /**
+             * 在mongoose线程中发送所有已完成的响应
+             * @param mgr 事件管理器
+             */
+            void flush(mg_mgr *mgr) {
+                std::vector<std::pair<unsigned long, Reply>> replies;
+                {
+                    std::unique_lock<std::mutex> lock(done_mtx);
+                    replies.swap(done);
+                }
+                for (const auto &r: replies) {
+                    for (auto t = mgr->conns; t != nullptr; t = t->next) {
+                        if (t->id != r.first)continue;//连接已关闭时丢弃
+                        mg_http_reply(t, r.second.code, r.second.headers.c_str(), "%s", r.second.body.c_str());
+                        break;
+                    }
+                }
+            }
+
+            /**
+             * 启动工作线程
+             * @param workers 工作线程数量
+             */
+            void start(size_t workers) {
+                for (size_t i = 0; i < std::max<size_t>(workers, 1); i++) {
+                    thread t([]() {
+                        ifr::Trace::setThreadName("api-worker");
+                        while (true) {
+                            std::unique_lock<std::mutex> lock(job_mtx);
+                            job_cv.wait(lock, []() { return !jobs.empty(); });
+                            auto job = std::move(jobs.front());
+                            jobs.pop_front();
+                            lock.unlock();
+                            job();
+                        }
+                    });
+                    while (!t.joinable());
+                    t.detach();
+                }
             }
         }
 
-        void sendWs(ifr::Plans::msgType wsType, const string &type, const std::string &subType, const string &msg) {
+        /**
+         * 生成websocket类型信息
+         * @see sendWs
+         */
+        std::string wsJson(ifr::Plans::msgType wsType, const string &type, const std::string &subType, const string &msg) {
             rapidjson::StringBuffer buf;
             rapidjson::Writer<rapidjson::StringBuffer> w(buf);
             w.StartObject();
@@ -99,24 +230,402 @@ namespace ifr {
             w.Key("msg"), w.String(msg);
             w.EndObject();
             w.Flush();
-            sendWsReal(buf.GetString());
+            return buf.GetString();
+        }
+
+        /**
+         * websocket发送队列
+         * @details 任意线程均可无锁地加入消息(多生产者), 由mongoose线程取出并发送(单消费者)
+         * @details 同一轮取出的消息以'\n'连接, 合并为尽量少的帧; 每个客户端的待发送数据超过上限时丢弃新的帧,
+         * 恢复后先发送一条丢弃数量的提示
+         * @details 队列中尚未取出的数据超过上限(mongoose线程未能及时处理)时, 直接丢弃新加入的消息
+         */
+        namespace WsQueue {
+            const constexpr size_t max_frame = 64 * 1024;//合并帧的最大长度
+            const constexpr size_t max_pending = 1024 * 1024;//每个客户端待发送数据的上限
+            const constexpr size_t max_queued = 8 * 1024 * 1024;//队列中未取出数据的上限
+
+            struct Node {
+                std::string msg;
+                Node *next;
+                unsigned long to = 0;//目标客户端ID, 0为广播
+            };
+            std::atomic<Node *> head{nullptr};//待发送的消息 (逆序)
+            std::atomic_bool waking{false};//是否已经唤醒mongoose线程
+            std::atomic<size_t> queued{0};//队列中未取出数据的长度
+            std::atomic<size_t> overflow{0};//因队列已满丢弃的消息数
+
+            struct Client {
+                mg_connection *c;
+                size_t dropped = 0;//丢弃的帧数
+                uint8_t topics = 0;//订阅的遥测主题 (按位)
+                uint8_t fresh = 0;//新订阅, 需要发送完整快照的遥测主题 (按位)
+            };
+            std::map<unsigned long, Client> clients;//ws客户端, 仅在mongoose线程中访问
+
+            /**
+             * 加入一条消息
+             * @param msg 消息
+             * @param to 目标客户端ID, 0为广播
+             */
+            void push(std::string &&msg, unsigned long to = 0) {
+                const auto n = msg.length();
+                if (queued.fetch_add(n, std::memory_order_relaxed) + n > max_queued) {
+                    queued.fetch_sub(n, std::memory_order_relaxed);
+                    overflow.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                auto node = new Node{std::move(msg), head.load(std::memory_order_relaxed), to};
+                while (!head.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                                   std::memory_order_relaxed));
+                if (!waking.exchange(true))wakeLoop();
+            }
+
+            /**
+             * 向客户端发送一帧, 待发送数据超过上限时丢弃
+             * @param client 客户端
+             * @param frame 帧
+             * @param op 帧类型
+             */
+            void send(Client &client, const std::string &frame, int op) {
+                if (client.c->send.len > max_pending) {
+                    client.dropped++;
+                    return;
+                }
+                if (client.dropped) {
+                    const auto notice = wsJson(ifr::Plans::ERR, "api", "ws-drop", std::to_string(client.dropped));
+                    mg_ws_send(client.c, notice.c_str(), notice.length(), WEBSOCKET_OP_TEXT);
+                    client.dropped = 0;
+                }
+                mg_ws_send(client.c, frame.c_str(), frame.length(), op);
+            }
+
+            /**在mongoose线程中发送所有待发送的消息*/
+            void flush() {
+                waking = false;
+                Node *node = head.exchange(nullptr, std::memory_order_acquire), *list = nullptr;
+                if (!node)return;
+                while (node) {//恢复为加入顺序
+                    const auto next = node->next;
+                    queued.fetch_sub(node->msg.length(), std::memory_order_relaxed);
+                    node->next = list, list = node, node = next;
+                }
+                std::vector<std::string> frames(1);
+                if (const auto lost = overflow.exchange(0, std::memory_order_relaxed))
+                    frames.back() = wsJson(ifr::Plans::ERR, "api", "ws-overflow", std::to_string(lost));
+                std::vector<std::pair<unsigned long, std::string>> targeted;//发给单个客户端的帧, 不合并
+                while (list) {
+                    if (list->to) {
+                        targeted.emplace_back(list->to, std::move(list->msg));
+                        const auto next = list->next;
+                        delete list;
+                        list = next;
+                        continue;
+                    }
+                    auto &frame = frames.back();
+                    if (!frame.empty() && frame.length() + list->msg.length() >= max_frame)frames.emplace_back();
+                    if (!frames.back().empty())frames.back().push_back('\n');
+                    frames.back() += list->msg;
+                    const auto next = list->next;
+                    delete list;
+                    list = next;
+                }
+                for (auto &e: clients)
+                    for (const auto &frame: frames)if (!frame.empty())send(e.second, frame, WEBSOCKET_OP_TEXT);
+                for (const auto &e: targeted) {
+                    const auto itr = clients.find(e.first);
+                    if (itr != clients.end())send(itr->second, e.second, WEBSOCKET_OP_TEXT);
+                }
+            }
+        }
+
+        /**
+         * websocket日志流
+         * @details 客户端发送{"log":{"types":[...],"level":"INFO","regex":"..."}}订阅日志 (替换原有条件, {"log":null}取消)
+         * @details 过滤在服务器端执行: 日志后台线程每输出一批日志, 为每个订阅的客户端生成最多一帧, 经WsQueue发送
+         * @details 日志线程只读取过滤条件的快照并加入无锁队列, 慢速客户端由WsQueue丢弃帧, 不会阻塞记录日志的线程
+         */
+        namespace LogStream {
+            struct Filter {
+                unsigned long id;//客户端ID
+                std::set<std::string> types;//分类, 为空时不限
+                ifr::logger::Level level;//最低级别
+                std::shared_ptr<const std::regex> regex;//匹配日志行, 为空时不限
+            };
+            std::map<unsigned long, Filter> filters;//仅在mongoose线程中访问
+            std::atomic<std::shared_ptr<const std::vector<Filter>>> snapshot;//供日志线程读取的快照
+
+            void publish() {
+                auto all = std::make_shared<std::vector<Filter>>();
+                for (const auto &e: filters)all->push_back(e.second);
+                snapshot.store(std::move(all), std::memory_order_release);
+            }
+
+            /**
+             * 处理客户端的订阅条件
+             * @param client 客户端
+             * @param v 条件, null为取消
+             */
+            void subscribe(WsQueue::Client &client, const rapidjson::Value &v) {
+                const auto id = client.c->id;
+                if (!v.IsObject()) {
+                    if (filters.erase(id))publish();
+                    return;
+                }
+                Filter f{id, {}, ifr::logger::LV_TRACE, nullptr};
+                if (v.HasMember("types") && v["types"].IsArray())
+                    for (const auto &t: v["types"].GetArray())if (t.IsString())f.types.insert(t.GetString());
+                if (v.HasMember("level") && v["level"].IsString())ifr::logger::parseLevel(v["level"].GetString(), f.level);
+                if (v.HasMember("regex") && v["regex"].IsString() && v["regex"].GetStringLength()) {
+                    try {
+                        f.regex = std::make_shared<const std::regex>(v["regex"].GetString(),
+                                                                     std::regex::ECMAScript | std::regex::optimize);
+                    } catch (const std::regex_error &e) {
+                        const auto notice = wsJson(ifr::Plans::ERR, "api", "log-regex", e.what());
+                        WsQueue::send(client, notice, WEBSOCKET_OP_TEXT);
+                        return;
+                    }
+                }
+                filters[id] = std::move(f);
+                publish();
+            }
+
+            void remove(unsigned long id) {
+                if (filters.erase(id))publish();
+            }
+
+            /**
+             * 日志附加输出器, 在日志后台线程中执行
+             * @details 帧格式: {"ws-type":0,"type":"api","sub-type":"log","logs":[{"ts":毫秒,"level":"INFO","type":"","id":-1,"sub-type":"","msg":""}]}
+             */
+            void sink(const std::vector<ifr::logger::Entry> &entries) {
+                const auto all = snapshot.load(std::memory_order_acquire);
+                if (!all || all->empty())return;
+                std::vector<std::string> msgs(entries.size()), lines(entries.size());//按需格式化, 多个客户端共用
+                const auto msg = [&](size_t i) -> const std::string & {
+                    if (msgs[i].empty())msgs[i] = entries[i].message();
+                    return msgs[i];
+                };
+                for (const auto &f: *all) {
+                    rapidjson::StringBuffer buf;
+                    rapidjson::Writer<rapidjson::StringBuffer> w(buf);
+                    size_t n = 0;
+                    for (size_t i = 0; i < entries.size(); i++) {
+                        const auto &e = entries[i];
+                        if (e.level < f.level || (!f.types.empty() && !f.types.count(e.type)))continue;
+                        if (f.regex) {
+                            if (lines[i].empty())lines[i] = e.line();
+                            if (!std::regex_search(lines[i], *f.regex))continue;
+                        }
+                        if (!n++) {
+                            w.StartObject();
+                            w.Key("ws-type"), w.Int(ifr::Plans::LOG);
+                            w.Key("type"), w.String("api");
+                            w.Key("sub-type"), w.String("log");
+                            w.Key("logs"), w.StartArray();
+                        }
+                        w.StartObject();
+                        w.Key("ts"), w.Int64(e.ts / 1000000);
+                        w.Key("level"), w.String(ifr::logger::levelName(e.level));
+                        w.Key("type"), w.String(e.type);
+                        w.Key("id"), w.Int(e.id);
+                        w.Key("sub-type"), w.String(e.sub_type);
+                        w.Key("msg"), w.String(msg(i));
+                        w.EndObject();
+                    }
+                    if (!n)continue;
+                    w.EndArray(), w.EndObject();
+                    WsQueue::push(std::string(buf.GetString(), buf.GetLength()), f.id);
+                }
+            }
+        }
+
+        /**
+         * websocket遥测流
+         * @details 在mongoose线程中按固定间隔向订阅的客户端推送二进制帧, 替代轮询
+         * @details 帧格式(小端序): [u8 主题][内容], 字符串为[u8/u16 长度][字节]
+         * @details time: [u16 数量]{[str8 类型][f64 单位][u16 工作线程数][u16 节点数][i64 时间点 x 工作线程数 x 节点数]}
+         * @details vars: [u16 数量]{[str8 键][str16 值]}, 仅包含变化的变量 (新订阅时为全部变量)
+         * @details plan: [u16 数量]{[str8 计划名称][u8 阶段]}, 运行中的计划, 仅在变化时推送 (新订阅时立即推送)
+         */
+        namespace Telemetry {
+            enum Topic : uint8_t {
+                TIME = 1, VARS = 2, PLAN = 3
+            };
+            const std::map<std::string, Topic> names = {{"time", TIME},
+                                                        {"vars", VARS},
+                                                        {"plan", PLAN}};
+
+            FORCE_INLINE uint8_t bit(Topic t) { return 1 << t; }
+
+            std::atomic_int interval{100};//推送间隔(ms)
+            std::chrono::steady_clock::time_point last;//上次推送时间
+            std::string lastPlan;//上次推送的计划状态
+            std::map<std::string, std::string> lastVars;//上次推送的变量值
+
+            /**二进制帧*/
+            struct Frame {
+                std::string buf;
+
+                explicit Frame(Topic t) { put<uint8_t>(t); }
+
+                template<class T>
+                void put(const T &v) { buf.append((const char *) &v, sizeof(T)); }
+
+                template<class L>
+                void putStr(const std::string &s) {
+                    const auto len = (L) std::min<size_t>(s.length(), std::numeric_limits<L>::max());
+                    put<L>(len), buf.append(s.c_str(), len);
+                }
+            };
+
+            /**
+             * 处理客户端的订阅消息: {"sub":["time","vars","plan"]}, 替换原有的订阅
+             * @param client 客户端
+             * @param sub 订阅的主题
+             */
+            void subscribe(WsQueue::Client &client, const rapidjson::Value &sub) {
+                if (!sub.IsArray())return;
+                uint8_t topics = 0;
+                for (const auto &e: sub.GetArray()) {
+                    if (!e.IsString())continue;
+                    const auto itr = names.find(e.GetString());
+                    if (itr != names.end())topics |= bit(itr->second);
+                }
+                client.fresh |= topics & ~client.topics;
+                client.topics = topics;
+            }
+
+            std::string timeFrame() {
+                Frame f(TIME);
+                std::vector<std::pair<std::string, std::shared_ptr<TimeWatcher>>> tws;
+                TimeWatcherHelper::forEach([&tws](const auto &type, const auto &tw) { tws.emplace_back(type, tw); });
+                f.put<uint16_t>(tws.size());
+                std::vector<TimeWatcher::tick_t> mat;
+                for (const auto &e: tws) {
+                    const auto &tw = e.second;
+                    if (!tw->read(mat))mat.clear();
+                    f.putStr<uint8_t>(e.first);
+                    f.put<double>(tw->unit_ms);
+                    f.put<uint16_t>(mat.empty() ? 0 : tw->worker_amount);
+                    f.put<uint16_t>(mat.empty() ? 0 : tw->point_amount);
+                    for (const auto &t: mat)f.put<int64_t>(t);
+                }
+                return f.buf;
+            }
+
+            std::string planFrame() {
+                Frame f(PLAN);
+                const auto plans = ifr::Plans::getRunningPlans();
+                f.put<uint16_t>(plans.size());
+                for (const auto &name: plans)f.putStr<uint8_t>(name), f.put<uint8_t>(ifr::Plans::getState(name));
+                return f.buf;
+            }
+
+            /**
+             * 生成变量帧
+             * @param vars 变量值
+             * @param base 基准值, 仅包含与基准值不同的变量, 为空时包含全部变量
+             */
+            std::string varsFrame(const std::map<std::string, std::string> &vars,
+                                  const std::map<std::string, std::string> *base) {
+                Frame f(VARS);
+                std::vector<const std::pair<const std::string, std::string> *> changed;
+                for (const auto &e: vars) {
+                    if (base) {
+                        const auto itr = base->find(e.first);
+                        if (itr != base->end() && itr->second == e.second)continue;
+                    }
+                    changed.push_back(&e);
+                }
+                if (base && changed.empty())return "";
+                f.put<uint16_t>(changed.size());
+                for (const auto e: changed)f.putStr<uint8_t>(e->first), f.putStr<uint16_t>(e->second);
+                return f.buf;
+            }
+
+            /**在mongoose线程中调用, 到达推送间隔时推送所有订阅的主题*/
+            void tick() {
+                const auto now = std::chrono::steady_clock::now();
+                if (now - last < std::chrono::milliseconds(interval))return;
+                last = now;
+                uint8_t want = 0;
+                for (const auto &e: WsQueue::clients)want |= e.second.topics;
+                if (!want)return;
+
+                const auto publish = [](Topic t, const std::string &frame, const std::string &full) {
+                    for (auto &e: WsQueue::clients) {
+                        auto &client = e.second;
+                        if (!(client.topics & bit(t)))continue;
+                        const bool fresh = client.fresh & bit(t);
+                        client.fresh &= ~bit(t);
+                        if (fresh && !full.empty())WsQueue::send(client, full, WEBSOCKET_OP_BINARY);
+                        else if (!frame.empty())WsQueue::send(client, frame, WEBSOCKET_OP_BINARY);
+                    }
+                };
+                if (want & bit(TIME))publish(TIME, timeFrame(), "");
+                if (want & bit(PLAN)) {
+                    auto frame = planFrame();
+                    const bool changed = frame != lastPlan;
+                    lastPlan = frame;
+                    publish(PLAN, changed ? frame : "", frame);
+                }
+#if IFRAPI_HAS_VARIABLE
+                if (want & bit(VARS)) {
+                    std::map<std::string, std::string> vars;
+                    {
+                        std::unique_lock<decltype(Variable::mutex)> lock(Variable::mutex);
+                        for (const auto &e: Variable::vars)vars[e.first] = e.second.getValue();
+                    }
+                    const auto frame = varsFrame(vars, &lastVars);
+                    publish(VARS, frame, varsFrame(vars, nullptr));
+                    lastVars.swap(vars);
+                }
+#endif
+            }
+        }
+
+        void setTelemetryInterval(int ms) { Telemetry::interval = std::max(ms, 1); }
+
+        void sendWsReal(const std::string &str) {
+            WsQueue::push(std::string(str));
+        }
+
+        void sendWs(ifr::Plans::msgType wsType, const string &type, const std::string &subType, const string &msg) {
+            WsQueue::push(wsJson(wsType, type, subType, msg));
+        }
+
+        /**管道处理器: 在mongoose线程中发送异步响应及websocket消息*/
+        static void onWake(struct mg_connection *c, int ev, void *ev_data, void *fn_data) {
+            if (ev != MG_EV_READ)return;
+            c->recv.len = 0;
+            Executor::flush(c->mgr);
+            WsQueue::flush();
         }
 
 
         static void fn(struct mg_connection *c, int ev, void *ev_data, void *fn_data) {
             switch (ev) {
                 case MG_EV_WS_OPEN: {
-                    {
-                        std::unique_lock<mutex> lock(ws_mtx);
-                        wsClients[c->id] = c;
-                    }
+                    WsQueue::clients[c->id] = {c};
                     sendWsReal("connected " + to_string(c->rem.ip) + ", " + to_string(c->id));
                     cout << "已连接ws " << c->rem.ip << endl;
                     break;
                 }
+                case MG_EV_WS_MSG: {
+                    const auto itr = WsQueue::clients.find(c->id);
+                    if (itr == WsQueue::clients.end())break;
+                    const auto &data = ((mg_ws_message *) ev_data)->data;
+                    rapidjson::Document d;
+                    d.Parse(data.ptr, data.len);
+                    if (d.HasParseError() || !d.IsObject())break;
+                    if (d.HasMember("sub"))Telemetry::subscribe(itr->second, d["sub"]);
+                    if (d.HasMember("log"))LogStream::subscribe(itr->second, d["log"]);
+                    break;
+                }
                 case MG_EV_CLOSE: {
-                    std::unique_lock<mutex> lock(ws_mtx);
-                    wsClients.erase(c->id);
+                    WsQueue::clients.erase(c->id);
+                    LogStream::remove(c->id);
                     break;
                 }
                 case MG_EV_HTTP_MSG: {
@@ -130,10 +639,12 @@ namespace ifr {
                         return;
                     }
                     //注册的路由
-                    for (const auto &r: http_route) {
-                        if (!mg_http_match_uri(hm, r.pattern))continue;
-                        if (mg_vcmp(&hm->method, r.method))continue;
-
+                    if (const auto h = routes.find({hm->method.ptr, hm->method.len}, {hm->uri.ptr, hm->uri.len})) {
+                        const auto &r = *h;
+                        if (r.async) {
+                            Executor::submit(c->id, Request::of(hm), r.async);
+                            return;
+                        }
                         try {
                             r.fn(c, ev, ev_data, fn_data);
                         } catch (exception &e) {
@@ -153,7 +664,64 @@ namespace ifr {
             }
         }
 
+#if IFRAPI_HAS_VARIABLE
+
+        /**@return 变量键值的json: {key:value}*/
+        static std::string varsJson(const std::map<std::string, std::string> &values) {
+            rapidjson::StringBuffer buf;
+            rapidjson::Writer<rapidjson::StringBuffer> w(buf);
+            w.StartObject();
+            for (const auto &e: values)w.Key(e.first), w.String(e.second);
+            w.EndObject();
+            w.Flush();
+            return buf.GetString();
+        }
+
+        /**@return json值对应的变量值: 字符串原样返回, 其他类型返回其json文本*/
+        /**
+         * 写入一个类型描述 (/vars/descriptions中types的值), 由VarTraits::type的结果生成
+         * @details 数字/字符串等为类型名本身; 枚举为{"base":"enum","names":[...]};
+         * 数组为{"base":"array","element":元素类型,"size":N}
+         */
+        template<class W>
+        static void writeTypeDescriptor(W &w, const std::string &t) {
+            if (t.rfind("enum", 0) == 0) {
+                w.StartObject();
+                w.Key("base"), w.String("enum");
+                w.Key("names"), w.StartArray();
+                if (t.size() > 6)//enum{A,B}
+                    for (size_t i = 5, j; i < t.size(); i = j + 1) {
+                        j = std::min(t.find(',', i), t.size() - 1);
+                        w.String(t.substr(i, j - i));
+                    }
+                w.EndArray();
+                w.EndObject();
+            } else if (t.rfind("array<", 0) == 0 && t.back() == '>') {//array<元素类型,N>
+                const auto comma = t.rfind(',');
+                w.StartObject();
+                w.Key("base"), w.String("array");
+                w.Key("element"), writeTypeDescriptor(w, t.substr(6, comma - 6));
+                w.Key("size"), w.Uint64(std::stoull(t.substr(comma + 1, t.size() - comma - 2)));
+                w.EndObject();
+            } else w.String(t);
+        }
+
+        static std::string jsonToValue(const rapidjson::Value &v) {
+            if (v.IsString())return {v.GetString(), v.GetStringLength()};
+            rapidjson::StringBuffer buf;
+            rapidjson::Writer<rapidjson::StringBuffer> w(buf);
+            v.Accept(w);
+            return buf.GetString();
+        }
+
+#endif
+
         void registerRoute() {
+            http_route.push_back(
+                    {"/ws", "GET", [](auto c, int ev, auto ev_data, auto fn_data) {
+                        mg_ws_upgrade(c, (mg_http_message *) ev_data, nullptr);
+                    }
+                    });
             http_route.push_back(
                     {"/time/detail", "GET", [](auto c, int ev, auto ev_data, auto fn_data) {
                         auto hm = (mg_http_message *) ev_data;
@@ -187,9 +755,9 @@ namespace ifr {
                             auto key = mgx_getquery(((mg_http_message *) ev_data)->query, "key");
                             char buf[1024];
                             mg_url_decode(key.ptr, key.len, buf, sizeof(buf), 0);
-                            const auto itr = Variable::vars.find(buf);
-                            if (itr == Variable::vars.end())mg_http_reply(c, 404, COMMON_TEXT_HEADER, "Not Found key");
-                            else mg_http_reply(c, 200, COMMON_TEXT_HEADER, itr->second.getValue().c_str());
+                            const auto values = Variable::getValues({buf});//加锁读取
+                            if (values.empty())mg_http_reply(c, 404, COMMON_TEXT_HEADER, "Not Found key");
+                            else mg_http_reply(c, 200, COMMON_TEXT_HEADER, values.begin()->second.c_str());
                         } else mg_http_reply(c, 500, COMMON_TEXT_HEADER, "uninitialized");
                     }
                     });
@@ -200,16 +768,100 @@ namespace ifr {
                             auto key = mgx_getquery(hm->query, "key");
                             char buf[1024];
                             mg_url_decode(key.ptr, key.len, buf, sizeof(buf), 0);
-                            auto value = STR_MG2STD(hm->body);
-                            const auto itr = Variable::vars.find(buf);
-                            if (itr == Variable::vars.end())mg_http_reply(c, 404, COMMON_TEXT_HEADER, "Not Found key");
-                            else {
-                                itr->second.setValue(value);
-                                mg_http_reply(c, 200, COMMON_TEXT_HEADER, itr->second.getValue().c_str());
-                            }
+                            const std::string k = buf;
+                            std::string error;
+                            if (!Variable::vars.count(k))mg_http_reply(c, 404, COMMON_TEXT_HEADER, "Not Found key");
+                            else if (!Variable::setValues({{k, STR_MG2STD(hm->body)}}, false, error))//加锁写入
+                                mg_http_reply(c, 400, COMMON_TEXT_HEADER, "Bad value");
+                            else mg_http_reply(c, 200, COMMON_TEXT_HEADER, Variable::getValues({k})[k].c_str());
                         } else mg_http_reply(c, 500, COMMON_TEXT_HEADER, "uninitialized");
                     }
                     });
+            http_route.push_back(
+                    {"/vars/values", "GET", [](auto c, int ev, auto ev_data, auto fn_data) {
+                        if (!Variable::locked) {
+                            mg_http_reply(c, 500, COMMON_TEXT_HEADER, "uninitialized");
+                            return;
+                        }
+                        auto keys = mgx_getquery(((mg_http_message *) ev_data)->query, "keys");
+                        std::vector<std::string> list;
+                        if (keys.len) {
+                            std::string buf(keys.len + 1, 0);
+                            buf.resize(mg_url_decode(keys.ptr, keys.len, buf.data(), buf.size(), 0));
+                            for (size_t i = 0, j; i <= buf.length(); i = j + 1) {
+                                j = std::min(buf.find(',', i), buf.length());
+                                if (j > i)list.push_back(buf.substr(i, j - i));
+                            }
+                        }
+                        mg_http_reply(c, 200, COMMON_JSON_HEADER, varsJson(Variable::getValues(list)).c_str());
+                    }
+                    });
+            http_route.push_back(
+                    {"/vars/values", "POST", [](auto c, int ev, auto ev_data, auto fn_data) {
+                        if (!Variable::locked) {
+                            mg_http_reply(c, 500, COMMON_TEXT_HEADER, "uninitialized");
+                            return;
+                        }
+                        auto hm = (mg_http_message *) ev_data;
+                        rapidjson::Document d;
+                        d.Parse(hm->body.ptr, hm->body.len);
+                        if (d.HasParseError() || !d.IsObject()) {
+                            mg_http_reply(c, 400, COMMON_TEXT_HEADER, "Can not parse body");
+                            return;
+                        }
+                        std::map<std::string, std::string> values;
+                        std::vector<std::string> keys;
+                        for (const auto &e: d.GetObj())
+                            keys.emplace_back(e.name.GetString()), values[keys.back()] = jsonToValue(e.value);
+                        std::string error;
+                        if (Variable::setValues(values, false, error))
+                            mg_http_reply(c, 200, COMMON_JSON_HEADER, varsJson(Variable::getValues(keys)).c_str());
+                        else if (!Variable::vars.count(error))
+                            mg_http_reply(c, 404, COMMON_TEXT_HEADER, "Not Found key: %s", error.c_str());
+                        else mg_http_reply(c, 400, COMMON_TEXT_HEADER, "Bad value: %s", error.c_str());
+                    }
+                    });
+            http_route.push_back(
+                    {"/vars/presets", "GET", [](auto c, int ev, auto ev_data, auto fn_data) {
+                        mg_http_reply(c, 200, COMMON_JSON_HEADER, Variable::getPresetsJson().c_str());
+                    }
+                    });
+            http_route.push_back(
+                    {"/vars/preset", "POST", [](auto c, int ev, auto ev_data, auto fn_data) {
+                        auto name = mgx_getquery(((mg_http_message *) ev_data)->query, "name");
+                        if (!name.len) {
+                            mg_http_reply(c, 400, COMMON_TEXT_HEADER, "no query: name");
+                            return;
+                        }
+                        Variable::savePreset(STR_MG2STD(name));
+                        mg_http_reply(c, 204, COMMON_JSON_HEADER, "");
+                    }
+                    });
+            http_route.push_back(
+                    {"/vars/preset", "DELETE", [](auto c, int ev, auto ev_data, auto fn_data) {
+                        auto name = mgx_getquery(((mg_http_message *) ev_data)->query, "name");
+                        if (!name.len) {
+                            mg_http_reply(c, 400, COMMON_TEXT_HEADER, "no query: name");
+                            return;
+                        }
+                        mg_http_reply(c, 200, COMMON_JSON_HEADER,
+                                      Variable::removePreset(STR_MG2STD(name)) ? "true" : "false");
+                    }
+                    });
+            http_route.push_back(
+                    {"/vars/preset/apply", "GET", [](auto c, int ev, auto ev_data, auto fn_data) {
+                        auto name = mgx_getquery(((mg_http_message *) ev_data)->query, "name");
+                        if (!name.len) {
+                            mg_http_reply(c, 400, COMMON_TEXT_HEADER, "no query: name");
+                            return;
+                        }
+                        std::string error;
+                        if (Variable::applyPreset(STR_MG2STD(name), error))
+                            mg_http_reply(c, 200, COMMON_JSON_HEADER, "true");
+                        else if (error.empty())mg_http_reply(c, 404, COMMON_TEXT_HEADER, "Not Found");
+                        else mg_http_reply(c, 400, COMMON_TEXT_HEADER, "Bad value: %s", error.c_str());
+                    }
+                    });
             http_route.push_back(
                     {"/vars/descriptions", "GET", [](auto c, int ev, auto ev_data, auto fn_data) {
                         if (Variable::locked) {
@@ -220,13 +872,10 @@ namespace ifr {
                                 w.StartObject();
                                 w.Key("types"), w.StartObject();
                                 {
-                                    w.Key("bool"), w.String(typeid(bool).name());
-                                    w.Key("long"), w.String(typeid(long).name());
-                                    w.Key("int"), w.String(typeid(int).name());
-                                    w.Key("unsigned"), w.String(typeid(unsigned).name());
-                                    w.Key("unsigned long"), w.String(typeid(unsigned long).name());
-                                    w.Key("float"), w.String(typeid(float).name());
-                                    w.Key("double"), w.String(typeid(double).name());
+                                    std::set<std::string> types = {"bool", "long", "int", "unsigned", "unsigned long",
+                                                                   "float", "double", "string"};
+                                    for (const auto &e: Variable::vars)types.insert(e.second.type_);//已注册变量的类型
+                                    for (const auto &t: types)w.Key(t.c_str()), writeTypeDescriptor(w, t);
                                 }
                                 w.EndObject();
                                 w.Key("vars"), w.StartArray();
@@ -263,7 +912,37 @@ namespace ifr {
                     });
             http_route.push_back(
                     {"/plan/state", "GET", [](auto c, int ev, auto ev_data, auto fn_data) {
-                        mg_http_reply(c, 200, COMMON_JSON_HEADER, ifr::Plans::getPlanStateJson().c_str());
+                        auto pname = mgx_getquery(((mg_http_message *) ev_data)->query, "pname");
+                        mg_http_reply(c, 200, COMMON_JSON_HEADER,
+                                      (pname.len ? ifr::Plans::getPlanStateJson(STR_MG2STD(pname))
+                                                 : ifr::Plans::getPlanStateJson()).c_str());
+                    }
+                    });
+            http_route.push_back(
+                    {"/plan/running", "GET", [](auto c, int ev, auto ev_data, auto fn_data) {
+                        rapidjson::StringBuffer buf;
+                        rapidjson::Writer<StringBuffer> w(buf);
+                        w.StartArray();
+                        for (const auto &name: ifr::Plans::getRunningPlans())w.String(name);
+                        w.EndArray();
+                        w.Flush();
+                        mg_http_reply(c, 200, COMMON_JSON_HEADER, buf.GetString());
+                    }
+                    });
+            http_route.push_back(
+                    {"/plan/usage", "GET", [](auto c, int ev, auto ev_data, auto fn_data) {
+                        mg_http_reply(c, 200, COMMON_JSON_HEADER, ifr::Plans::getPlanUsageJson().c_str());
+                    }
+                    });
+            http_route.push_back(
+                    {"/plan/latency", "GET", [](auto c, int ev, auto ev_data, auto fn_data) {
+                        auto pname = mgx_getquery(((mg_http_message *) ev_data)->query, "pname");
+                        if (!pname.len) {
+                            mg_http_reply(c, 400, COMMON_TEXT_HEADER, "no query: pname");
+                            return;
+                        }
+                        mg_http_reply(c, 200, COMMON_JSON_HEADER,
+                                      ifr::Plans::getTaskLatencyJson(STR_MG2STD(pname)).c_str());
                     }
                     });
             http_route.push_back(
@@ -287,53 +966,94 @@ namespace ifr {
                     }
                     });
             http_route.push_back(
-                    {"/plan/save", "POST", [](auto c, int ev, auto ev_data, auto fn_data) {
-                        auto hm = (mg_http_message *) ev_data;
+                    {"/plan/save", "POST", nullptr, [](const Request &req) -> Reply {
+                        std::string error;
+                        const auto plan = ifr::Plans::PlanInfo::read(req.body, error);
+                        if (!plan.loaded)return {400, COMMON_TEXT_HEADER, "Can not parse PlanInfo: " + error};
+                        ifr::Plans::savePlanInfo(plan);
+                        return {200, COMMON_JSON_HEADER, "true"};
+                    }
+                    });
+            http_route.push_back(
+                    {"/plan/remove", "DELETE", nullptr, [](const Request &req) -> Reply {
+                        const auto pname = req.get("pname");
+                        if (pname.empty())return {400, COMMON_TEXT_HEADER, "no query: pname"};
+                        bool success = ifr::Plans::removePlanInfo(pname);
+                        return {200, COMMON_JSON_HEADER, success ? "true" : "false"};
+                    }
+                    });
+            http_route.push_back(
+                    {"/plan/use", "GET", nullptr, [](const Request &req) -> Reply {
+                        const auto pname = req.get("pname");
+                        if (pname.empty())return {400, COMMON_TEXT_HEADER, "no query: pname"};
+                        ifr::Plans::usePlanInfo(pname);
+                        return {204, COMMON_JSON_HEADER, ""};
+                    }
+                    });
+            http_route.push_back(
+                    {"/plan/start", "GET", nullptr, [](const Request &req) -> Reply {
+                        const auto pname = req.get("pname");
+                        bool success = !pname.empty() ? ifr::Plans::startPlan(pname) : ifr::Plans::startPlan();
+                        return {200, COMMON_JSON_HEADER, success ? "true" : "false"};
+                    }
+                    });
+            http_route.push_back(
+                    {"/plan/stop", "GET", nullptr, [](const Request &req) -> Reply {
+                        const auto pname = req.get("pname");
+                        if (!pname.empty())ifr::Plans::stopPlan(pname);
+                        else ifr::Plans::stopPlan();
+                        return {204, COMMON_JSON_HEADER, ""};
+                    }
+                    });
+            http_route.push_back(
+                    {"/trace", "GET", nullptr, [](const Request &req) -> Reply {
+                        const auto sec = req.get("sec");
+                        double seconds = 5;
                         try {
-                            rapidjson::Document d;
-                            d.Parse(hm->body.ptr, hm->body.len);
-                            auto plan = ifr::Plans::PlanInfo::read(d);
-                            ifr::Plans::savePlanInfo(plan);
-                            mg_http_reply(c, 200, COMMON_JSON_HEADER, "true");
+                            if (!sec.empty())seconds = std::stod(sec);
                         } catch (...) {
-                            mg_http_reply(c, 400, COMMON_TEXT_HEADER, "Can not parse PlanInfo");
+                            return {400, COMMON_TEXT_HEADER, "bad query: sec"};
                         }
+                        return {200, COMMON_JSON_HEADER, ifr::Trace::dump(seconds)};
                     }
                     });
             http_route.push_back(
-                    {"/plan/remove", "DELETE", [](auto c, int ev, auto ev_data, auto fn_data) {
-                        auto hm = (mg_http_message *) ev_data;
-                        auto pname = mgx_getquery(hm->query, "pname");
-                        if (!pname.len) {
-                            mg_http_reply(c, 400, COMMON_TEXT_HEADER, "no query: pname");
-                            return;
-                        }
-                        bool success = ifr::Plans::removePlanInfo(STR_MG2STD(pname));
-                        mg_http_reply(c, 200, COMMON_JSON_HEADER, success ? "true" : "false");
+                    {"/log/level", "GET", [](auto c, int ev, auto ev_data, auto fn_data) {
+                        rapidjson::StringBuffer buf;
+                        rapidjson::Writer<StringBuffer> w(buf);
+                        w.StartObject();
+                        w.Key("default"), w.String(ifr::logger::levelName(ifr::logger::Levels::getDefault()));
+                        w.Key("modules"), w.StartObject();
+                        for (const auto &e: ifr::logger::Levels::modules())
+                            w.Key(e.first), w.String(ifr::logger::levelName(e.second));
+                        w.EndObject();
+                        w.EndObject();
+                        mg_http_reply(c, 200, COMMON_JSON_HEADER, buf.GetString());
                     }
                     });
             http_route.push_back(
-                    {"/plan/use", "GET", [](auto c, int ev, auto ev_data, auto fn_data) {
+                    {"/log/level", "POST", [](auto c, int ev, auto ev_data, auto fn_data) {
                         auto hm = (mg_http_message *) ev_data;
-                        auto pname = mgx_getquery(hm->query, "pname");
-                        if (!pname.len) {
-                            mg_http_reply(c, 400, COMMON_TEXT_HEADER, "no query: pname");
+                        auto type = mgx_getquery(hm->query, "type");
+                        auto level = mgx_getquery(hm->query, "level");
+                        ifr::logger::Level l;
+                        if (!level.len || !ifr::logger::parseLevel(STR_MG2STD(level), l)) {
+                            mg_http_reply(c, 400, COMMON_TEXT_HEADER, "bad query: level");
                             return;
                         }
-                        ifr::Plans::usePlanInfo(STR_MG2STD(pname));
+                        ifr::logger::Levels::set(type.len ? STR_MG2STD(type) : "", l);
                         mg_http_reply(c, 204, COMMON_JSON_HEADER, "");
                     }
                     });
             http_route.push_back(
-                    {"/plan/start", "GET", [](auto c, int ev, auto ev_data, auto fn_data) {
-                        bool success = ifr::Plans::startPlan();
-                        mg_http_reply(c, 200, COMMON_JSON_HEADER, success ? "true" : "false");
-                    }
-                    });
-            http_route.push_back(
-                    {"/plan/stop", "GET", [](auto c, int ev, auto ev_data, auto fn_data) {
-                        ifr::Plans::stopPlan();
-                        mg_http_reply(c, 204, COMMON_JSON_HEADER, "");
+                    {"/log/level", "DELETE", [](auto c, int ev, auto ev_data, auto fn_data) {
+                        auto type = mgx_getquery(((mg_http_message *) ev_data)->query, "type");
+                        if (!type.len) {
+                            mg_http_reply(c, 400, COMMON_TEXT_HEADER, "no query: type");
+                            return;
+                        }
+                        mg_http_reply(c, 200, COMMON_JSON_HEADER,
+                                      ifr::logger::Levels::reset(STR_MG2STD(type)) ? "true" : "false");
                     }
                     });
             http_route.push_back(
@@ -359,14 +1079,16 @@ namespace ifr {
                     });
         }
 
-        void init(const std::string &url, bool async) {
+        void init(const std::string &url, bool async, size_t workers) {
             if (async) {
-                thread t(init, url, false);
+                thread t(init, url, false, workers);
                 while (!t.joinable());
                 t.detach();
             } else {
                 ifr::Plans::registerMsgOut(sendWs);
+                ifr::logger::addTap(LogStream::sink);
                 registerRoute();
+                for (const auto &r: http_route)routes.add(r.method, r.pattern, r);
 #if IFRAPI_HAS_VARIABLE
                 Variable::init();
 #endif
@@ -374,10 +1096,17 @@ namespace ifr {
                 struct mg_mgr mgr{};
                 mg_mgr_init(&mgr);
                 mg_http_listen(&mgr, url.c_str(), fn, nullptr);     // Create listening connection
+                wake_pipe = mg_mkpipe(&mgr, onWake, nullptr, true);
+                if (wake_pipe < 0)throw runtime_error("[API] Cannot create pipe");
+                Executor::start(workers);
 
 
                 ifr::logger::log("api", "Start listen", url);
-                for (;;) mg_mgr_poll(&mgr, 1000);                   // Block forever
+                for (;;) {                                          // Block forever
+                    mg_mgr_poll(&mgr, std::min(Telemetry::interval.load(), 1000));
+                    WsQueue::flush();
+                    Telemetry::tick();
+                }
             }
         }
 
@@ -410,8 +1139,8 @@ namespace ifr {
 
         std::shared_ptr<TimeWatcher>
         registerTimePoint(const string &type, const TimeWatcher::unit_t &unit_ms, const size_t &point_amount,
-                          const size_t &worker_amount) {
-            auto s = std::make_shared<TimeWatcher>(type, unit_ms, point_amount, worker_amount);
+                          const size_t &worker_amount, const std::vector<std::string> &names) {
+            auto s = std::make_shared<TimeWatcher>(type, unit_ms, point_amount, worker_amount, 5000, names);
             TimeWatcherHelper::registerTimeWatcher(s);
             return s;
         }
@@ -424,9 +1153,15 @@ namespace ifr {
         ifr::Config::ConfigController Variable::cc;
 
 
+        std::map<std::string, std::map<std::string, std::string>> Variable::presets;
+        ifr::Config::ConfigController Variable::presetCC;
+
         bool Variable::init() {
-            std::unique_lock<decltype(mutex)> lock(mutex);
-            if (locked)return false;
+            {
+                std::unique_lock<decltype(mutex)> lock(mutex);
+                if (locked)return false;
+                locked = true;
+            }
             static ifr::Config::ConfigInfo<void> info = {
                     [](void *a, auto &w) {
                         std::unique_lock<decltype(mutex)> lock(mutex);
@@ -435,21 +1170,115 @@ namespace ifr {
                         w.EndObject();
                     },
                     [](void *a, const rapidjson::Document &d) {
+                        for (const auto &e: d.GetObj()) {//逐个应用: 跳过无效的值, 不影响其它变量
+                            std::string error;
+                            if (!setValues({{e.name.GetString(), jsonToValue(e.value)}}, true, error))
+                                ifr::logger::err("API", "Variable: bad value in config", error);
+                        }
+                    }
+            };
+            static ifr::Config::ConfigInfo<void> presetInfo = {
+                    [](void *a, auto &w) {
                         std::unique_lock<decltype(mutex)> lock(mutex);
-                        for (const auto &e: d.GetObj()) {
-                            const std::string name = e.name.GetString();
-                            if (vars.count(name))
-                                vars.find(name)->second.setValue(e.value.GetString());
+                        w.StartObject();
+                        for (const auto &p: presets) {
+                            w.Key(p.first), w.StartObject();
+                            for (const auto &e: p.second)w.Key(e.first), w.String(e.second);
+                            w.EndObject();
                         }
+                        w.EndObject();
+                    },
+                    [](void *a, const rapidjson::Document &d) {
+                        std::map<std::string, std::map<std::string, std::string>> all;//替换全部预设, 重新加载时移除已删除的预设
+                        for (const auto &p: d.GetObj()) {
+                            auto &preset = all[p.name.GetString()];
+                            for (const auto &e: p.value.GetObj())preset[e.name.GetString()] = jsonToValue(e.value);
+                        }
+                        std::unique_lock<decltype(mutex)> lock(mutex);
+                        presets.swap(all);
                     }
             };
             cc = ifr::Config::createConfig<void>("variable", nullptr, info);
             cc.load();
-            return locked = true;
+            presetCC = ifr::Config::createConfig<void>("variable-presets", nullptr, presetInfo);
+            presetCC.load();
+            return true;
         }
 
         void Variable::save() { cc.save(); }
 
+        std::map<std::string, std::string> Variable::getValues(const std::vector<std::string> &keys) {
+            std::map<std::string, std::string> values;
+            std::unique_lock<decltype(mutex)> lock(mutex);
+            if (keys.empty())for (const auto &e: vars)values[e.first] = e.second.getValue();
+            for (const auto &k: keys) {
+                const auto itr = vars.find(k);
+                if (itr != vars.end())values[k] = itr->second.getValue();
+            }
+            return values;
+        }
+
+        bool Variable::setValues(const std::map<std::string, std::string> &values, bool ignoreUnknown,
+                                 std::string &error) {
+            std::vector<std::pair<const Variable *, const std::string *>> todo;
+            std::unique_lock<decltype(mutex)> lock(mutex);
+            for (const auto &e: values) {
+                const auto itr = vars.find(e.first);
+                if (itr == vars.end()) {
+                    if (ignoreUnknown)continue;
+                    return error = e.first, false;
+                }
+                if (!itr->second.checkValue(e.second))return error = e.first, false;
+                todo.emplace_back(&itr->second, &e.second);
+            }
+            for (const auto &e: todo)e.first->setValue(*e.second);
+            return true;
+        }
+
+        void Variable::savePreset(const std::string &name) {
+            auto values = getValues();
+            {
+                std::unique_lock<decltype(mutex)> lock(mutex);
+                presets[name].swap(values);
+            }
+            presetCC.save();
+        }
+
+        bool Variable::removePreset(const std::string &name) {
+            {
+                std::unique_lock<decltype(mutex)> lock(mutex);
+                if (!presets.erase(name))return false;
+            }
+            presetCC.save();
+            return true;
+        }
+
+        bool Variable::applyPreset(const std::string &name, std::string &error) {
+            std::map<std::string, std::string> values;
+            {
+                std::unique_lock<decltype(mutex)> lock(mutex);
+                const auto itr = presets.find(name);
+                if (itr == presets.end())return error.clear(), false;
+                values = itr->second;
+            }
+            return setValues(values, true, error);
+        }
+
+        std::string Variable::getPresetsJson() {
+            rapidjson::StringBuffer buf;
+            rapidjson::Writer<rapidjson::StringBuffer> w(buf);
+            std::unique_lock<decltype(mutex)> lock(mutex);
+            w.StartObject();
+            for (const auto &p: presets) {
+                w.Key(p.first), w.StartObject();
+                for (const auto &e: p.second)w.Key(e.first), w.String(e.second);
+                w.EndObject();
+            }
+            w.EndObject();
+            w.Flush();
+            return buf.GetString();
+        }
+
 
 #endif
     }
@@ -13,14 +13,35 @@
 #include "logger/logger.hpp"
 #include "plan/Plans.h"
 #include "tools/tools.hpp"
+#include "trace/trace.hpp"
 #include <memory>
 #include <thread>
 #include <utility>
 #include <mutex>
+#include <unordered_map>
+#include <string_view>
+#include <tuple>
+#include <bit>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <atomic>
+#include <functional>
+#include <type_traits>
+#include <cstring>
+#include <charconv>
+#include <cctype>
 
 using namespace rapidjson;
 
 #define IFRAPI_HAS_VARIABLE RAPIDJSON_HAS_CXX17
+#if defined(__x86_64__) || defined(__i386__)
+#define IFRAPI_HAS_RDTSC 1
+#include <x86intrin.h>
+#include <cpuid.h>
+#else
+#define IFRAPI_HAS_RDTSC 0
+#endif
 
 namespace ifr {
 
@@ -35,15 +56,143 @@ namespace ifr {
          */
         mg_str mgx_getquery(const mg_str &query, const std::string &key);
 
+        /**
+         * 路由表
+         * @details 在注册路由时构建, 查找耗时与路由数量无关:
+         * @details 无通配符的路由使用哈希表(路径)查找; 由整段"*"(匹配一段)及末尾"#"(匹配剩余所有段)组成的通配符路由按路径段构建前缀树;
+         * @details 段内含通配符的其他模式串按注册顺序使用mg_globmatch逐个匹配。
+         * @details 匹配优先级: 无通配符 > 前缀树(普通段优先于"*"及"#") > 其他, 同一请求类型及模式串仅保留第一次注册的处理器
+         * @tparam H 处理器类型
+         */
+        template<class H>
+        class RouteTable {
+        private:
+            struct Hash {
+                using is_transparent = void;
+
+                size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+            };
+
+            template<class V> using Map = std::unordered_map<std::string, V, Hash, std::equal_to<>>;
+            typedef std::vector<std::pair<std::string, H>> Methods;//请求类型 - 处理器
+
+            struct Node {
+                Map<std::unique_ptr<Node>> children;//普通段
+                std::unique_ptr<Node> any;//"*"段
+                Methods handlers;//在此结束的路由
+                Methods rest;//"#"段, 匹配剩余所有段
+            };
+
+            Map<Methods> exact;//无通配符的路由: 路径 - 处理器
+            Node root;//通配符路由的前缀树
+            std::vector<std::tuple<std::string, std::string, H>> globs;//其他路由: 请求类型, 模式串, 处理器
+
+            static const H *match(const Methods &m, std::string_view method) {
+                for (const auto &e: m)if (e.first == method)return &e.second;
+                return nullptr;
+            }
+
+            static void put(Methods &m, const std::string &method, const H &h) {
+                if (!match(m, method))m.emplace_back(method, h);
+            }
+
+            /**
+             * 在前缀树中匹配
+             * @param node 当前节点
+             * @param path 剩余路径(不含开头的'/')
+             * @param more 是否还有剩余的段
+             * @param method 请求类型
+             */
+            const H *walk(const Node &node, std::string_view path, bool more, std::string_view method) const {
+                if (!more)return match(node.handlers, method);
+                const auto pos = path.find('/');
+                const auto seg = path.substr(0, pos);
+                const auto next = pos == std::string_view::npos ? std::string_view() : path.substr(pos + 1);
+                const bool nmore = pos != std::string_view::npos;
+                const H *h = nullptr;
+                if (const auto itr = node.children.find(seg); itr != node.children.end())
+                    h = walk(*itr->second, next, nmore, method);
+                if (!h && node.any)h = walk(*node.any, next, nmore, method);
+                return h ? h : match(node.rest, method);
+            }
+
+        public:
+            /**
+             * 添加路由
+             * @param method 请求类型
+             * @param pattern 模式串(以'/'开头)
+             * @param h 处理器
+             */
+            void add(const std::string &method, const std::string &pattern, const H &h) {
+                if (pattern.find_first_of("*#?") == std::string::npos) {
+                    put(exact[pattern], method, h);
+                    return;
+                }
+                std::vector<std::string> segs;
+                for (size_t i = 1, j;; i = j + 1) {
+                    j = pattern.find('/', i);
+                    segs.push_back(pattern.substr(i, j == std::string::npos ? j : j - i));
+                    if (j == std::string::npos)break;
+                }
+                bool tree = pattern[0] == '/';
+                for (size_t i = 0; i < segs.size() && tree; i++) {
+                    const auto &seg = segs[i];
+                    if (seg == "*" || (seg == "#" && i + 1 == segs.size()))continue;
+                    tree = seg.find_first_of("*#?") == std::string::npos;
+                }
+                if (!tree) {
+                    globs.emplace_back(method, pattern, h);
+                    return;
+                }
+                Node *node = &root;
+                for (const auto &seg: segs) {
+                    if (seg == "#") {
+                        put(node->rest, method, h);
+                        return;
+                    }
+                    auto &next = seg == "*" ? node->any : node->children[seg];
+                    if (!next)next = std::make_unique<Node>();
+                    node = next.get();
+                }
+                put(node->handlers, method, h);
+            }
+
+            /**
+             * 查找路由
+             * @param method 请求类型
+             * @param uri 请求路径
+             * @return 处理器, 未找到时为nullptr
+             */
+            const H *find(std::string_view method, std::string_view uri) const {
+                if (const auto itr = exact.find(uri); itr != exact.end())
+                    if (const auto h = match(itr->second, method))return h;
+                if (!uri.empty() && uri[0] == '/')
+                    if (const auto h = walk(root, uri.substr(1), true, method))return h;
+                for (const auto &e: globs)
+                    if (std::get<0>(e) == method &&
+                        mg_globmatch(std::get<1>(e).c_str(), std::get<1>(e).length(), uri.data(), uri.length()))
+                        return &std::get<2>(e);
+                return nullptr;
+            }
+        };
+
+        /**
+         * 设置websocket遥测流的推送间隔
+         * @param ms 间隔(毫秒), 默认100
+         */
+        void setTelemetryInterval(int ms);
+
         /**
          * @brief 初始化服务器
          * @param async 是否异步, false=直接在当前线程循环
+         * @param workers 执行耗时路由的工作线程数量
          */
-        void init(const std::string &url = "0.0.0.0:8000", bool async = false);
+        void init(const std::string &url = "0.0.0.0:8000", bool async = false, size_t workers = 2);
 
         /**
          * @brief websocket广播
          * @details 原始的信息
+         * @details 可在任意线程调用: 消息加入无锁队列, 由mongoose线程合并(以'\n'分隔)后发送
          * @param str 广播字符串
          */
         void sendWsReal(const std::string &str);
@@ -60,51 +209,183 @@ namespace ifr {
         sendWs(ifr::Plans::msgType wsType, const std::string &type, const std::string &subType, const std::string &msg);
 
 
-        /**耗时监控器*/
+        /**
+         * 耗时监控器
+         * @details 每个工作线程的数据独立且按缓存行分隔, 仅由该线程写入, 记录时不加锁, 可在发布版本中保持开启
+         * @details 同一轮(start)内相邻检查点之间的耗时记录在对数直方图中(HDR风格, 相对误差12.5%),
+         * 直方图按时间分为slot_amount片, 读取时合并滑动窗口内的分片得到分位数
+         * @details 每个区间同时作为完整区间事件记录到trace模块 (名称为"类型:起点>终点")
+         */
         class TimeWatcher {
         public:
             typedef int64_t tick_t;
             typedef double unit_t;
+            static const constexpr size_t sub_bits = 3;//每个数量级的子桶位数
+            static const constexpr size_t bucket_amount = (64 - sub_bits) << sub_bits;//直方图桶数量
+            static const constexpr size_t slot_amount = 5;//滑动窗口的分片数量
+
+            /**分位数统计 (单位: ms)*/
+            struct Stats {
+                uint64_t n = 0;//样本数
+                double p50 = 0, p90 = 0, p99 = 0, max = 0;
+
+                template<class T>
+                void operator()(rapidjson::Writer<T> &w) const {
+                    w.StartObject();
+                    w.Key("n"), w.Uint64(n);
+                    w.Key("p50"), w.Double(p50);
+                    w.Key("p90"), w.Double(p90);
+                    w.Key("p99"), w.Double(p99);
+                    w.Key("max"), w.Double(max);
+                    w.EndObject();
+                }
+            };
+
+            /**@return 耗时所在的桶*/
+            static inline size_t bucketOf(tick_t v) {
+                const auto u = (uint64_t) (v < 0 ? 0 : v);
+                const int e = (int) std::bit_width(u | 1) - 1;
+                const int shift = e > (int) sub_bits ? e - (int) sub_bits : 0;
+                return ((size_t) shift << sub_bits) + (size_t) (u >> shift);
+            }
+
+            /**@return 桶的中间值*/
+            static double bucketValue(size_t idx) {
+                if (idx < (2 << sub_bits))return (double) idx;
+                const auto shift = (idx >> sub_bits) - 1;
+                return (double) ((idx - (shift << sub_bits)) << shift) + (double) (1ULL << shift) / 2;
+            }
+
         private:
-            tick_t *mat;//时间点矩阵 [worker][point][c1/c2]
-            int *mat_id;//时间点矩阵的状态 [worker][w_id/r_id]
-            std::mutex cal_mutex;//计算锁
-            std::mutex stat_lock;//状态锁
+            /**滑动窗口的一个分片*/
+            struct Slot {
+                std::atomic<int64_t> epoch{-1};//分片编号
+                std::unique_ptr<std::atomic<uint32_t>[]> buckets;//[segment][bucket]
+                std::unique_ptr<std::atomic<tick_t>[]> max;//[segment]
+            };
+
+            /**一个工作线程的数据*/
+            struct alignas(64) Worker {
+                std::unique_ptr<std::atomic<tick_t>[]> row;//本轮每个检查点的时间
+                std::unique_ptr<uint32_t[]> rowRound;//每个检查点所属的轮次, 仅写入线程访问
+                uint32_t round = 0;//当前轮次, 仅写入线程访问
+                std::atomic<int64_t> epoch{-1};//最近写入的分片编号
+                Slot slots[slot_amount];
+            };
+
+            std::unique_ptr<Worker[]> workers;
+            const double slot_ticks;//每个分片的时长
+            std::vector<std::string> labels;//每个区间在轨迹中的名称
+
+            /**记录一个耗时, 仅由工作线程调用*/
+            inline void record(Worker &w, const size_t &segment, const tick_t &d, const tick_t &time) {
+                const auto epoch = (int64_t) ((double) time / slot_ticks);
+                auto &slot = w.slots[(size_t) (epoch < 0 ? -epoch : epoch) % slot_amount];
+                const auto segments = point_amount - 1;
+                if (slot.epoch.load(std::memory_order_relaxed) != epoch) {//进入新分片, 清空旧数据
+                    for (size_t i = 0; i < segments * bucket_amount; i++)
+                        slot.buckets[i].store(0, std::memory_order_relaxed);
+                    for (size_t i = 0; i < segments; i++)slot.max[i].store(0, std::memory_order_relaxed);
+                    slot.epoch.store(epoch, std::memory_order_release);
+                    w.epoch.store(epoch, std::memory_order_relaxed);
+                }
+                auto &b = slot.buckets[segment * bucket_amount + bucketOf(d)];
+                b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                auto &m = slot.max[segment];
+                if (d > m.load(std::memory_order_relaxed))m.store(d, std::memory_order_relaxed);
+            }
+
         public:
             const std::string type;//类型
             const unit_t unit_ms;//单位大小
             const size_t point_amount;//节点数量
             const size_t worker_amount;//工作线程数量
+            const double window_ms;//滑动窗口时长
+            const std::vector<std::string> names;//检查点名称, 可以为空
+
+            /**
+             * @brief 读取每个工作线程最近一次记录的时间点
+             * @param out 输出, 按[worker][point]展开
+             * @return 是否有效
+             */
+            bool read(std::vector<tick_t> &out) const {
+                if (point_amount < 2 || worker_amount < 1)return false;
+                out.resize(worker_amount * point_amount);
+                for (size_t i = 0; i < worker_amount; i++)
+                    for (size_t j = 0; j < point_amount; j++)
+                        out[i * point_amount + j] = workers[i].row[j].load(std::memory_order_relaxed);
+                return true;
+            }
+
+            /**
+             * @brief 获取滑动窗口内检查点之间耗时的分位数
+             * @param segment 区间, 即检查点segment到segment+1
+             * @param worker 工作ID, 小于0表示合并所有工作线程
+             * @return 统计数据
+             */
+            Stats stats(size_t segment, int worker = -1) const {
+                Stats st;
+                if (segment + 1 >= point_amount)return st;
+                int64_t current = -1;
+                for (size_t i = 0; i < worker_amount; i++)
+                    current = std::max(current, workers[i].epoch.load(std::memory_order_relaxed));
+                if (current < 0)return st;
+
+                std::vector<uint64_t> merged(bucket_amount);
+                tick_t max = 0;
+                for (size_t i = 0; i < worker_amount; i++) {
+                    if (worker >= 0 && (size_t) worker != i)continue;
+                    for (const auto &slot: workers[i].slots) {
+                        const auto epoch = slot.epoch.load(std::memory_order_acquire);
+                        if (epoch < 0 || epoch > current || current - epoch >= (int64_t) slot_amount)continue;
+                        for (size_t b = 0; b < bucket_amount; b++)
+                            merged[b] += slot.buckets[segment * bucket_amount + b].load(std::memory_order_relaxed);
+                        max = std::max(max, slot.max[segment].load(std::memory_order_relaxed));
+                    }
+                }
+                for (const auto &c: merged)st.n += c;
+                if (!st.n)return st;
+                const auto at = [&](double q) {
+                    const auto target = (uint64_t) std::ceil(q * (double) st.n);
+                    uint64_t sum = 0;
+                    for (size_t b = 0; b < bucket_amount; b++)
+                        if ((sum += merged[b]) >= target)return std::min(bucketValue(b), (double) max) / unit_ms;
+                    return (double) max / unit_ms;
+                };
+                st.p50 = at(0.5), st.p90 = at(0.9), st.p99 = at(0.99);
+                st.max = (double) max / unit_ms;
+                return st;
+            }
+
             /**
              * @brief 获取时间信息
-             * @details {"u":unit_ms,"mat":[[work0_point0, work0_point1, ... ], ... ]}
+             * @details {"u":unit_ms,"mat":[[work0_point0, work0_point1, ... ], ... ],"seg":[{"n","p50","p90","p99","max"}, ... ]}
+             * @details seg为相邻检查点之间的耗时(ms), 合并所有工作线程
              * @return 一个json 包含时间信息
              */
-            std::string getTime() {
-                if (point_amount < 2 || worker_amount < 1)return "";
-                std::unique_lock<std::mutex> lock(cal_mutex);
+            std::string getTime() const {
+                std::vector<tick_t> m;
+                if (!read(m))return "";
 
                 rapidjson::StringBuffer buf;
                 rapidjson::Writer<rapidjson::StringBuffer> w(buf);
                 w.StartObject();
                 w.Key("u"), w.Double(unit_ms);
-                w.Key("mat"), w.StartArray();
-                {
-                    std::unique_lock<std::mutex> lock_s(stat_lock);
-                    for (size_t i = 0; i < worker_amount; i++)
-                        mat_id[i * 2 + 1] = mat_id[i * 2] ? 0 : 1;
+                if (!names.empty()) {
+                    w.Key("names"), w.StartArray();
+                    for (const auto &n: names)w.String(n);
+                    w.EndArray();
                 }
+                w.Key("mat"), w.StartArray();
                 for (size_t i = 0; i < worker_amount; i++) {
-                    const auto off_w = 2 * point_amount * i + mat_id[i * 2 + 1];
                     w.StartArray();
                     for (size_t j = 0; j < point_amount; j++)
-                        w.Int64(mat[off_w + j * 2]);
+                        w.Int64(m[i * point_amount + j]);
                     w.EndArray();
                 }
-                for (size_t i = 0; i < worker_amount; i++)
-                    mat_id[i * 2 + 1] = -1;
-
-
+                w.EndArray();
+                w.Key("seg"), w.StartArray();
+                for (size_t j = 0; j + 1 < point_amount; j++)stats(j)(w);
                 w.EndArray();
                 w.EndObject();
                 w.Flush();
@@ -113,79 +394,518 @@ namespace ifr {
 
             /**
              * @brief 开始一组记录
+             * @details 仅由对应的工作线程调用
              * @param worker 开始的工作ID
              */
             inline void start(const size_t &worker) {
-                std::unique_lock<std::mutex> lock(stat_lock);
-                if (mat_id[worker * 2 + 1] < 0)mat_id[worker * 2] = mat_id[worker * 2] ? 0 : 1;
+                workers[worker].round++;
             }
 
             /**
              * @brief 记录一个时间
+             * @details 仅由对应的工作线程调用; 本轮已记录前一个检查点时, 同时记录两者之间的耗时
              * @param point 记录点
              * @param worker 工作ID
              * @param time 记录时间
              */
-#if DEBUG_TIME
-
             inline void setTime(const size_t &point, const size_t &worker, const tick_t &time) {
 #if DEBUG
-                if (point >= 0 && worker >= 0 && point < point_amount && worker < worker_amount) {
+                if (point >= point_amount || worker >= worker_amount)
+                    throw std::runtime_error("[TimeWatcher] " + type + ": Bad Arg: p=" + std::to_string(point) + ", w=" +
+                                             std::to_string(worker) + ", t=" + std::to_string(time));
 #endif
-                    mat[worker * point_amount * 2 + point * 2 + mat_id[worker * 2]] = time;
-#if DEBUG
-                    return;
+                auto &w = workers[worker];
+                w.row[point].store(time, std::memory_order_relaxed);
+                w.rowRound[point] = w.round;
+                if (point > 0 && w.rowRound[point - 1] == w.round) {
+                    const auto d = time - w.row[point - 1].load(std::memory_order_relaxed);
+                    record(w, point - 1, d, time);
+                    if (ifr::Trace::enabled.load(std::memory_order_relaxed)) {
+                        const auto end = ifr::Trace::now();
+                        ifr::Trace::complete(ifr::Trace::TIME, labels[point - 1], {},
+                                             end - (int64_t) ((double) d * 1e6 / unit_ms), end);
+                    }
                 }
-                throw std::runtime_error("[TimeWatcher] " + type + ": Bad Arg: p=" + std::to_string(point) + ", w=" +
-                                         std::to_string(worker) + ", t=" + std::to_string(time));
-#endif
             }
 
-#else
+            /**
+             * @param type 类型名称
+             * @param unitMs 单位, 即每毫秒的tick数
+             * @param pointAmount 检查点数量
+             * @param workerAmount 工作线程数量
+             * @param windowMs 滑动窗口时长(ms)
+             * @param pointNames 检查点名称
+             */
+            TimeWatcher(std::string type, const unit_t unitMs, const size_t pointAmount, const size_t workerAmount,
+                        const double windowMs = 5000, std::vector<std::string> pointNames = {}) :
+                    slot_ticks(std::max(unitMs * windowMs / slot_amount, 1.0)),
+                    type(std::move(type)), unit_ms(unitMs), point_amount(pointAmount), worker_amount(workerAmount),
+                    window_ms(windowMs), names(std::move(pointNames)) {
+                workers = std::make_unique<Worker[]>(workerAmount);
+                const auto segments = pointAmount > 1 ? pointAmount - 1 : 0;
+                for (size_t i = 0; i < workerAmount; i++) {
+                    auto &w = workers[i];
+                    w.row = std::make_unique<std::atomic<tick_t>[]>(pointAmount);
+                    w.rowRound = std::make_unique<uint32_t[]>(pointAmount);
+                    for (auto &slot: w.slots) {
+                        slot.buckets = std::make_unique<std::atomic<uint32_t>[]>(segments * bucket_amount);
+                        slot.max = std::make_unique<std::atomic<tick_t>[]>(segments);
+                    }
+                }
+                for (size_t i = 0; i < segments; i++)
+                    labels.push_back(this->type + ":" + (names.size() == pointAmount ? names[i] + ">" + names[i + 1]
+                                                                                     : std::to_string(i)));
+            }
+        };
+
+
+        /**
+         * 注册耗时检查点
+         * @param type 类型名称
+         * @param unit_ms 单位, 即(t1-t0)/unit_ms
+         * @param point_amount 检查点数量
+         * @param worker_amount 工作线程数量
+         * @param names 检查点名称, 可以为空
+         */
+        std::shared_ptr<TimeWatcher> registerTimePoint(const std::string &type, const TimeWatcher::unit_t &unit_ms,
+                                                       const size_t &point_amount, const size_t &worker_amount = 1,
+                                                       const std::vector<std::string> &names = {});
 
-            FORCE_INLINE void setTime(const size_t &point, const size_t &worker, const tick_t &time) {}
+        /**
+         * 低开销时钟
+         * @details x86平台且CPU支持恒定频率的TSC(cpuid 0x80000007 EDX[8])时使用rdtsc, 第一次获取单位时与steady_clock校准(约20ms);
+         * @details 其他情况使用steady_clock(ns)
+         */
+        struct FastClock {
+            /**@return 是否使用rdtsc*/
+            static inline bool useTsc() {
+#if IFRAPI_HAS_RDTSC
+                static const bool v = []() {
+                    unsigned a, b, c, d;
+                    return __get_cpuid(0x80000007, &a, &b, &c, &d) && (d & (1u << 8));
+                }();
+                return v;
+#else
+                return false;
+#endif
+            }
 
+            /**@return 当前时间(tick)*/
+            static inline TimeWatcher::tick_t now() {
+#if IFRAPI_HAS_RDTSC
+                if (useTsc())return (TimeWatcher::tick_t) __rdtsc();
 #endif
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
 
-            TimeWatcher(std::string type, const unit_t unitMs, const size_t pointAmount, const size_t workerAmount) :
-                    type(std::move(type)), unit_ms(unitMs), point_amount(pointAmount), worker_amount(workerAmount) {
-                mat = new tick_t[pointAmount * workerAmount * 2];
-                mat_id = new int[workerAmount * 2];
-                memset(mat, 0, sizeof(tick_t) * pointAmount * workerAmount * 2);
-                memset(mat_id, 0, sizeof(int) * workerAmount * 2);
+            /**@return 每毫秒的tick数*/
+            static double ticksPerMs() {
+                static const double v = calibrate();
+                return v;
             }
 
-            ~TimeWatcher() {
-                delete[] mat;
-                delete[] mat_id;
+        private:
+            static double calibrate() {
+#if IFRAPI_HAS_RDTSC
+                if (!useTsc())return 1e6;
+                const auto t0 = std::chrono::steady_clock::now();
+                const auto c0 = now();
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                const auto c1 = now();
+                const auto t1 = std::chrono::steady_clock::now();
+                return (double) (c1 - c0) / std::chrono::duration<double, std::milli>(t1 - t0).count();
+#else
+                return 1e6;
+#endif
             }
+        };
 
+        /**@return 字符串的FNV-1a哈希, 用作编译期检查点ID*/
+        constexpr uint64_t fnv1a(std::string_view s) {
+            uint64_t h = 14695981039346656037ULL;
+            for (const auto c: s)h = (h ^ (uint8_t) c) * 1099511628211ULL;
+            return h;
+        }
 
+        /**
+         * 编译期检查点名称表
+         * @details 应声明为static constexpr, 名称重复或查找不存在的名称时编译失败
+         * @tparam N 检查点数量
+         */
+        template<size_t N>
+        struct PointNames {
+            std::array<std::string_view, N> names;//名称
+            std::array<uint64_t, N> ids{};//ID
+
+            template<class... S>
+            constexpr explicit PointNames(S... s) : names{std::string_view(s)...} {
+                for (size_t i = 0; i < N; i++) {
+                    ids[i] = fnv1a(names[i]);
+                    for (size_t j = 0; j < i; j++)
+                        if (ids[j] == ids[i])throw std::logic_error("[TimeWatcher] duplicate point name");
+                }
+            }
+
+            /**@return 检查点ID对应的下标*/
+            constexpr size_t index(uint64_t id) const {
+                for (size_t i = 0; i < N; i++)if (ids[i] == id)return i;
+                throw std::logic_error("[TimeWatcher] unknown point name");
+            }
         };
 
+        template<class... S> PointNames(S...) -> PointNames<sizeof...(S)>;
 
         /**
-         * 注册耗时检查点
+         * 注册使用FastClock的耗时检查点
          * @param type 类型名称
-         * @param unit_ms 单位, 即(t1-t0)/unit_ms
-         * @param point_amount 检查点数量
+         * @param names 检查点名称表
          * @param worker_amount 工作线程数量
          */
-        std::shared_ptr<TimeWatcher> registerTimePoint(const std::string &type, const TimeWatcher::unit_t &unit_ms,
-                                                       const size_t &point_amount, const size_t &worker_amount = 1);
+        template<size_t N>
+        std::shared_ptr<TimeWatcher>
+        registerTimePoint(const std::string &type, const PointNames<N> &names, const size_t &worker_amount = 1) {
+            return registerTimePoint(type, FastClock::ticksPerMs(), N, worker_amount,
+                                     std::vector<std::string>(names.names.begin(), names.names.end()));
+        }
+
+        /**
+         * 区间探针
+         * @details 构造时记录起点, 析构时记录终点; 起点为第0个检查点时自动开始新的一轮
+         */
+        class ScopedProbe {
+        private:
+            TimeWatcher *const tw;
+            const size_t worker, end;
+        public:
+            ScopedProbe(TimeWatcher *tw, size_t worker, size_t begin, size_t end) : tw(tw), worker(worker), end(end) {
+                if (begin == 0)tw->start(worker);
+                tw->setTime(begin, worker, FastClock::now());
+            }
+
+            ScopedProbe(const ScopedProbe &) = delete;
+
+            ScopedProbe &operator=(const ScopedProbe &) = delete;
+
+            ~ScopedProbe() { tw->setTime(end, worker, FastClock::now()); }
+        };
+
+#define IFRAPI_PROBE_CAT_(a, b) a##b
+#define IFRAPI_PROBE_CAT(a, b) IFRAPI_PROBE_CAT_(a, b)
+#define IFRAPI_PROBE_INDEX(names, point) std::integral_constant<size_t, (names).index(ifr::API::fnv1a(point))>::value
+///记录一个检查点: 监控器, 名称表, 检查点名称, 工作ID
+#define IFRAPI_PROBE(tw, names, point, worker) \
+        (tw)->setTime(IFRAPI_PROBE_INDEX(names, point), worker, ifr::API::FastClock::now())
+///记录一个区间(至作用域结束): 监控器, 名称表, 起点名称, 终点名称, 工作ID
+#define IFRAPI_PROBE_SCOPE(tw, names, begin, end, worker) \
+        ifr::API::ScopedProbe IFRAPI_PROBE_CAT(_ifrapi_probe_, __LINE__)(&*(tw), worker, \
+                IFRAPI_PROBE_INDEX(names, begin), IFRAPI_PROBE_INDEX(names, end))
 
 #if IFRAPI_HAS_VARIABLE
 
-        class Variable {
-        private:
+        /**
+         * 顺序锁存储, 用于无法无锁原子化的可平凡复制类型
+         * @details 写入方需互斥; 读取方不加锁, 读到写入中的数据时重试
+         */
+        template<class T>
+        class SeqLock {
+            static const constexpr size_t words = (sizeof(T) + 7) / 8;
+            std::atomic<uint32_t> seq{0};
+            std::array<std::atomic<uint64_t>, words> data;
+        public:
+            explicit SeqLock(const T &v) { store(v); }
 
+            T load() const {
+                uint64_t buf[words];
+                for (;;) {
+                    const auto s1 = seq.load(std::memory_order_acquire);
+                    if (s1 & 1)continue;
+                    for (size_t i = 0; i < words; i++)buf[i] = data[i].load(std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (seq.load(std::memory_order_relaxed) == s1)break;
+                }
+                T v;
+                std::memcpy(&v, buf, sizeof(T));
+                return v;
+            }
+
+            void store(const T &v) {
+                uint64_t buf[words]{};
+                std::memcpy(buf, &v, sizeof(T));
+                const auto s = seq.load(std::memory_order_relaxed);
+                seq.store(s + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                for (size_t i = 0; i < words; i++)data[i].store(buf[i], std::memory_order_relaxed);
+                seq.store(s + 2, std::memory_order_release);
+            }
+        };
+
+        /**
+         * 原子共享指针存储, 用于不可平凡复制的类型(如字符串)
+         * @details 写入时替换整个对象, 读取方持有的旧对象不受影响
+         */
+        template<class T>
+        class SharedBox {
+            std::atomic<std::shared_ptr<const T>> ptr;
+        public:
+            explicit SharedBox(const T &v) : ptr(std::make_shared<const T>(v)) {}
+
+            T load() const { return *ptr.load(std::memory_order_acquire); }
+
+            std::shared_ptr<const T> share() const { return ptr.load(std::memory_order_acquire); }
+
+            void store(const T &v) { ptr.store(std::make_shared<const T>(v), std::memory_order_release); }
+        };
+
+        /**
+         * 枚举名称表, 使用IFRAPI_ENUM特化, 名称按枚举值0, 1, 2...的顺序排列
+         * @details 未特化的枚举按整数值读写
+         */
+        template<class E>
+        struct EnumNames {
+            static constexpr std::array<std::string_view, 0> names{};
+        };
+
+///定义枚举的名称表: 枚举类型, 名称...
+#define IFRAPI_ENUM(E, ...) \
+        template<> struct ifr::API::EnumNames<E> { \
+            static constexpr auto names = std::to_array<std::string_view>({__VA_ARGS__}); \
+        };
+
+        /**
+         * 变量类型特性: 每个类型的稳定类型描述、解析、格式化及范围检查
+         * @details type: 类型描述, 提供给前端, 不随编译器变化
+         * @details parse: 字符串转值, 格式错误时抛出std::invalid_argument
+         * @details format: 值转字符串
+         * @details inRange: 是否在[min, max]内
+         */
+        template<class T, class = void>
+        struct VarTraits {
+            static_assert(sizeof(T) == 0, "[API Variable] Unsupported type");
+        };
+
+        namespace VarTraitsHelper {
+            inline std::string_view trim(std::string_view s) {
+                while (!s.empty() && std::isspace((unsigned char) s.front()))s.remove_prefix(1);
+                while (!s.empty() && std::isspace((unsigned char) s.back()))s.remove_suffix(1);
+                return s;
+            }
+
+            /**解析整个字符串为数字*/
             template<class T>
-            static std::string toStr(const T &data) {
-                if (std::is_same<T, bool>::value) return data ? "true" : "false";
-                else return std::to_string(data);
+            T number(std::string_view s) {
+                s = trim(s);
+                if (!s.empty() && s.front() == '+')s.remove_prefix(1);
+                T v{};
+                const auto r = std::from_chars(s.data(), s.data() + s.size(), v);
+                if (s.empty() || r.ec != std::errc() || r.ptr != s.data() + s.size())
+                    throw std::invalid_argument("[API Variable] Bad number: " + std::string(s));
+                return v;
+            }
+        }
+
+        template<>
+        struct VarTraits<bool> {
+            static std::string type() { return "bool"; }
+
+            static bool parse(std::string_view s) {
+                s = VarTraitsHelper::trim(s);
+                if (s == "true")return true;
+                if (s == "false")return false;
+                throw std::invalid_argument("[API Variable] Bad bool: " + std::string(s));
+            }
+
+            static std::string format(const bool &v) { return v ? "true" : "false"; }
+
+            static bool inRange(const bool &, const bool &, const bool &) { return true; }
+        };
+
+        template<class T>
+        struct VarTraits<T, std::enable_if_t<std::is_arithmetic_v<T> && !std::is_same_v<T, bool>>> {
+            static std::string type() {
+                if constexpr (std::is_same_v<T, int>)return "int";
+                else if constexpr (std::is_same_v<T, long>)return "long";
+                else if constexpr (std::is_same_v<T, unsigned>)return "unsigned";
+                else if constexpr (std::is_same_v<T, unsigned long>)return "unsigned long";
+                else if constexpr (std::is_same_v<T, float>)return "float";
+                else if constexpr (std::is_same_v<T, double>)return "double";
+                else if constexpr (std::is_floating_point_v<T>)return "f" + std::to_string(sizeof(T) * 8);
+                else return (std::is_signed_v<T> ? "i" : "u") + std::to_string(sizeof(T) * 8);
+            }
+
+            static T parse(std::string_view s) { return VarTraitsHelper::number<T>(s); }
+
+            static std::string format(const T &v) { return std::to_string(v); }
+
+            static bool inRange(const T &v, const T &min, const T &max) { return !(v < min) && !(max < v); }
+        };
+
+        template<class T>
+        struct VarTraits<T, std::enable_if_t<std::is_enum_v<T>>> {
+            typedef std::underlying_type_t<T> U;
+            static constexpr auto &names = EnumNames<T>::names;
+
+            /**@return enum{名称,...}, 无名称表时为enum*/
+            static std::string type() {
+                std::string t = "enum";
+                if (names.empty())return t;
+                t += '{';
+                for (size_t i = 0; i < names.size(); i++)(i ? t += ',' : t) += names[i];
+                return t += '}';
             }
 
+            static T parse(std::string_view s) {
+                s = VarTraitsHelper::trim(s);
+                for (size_t i = 0; i < names.size(); i++)if (names[i] == s)return (T) i;
+                return (T) VarTraitsHelper::number<U>(s);
+            }
+
+            static std::string format(const T &v) {
+                const auto u = (U) v;
+                if (u >= 0 && (size_t) u < names.size())return std::string(names[(size_t) u]);
+                return std::to_string(u);
+            }
 
+            static bool inRange(const T &v, const T &min, const T &max) {
+                return (U) v >= (U) min && (U) v <= (U) max;
+            }
+        };
+
+        template<>
+        struct VarTraits<std::string> {
+            static std::string type() { return "string"; }
+
+            static std::string parse(std::string_view s) { return std::string(s); }
+
+            static std::string format(const std::string &v) { return v; }
+
+            /**字符串不检查范围*/
+            static bool inRange(const std::string &, const std::string &, const std::string &) { return true; }
+        };
+
+        /**定长数组, 格式为[a,b,c] (解析时方括号可省略), 逐个元素检查范围*/
+        template<class T, size_t N>
+        struct VarTraits<std::array<T, N>> {
+            static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>, "[API Variable] Unsupported array element");
+            typedef std::array<T, N> A;
+
+            static std::string type() { return "array<" + VarTraits<T>::type() + "," + std::to_string(N) + ">"; }
+
+            static A parse(std::string_view s) {
+                s = VarTraitsHelper::trim(s);
+                if (s.size() >= 2 && s.front() == '[' && s.back() == ']')s = s.substr(1, s.size() - 2);
+                A v{};
+                size_t i = 0;
+                for (size_t pos = 0; pos <= s.size(); i++) {
+                    auto end = s.find(',', pos);
+                    if (end == std::string_view::npos)end = s.size();
+                    if (i >= N)throw std::invalid_argument("[API Variable] Too many elements: " + std::string(s));
+                    v[i] = VarTraits<T>::parse(s.substr(pos, end - pos));
+                    pos = end + 1;
+                }
+                if (i != N)throw std::invalid_argument("[API Variable] Too few elements: " + std::string(s));
+                return v;
+            }
+
+            static std::string format(const A &v) {
+                std::string str = "[";
+                for (size_t i = 0; i < N; i++)(i ? str += ',' : str) += VarTraits<T>::format(v[i]);
+                return str += ']';
+            }
+
+            static bool inRange(const A &v, const A &min, const A &max) {
+                for (size_t i = 0; i < N; i++)if (!VarTraits<T>::inRange(v[i], min[i], max[i]))return false;
+                return true;
+            }
+        };
+
+        /**
+         * 实时可调变量
+         * @details 值保存在原子变量(或顺序锁)中, 任务线程每帧读取不加锁, 开销与读取普通变量相当
+         * @details 写入(API线程/代码)后, 读取方在看到新的版本号时一定能读到新值; 单次读取不会读到写了一半的值
+         * @details 变化钩子在写入线程上, 新值发布并释放访问锁后调用, 钩子中可以读写可调变量
+         * @details 任务线程可使用changed检测变化, 仅在变化时重新计算派生值
+         * @details 不可平凡复制的类型(如字符串)保存在原子共享指针中, 读取会复制对象, 可使用share避免复制
+         * @tparam T 值类型
+         */
+        template<class T>
+        class Tunable {
+        public:
+            typedef T value_type;
+            static const constexpr bool trivial = std::is_trivially_copyable_v<T>;
+            static const constexpr bool lock_free = [] {//是否直接使用原子变量
+                if constexpr (trivial)return std::atomic<T>::is_always_lock_free;
+                else return false;
+            }();
+            typedef std::function<void(const T &)> hook_t;
+        private:
+            std::conditional_t<lock_free, std::atomic<T>, std::conditional_t<trivial, SeqLock<T>, SharedBox<T>>> value;
+            std::atomic<uint64_t> ver{0};//版本号, 每次写入加一
+            std::mutex mtx;//访问锁: 写入及hooks
+            std::vector<hook_t> hooks;
+        public:
+            explicit Tunable(const T &def = T()) : value(def) {}
+
+            Tunable(const Tunable &) = delete;
+
+            Tunable &operator=(const Tunable &) = delete;
+
+            /**@return 当前值*/
+            inline T get() const {
+                if constexpr (lock_free)return value.load(std::memory_order_acquire);
+                else return value.load();
+            }
+
+            inline operator T() const { return get(); }// NOLINT(google-explicit-constructor)
+
+            /**@return 当前值的共享指针, 仅用于不可平凡复制的类型*/
+            std::shared_ptr<const T> share() const {
+                static_assert(!trivial, "Use get() for trivially copyable types");
+                return value.share();
+            }
+
+            /**
+             * @brief 写入新值并调用变化钩子
+             * @details 与当前值相同时不改变版本号, 也不调用钩子
+             */
+            void set(const T &v) {
+                std::unique_lock<std::mutex> lock(mtx);
+                const auto old = get();
+                if constexpr (trivial) {
+                    if (std::memcmp(&old, &v, sizeof(T)) == 0)return;
+                } else if (old == v)return;
+                if constexpr (lock_free)value.store(v, std::memory_order_release);
+                else value.store(v);
+                ver.fetch_add(1, std::memory_order_release);
+                const auto copy = hooks;
+                lock.unlock();//钩子中可能再次读写
+                for (const auto &h: copy)h(v);
+            }
+
+            Tunable &operator=(const T &v) { return set(v), *this; }
+
+            /**@return 版本号*/
+            inline uint64_t version() const { return ver.load(std::memory_order_acquire); }
+
+            /**
+             * @brief 检测自上次检测以来是否变化
+             * @param seen 调用方保存的版本号, 变化时被更新
+             * @return 是否变化
+             */
+            inline bool changed(uint64_t &seen) const {
+                const auto v = version();
+                if (v == seen)return false;
+                return seen = v, true;
+            }
+
+            /**添加变化钩子, 在写入线程上调用, 应尽量轻量*/
+            void onChange(hook_t hook) {
+                std::unique_lock<std::mutex> lock(mtx);
+                hooks.push_back(std::move(hook));
+            }
+        };
+
+        class Variable {
         public:
             static std::map<std::string, Variable> vars;
             static std::mutex mutex;
@@ -195,52 +915,89 @@ namespace ifr {
 
             const std::function<void(std::string)> setValue;
             const std::function<std::string()> getValue;
+            const std::function<bool(const std::string &)> checkValue;//值是否可解析且在范围内
 
             const std::string group_; //所属的组
-            const std::string type_;//变量类型
+            const std::string type_;//变量类型, 见VarTraits::type
             const std::string name_;//名称
             void *const data_;//数据指针
             const std::string def_;//默认值
-            const std::string min_;//最小值
-            const std::string max_;//最大值
+            const std::string min_;//最小值, 不检查范围时为空
+            const std::string max_;//最大值, 不检查范围时为空
 
         private:
 
+            /**普通变量: API线程通过atomic_ref读写; 任务线程直接读取变量, 不受保护, 运行时修改的值应使用Tunable*/
             template<class T>
-            std::function<std::string()> summonGet(T *const data) { return [data]() { return toStr(*((T *) data)); }; }
+            static std::function<std::string()> summonGet(T *const data) {
+                static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>, "Use Tunable for this type");
+                return [data]() { return VarTraits<T>::format(std::atomic_ref<T>(*data).load(std::memory_order_relaxed)); };
+            }
 
             template<class T>
-            std::function<void(std::string)> summonSet(T *const data) {
-                if (std::is_same<T, bool>::value) {
-                    return [data](auto v) { *((T *) data) = v == "true"; };
-                } else if (std::is_same<T, int>::value) {
-                    return [data](auto v) { *((T *) data) = std::stoi(v); };
-                } else if (std::is_same<T, double>::value) {
-                    return [data](auto v) { *((T *) data) = std::stod(v); };
-                } else if (std::is_same<T, float>::value) {
-                    return [data](auto v) { *((T *) data) = std::stof(v); };
-                } else if (std::is_same<T, long>::value) {
-                    return [data](auto v) { *((T *) data) = std::stol(v); };
-                } else if (std::is_same<T, unsigned long>::value) {
-                    return [data](auto v) { *((T *) data) = std::stoul(v); };
-                } else throw std::runtime_error("[API Variable] Unsupported type: " + type_);
+            static std::function<void(std::string)> summonSet(T *const data) {
+                return [data](auto v) {
+                    std::atomic_ref<T>(*data).store(VarTraits<T>::parse(v), std::memory_order_relaxed);
+                };
             }
 
-        public:
+            template<class T>
+            static std::function<std::string()> summonGet(Tunable<T> *const data) {
+                return [data]() { return VarTraits<T>::format(data->get()); };
+            }
 
             template<class T>
-            Variable(std::string group,
-                     std::string type, std::string name, T *const data,
-                     const T &def, const T &min, const T &max) :
-                    setValue(summonSet<T>(data)), getValue(summonGet<T>(data)),
-                    group_(std::move(group)), type_(std::move(type)), name_(std::move(name)), data_((void *) data),
-                    def_(toStr(def)), min_(toStr(min)), max_(toStr(max)) {
+            static std::function<void(std::string)> summonSet(Tunable<T> *const data) {
+                return [data](auto v) { data->set(VarTraits<T>::parse(v)); };
+            }
+
+            template<class T>
+            static std::function<bool(const std::string &)> summonCheck(const T &min, const T &max, bool ranged) {
+                return [min, max, ranged](const std::string &v) {
+                    try {
+                        const T t = VarTraits<T>::parse(v);
+                        return !ranged || VarTraits<T>::inRange(t, min, max);
+                    } catch (...) {
+                        return false;
+                    }
+                };
+            }
+
+            /**注册变量, 调用前需持有mutex*/
+            static void emplace(const std::string &key, Variable &&var) {
+                if (locked)
+                    throw std::runtime_error("[API Variable] Unable to register: " + key + ", locked");
+                if (vars.count(key))
+                    throw std::runtime_error("[API Variable] Variable with key " + key + " already exists");
+                vars.emplace(key, std::move(var));
+            }
+
+        public:
+
+            /**
+             * @tparam T 值类型
+             * @tparam D 数据类型, 为T或Tunable<T>
+             * @param ranged 是否检查范围
+             */
+            template<class T, class D>
+            Variable(std::string group, std::string name, D *const data,
+                     const T &def, const T &min, const T &max, bool ranged = true) :
+                    setValue(summonSet(data)), getValue(summonGet(data)), checkValue(summonCheck(min, max, ranged)),
+                    group_(std::move(group)), type_(VarTraits<T>::type()), name_(std::move(name)),
+                    data_((void *) data), def_(VarTraits<T>::format(def)),
+                    min_(ranged ? VarTraits<T>::format(min) : ""), max_(ranged ? VarTraits<T>::format(max) : "") {
             }
 
 
 #define IFRAPI_VARIABLE(group, name, min, max) \
         ifr::API::Variable::registerVar<decltype(name)>(#group, #name, &(name), min,max); \
 ///注册可前端调试变量: 是否可编辑, 所属组, 变量名, 最小值, 最大值
+#define IFRAPI_TUNABLE(group, name, min, max) \
+        ifr::API::Variable::registerVar<typename decltype(name)::value_type>(#group, #name, &(name), min,max); \
+///注册可前端调试的实时变量(Tunable): 所属组, 变量名, 最小值, 最大值
+#define IFRAPI_TUNABLE_NR(group, name) \
+        ifr::API::Variable::registerVar<typename decltype(name)::value_type>(#group, #name, &(name)); \
+///注册可前端调试的实时变量(Tunable), 不检查范围: 所属组, 变量名
 
             /**
              * @brief 注册一个可调变量
@@ -258,19 +1015,91 @@ namespace ifr {
             template<class T>
             static void registerVar(const std::string &group,
                                     const std::string &name, T *const data, const T &min, const T &max) {
-                auto key = group + " " + name;
                 std::unique_lock<decltype(mutex)> lock(mutex);
-                if (locked)
-                    throw std::runtime_error("[API Variable] Unable to register: " + key + ", locked");
-                if (vars.count(key))
-                    throw std::runtime_error("[API Variable] Variable with key " + key + " already exists");
-                assert(*data >= min && *data <= max);
-                vars.emplace(key, ifr::API::Variable(group, typeid(*data).name(), name, data, *data, min, max));
+                assert(VarTraits<T>::inRange(*data, min, max));
+                emplace(group + " " + name, ifr::API::Variable(group, name, data, *data, min, max));
+            }
+
+            /**
+             * @brief 注册一个实时可调变量
+             * @tparam T 变量类型
+             * @param group 所属组
+             * @param name 名称
+             * @param data 变量指针
+             * @param min 最小值
+             * @param max 最大值
+             */
+            template<class T>
+            static void registerVar(const std::string &group,
+                                    const std::string &name, Tunable<T> *const data, const T &min, const T &max) {
+                std::unique_lock<decltype(mutex)> lock(mutex);
+                const T def = data->get();
+                assert(VarTraits<T>::inRange(def, min, max));
+                emplace(group + " " + name, ifr::API::Variable(group, name, data, def, min, max));
+            }
+
+            /**
+             * @brief 注册一个实时可调变量, 不检查范围 (如字符串)
+             * @tparam T 变量类型
+             * @param group 所属组
+             * @param name 名称
+             * @param data 变量指针
+             */
+            template<class T>
+            static void registerVar(const std::string &group, const std::string &name, Tunable<T> *const data) {
+                std::unique_lock<decltype(mutex)> lock(mutex);
+                const T def = data->get();
+                emplace(group + " " + name, ifr::API::Variable(group, name, data, def, def, def, false));
             }
 
             /**保存所有变量*/
             static void save();
 
+            /**
+             * @brief 读取多个变量
+             * @param keys 变量键, 为空时读取全部; 不存在的键被忽略
+             * @return 键 - 值
+             */
+            static std::map<std::string, std::string> getValues(const std::vector<std::string> &keys = {});
+
+            /**
+             * @brief 批量设置变量
+             * @details 先校验全部值, 全部通过后再在锁内依次写入, 其他批量读写不会看到写了一半的状态
+             * @param values 键 - 值
+             * @param ignoreUnknown 是否忽略不存在的键 (否则视为错误)
+             * @param error 输出: 第一个出错的键
+             * @return 是否成功, 失败时不写入任何变量
+             */
+            static bool setValues(const std::map<std::string, std::string> &values, bool ignoreUnknown,
+                                  std::string &error);
+
+            static std::map<std::string, std::map<std::string, std::string>> presets;//预设名称 - 变量快照
+            static ifr::Config::ConfigController presetCC;
+
+            /**
+             * @brief 将当前所有变量保存为预设 (覆盖同名预设)
+             * @param name 预设名称
+             */
+            static void savePreset(const std::string &name);
+
+            /**
+             * @brief 删除预设
+             * @param name 预设名称
+             * @return 是否存在
+             */
+            static bool removePreset(const std::string &name);
+
+            /**
+             * @brief 一次性应用预设, 预设中已不存在的变量被忽略
+             * @param name 预设名称
+             * @param error 输出: 出错的键
+             * @return 是否成功 (预设不存在时error为空)
+             */
+            static bool applyPreset(const std::string &name, std::string &error);
+
+            /**@return 所有预设的json: {name:{key:value}}*/
+            static std::string getPresetsJson();
+
             /**初始化*/
             static bool init();
 
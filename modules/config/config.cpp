@@ -2,9 +2,393 @@
 // Created by yuanlu on 2022/10/18.
 //
 #include "config.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <map>
+
+#if __OS__ != __OS_Windows__
+
+#include <unistd.h>
+
+#endif
+#if __OS__ == __OS_Linux__
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+#endif
 
 namespace ifr {
     namespace Config {
+        namespace {
+            /**@return 当前时间 (ms, steady_clock)*/
+            int64_t now() {
+                return std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+        }
+
+        namespace Persist {
+            namespace {
+                /**后台写入线程, 程序退出时写入所有未完成的保存*/
+                struct Flusher {
+                    std::mutex mtx;//访问锁: 以下数据
+                    std::condition_variable cv;
+                    std::vector<std::shared_ptr<File>> queue;//等待写入的文件
+                    int delay = 200;//合并写入的等待时间 (ms)
+                    bool stop = false;
+                    std::thread thread;
+
+                    ~Flusher() {
+                        {
+                            std::unique_lock<std::mutex> lock(mtx);
+                            stop = true;
+                        }
+                        cv.notify_all();
+                        if (thread.joinable())thread.join();
+                    }
+
+                    void run() {
+                        std::unique_lock<std::mutex> lock(mtx);
+                        while (true) {
+                            if (queue.empty()) {
+                                if (stop)return;
+                                cv.wait(lock);
+                                continue;
+                            }
+                            int64_t due = INT64_MAX;
+                            for (const auto &f: queue) {
+                                std::unique_lock<std::mutex> lock2(f->mtx);
+                                due = std::min(due, f->pending ? f->due : 0);
+                            }
+                            if (!stop && due > now()) {
+                                cv.wait_for(lock, std::chrono::milliseconds(due - now()));
+                                continue;
+                            }
+                            std::vector<std::shared_ptr<File>> ready;
+                            const auto t = now();
+                            for (auto itr = queue.begin(); itr != queue.end();) {
+                                bool done;
+                                {
+                                    std::unique_lock<std::mutex> lock2((*itr)->mtx);
+                                    done = stop || !(*itr)->pending || (*itr)->due <= t;
+                                }
+                                if (done)ready.push_back(*itr), itr = queue.erase(itr);
+                                else ++itr;
+                            }
+                            lock.unlock();
+                            for (const auto &f: ready)flush(f);
+                            lock.lock();
+                        }
+                    }
+                };
+
+                Flusher &flusher() {
+                    static Flusher f;
+                    return f;
+                }
+            }
+
+            uint64_t hash(const std::string &content) {
+                uint64_t h = 1469598103934665603ULL;
+                for (const auto c: content)h = (h ^ (uint8_t) c) * 1099511628211ULL;
+                return h;
+            }
+
+            bool writeAtomic(const std::string &path, const std::string &content) {
+                const auto tmp = path + ".tmp";
+                FILE *f = std::fopen(tmp.c_str(), "wb");
+                if (!f) {
+                    ifr::logger::err("Config", "Can not open file (w)", tmp);
+                    return false;
+                }
+                bool ok = std::fwrite(content.data(), 1, content.size(), f) == content.size();
+                ok &= std::fflush(f) == 0;
+#if __OS__ != __OS_Windows__
+                ok &= fsync(fileno(f)) == 0;//重命名前确保内容已写入磁盘
+#endif
+                ok &= std::fclose(f) == 0;
+                if (!ok) {
+                    ifr::logger::err("Config", "Can not write file", tmp);
+                    std::remove(tmp.c_str());
+                    return false;
+                }
+#if IFR_CONFIG_USE_FS
+                std::error_code ec;
+                std::filesystem::rename(tmp, path, ec);//覆盖已存在的文件
+                if (ec) {
+                    ifr::logger::err("Config", "Can not rename file", tmp + ", err: " + ec.message());
+                    std::remove(tmp.c_str());
+                    return false;
+                }
+#else
+                if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+                    ifr::logger::err("Config", "Can not rename file", tmp);
+                    std::remove(tmp.c_str());
+                    return false;
+                }
+#endif
+                return true;
+            }
+
+            void submit(const std::shared_ptr<File> &file, std::string content) {
+                auto &fl = flusher();
+                std::unique_lock<std::mutex> lock(fl.mtx);
+                const auto h = hash(content);
+                {
+                    std::unique_lock<std::mutex> lock2(file->mtx);
+                    if (file->pending ? h == file->hash : h == file->written)return;//内容未变化
+                    if (!file->pending && fl.delay > 0)file->due = now() + fl.delay;
+                    file->pending = true, file->content.swap(content), file->hash = h;
+                    if (fl.delay > 0) {
+                        if (std::find(fl.queue.begin(), fl.queue.end(), file) == fl.queue.end())
+                            fl.queue.push_back(file);
+                        if (!fl.thread.joinable())fl.thread = std::thread([&fl]() { fl.run(); });
+                        lock2.unlock(), lock.unlock();
+                        fl.cv.notify_all();
+                        return;
+                    }
+                }
+                lock.unlock();
+                flush(file);
+            }
+
+            void flush(const std::shared_ptr<File> &file) {
+                std::unique_lock<std::mutex> wlock(file->write_mtx);
+                std::string content;
+                uint64_t h, prev;
+                {//只在取出内容时加锁, 写入期间submit/known不被阻塞
+                    std::unique_lock<std::mutex> lock(file->mtx);
+                    if (!file->pending)return;
+                    file->pending = false, content.swap(file->content), h = file->hash;
+                    if (h == file->written)return;
+                    prev = file->written, file->written = h;//提前更新: 监视线程不将本次写入视为外部修改
+                }
+                if (writeAtomic(file->path, content))return;
+                std::unique_lock<std::mutex> lock(file->mtx);
+                if (file->written == h)file->written = prev;
+            }
+
+            void flushAll() {
+                auto &fl = flusher();
+                std::vector<std::shared_ptr<File>> files;
+                {
+                    std::unique_lock<std::mutex> lock(fl.mtx);
+                    files.swap(fl.queue);
+                }
+                for (const auto &f: files)flush(f);
+            }
+
+            void setDelay(int ms) {
+                auto &fl = flusher();
+                {
+                    std::unique_lock<std::mutex> lock(fl.mtx);
+                    fl.delay = std::max(ms, 0);
+                }
+                if (ms <= 0)flushAll();
+            }
+        }
+        namespace Watch {
+#if __OS__ == __OS_Linux__ && IFR_CONFIG_USE_FS
+            namespace {
+                /**一个被监视的文件*/
+                struct Entry {
+                    std::string dir, name;//所在文件夹, 文件名
+                    std::function<uint64_t()> known;
+                    callback_t cb;
+                    int64_t due = 0;//读取时间 (ms), 0为没有修改
+                };
+
+                /**监视线程, 所有文件共用一个inotify实例*/
+                struct Watcher {
+                    std::mutex mtx;//访问锁: 以下数据
+                    std::recursive_mutex call_mtx;//访问锁: 执行回调 (停止监视时等待回调结束)
+                    int fd = -1, wake = -1;//inotify, 唤醒线程的eventfd
+                    std::map<std::string, std::pair<int, size_t>> dirs;//文件夹: 监视描述符, 文件数量
+                    std::map<size_t, Entry> entries;
+                    size_t nextId = 0;
+                    int debounce = 300;//修改后等待的时间 (ms)
+                    bool stop = false;
+                    std::thread thread;
+
+                    /**停止监视线程 (程序退出时), 之后仍可停止监视文件*/
+                    void shutdown() {
+                        {
+                            std::unique_lock<std::mutex> lock(mtx);
+                            stop = true;
+                        }
+                        notify();
+                        if (thread.joinable())thread.join();
+                    }
+
+                    void notify() const {
+                        if (wake < 0)return;
+                        const uint64_t one = 1;
+                        if (write(wake, &one, sizeof(one)) < 0) {}
+                    }
+
+                    /**处理inotify事件: 标记被修改的文件*/
+                    void read_events() {
+                        alignas(inotify_event) char buf[4096];
+                        ssize_t n;
+                        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+                            std::unique_lock<std::mutex> lock(mtx);
+                            const auto t = now();
+                            for (char *p = buf; p < buf + n;) {
+                                const auto *ev = (const inotify_event *) p;
+                                p += sizeof(inotify_event) + ev->len;
+                                if (!ev->len)continue;
+                                const std::string name(ev->name);
+                                for (auto &e: entries) {
+                                    if (e.second.name != name)continue;
+                                    const auto d = dirs.find(e.second.dir);
+                                    if (d != dirs.end() && d->second.first == ev->wd)e.second.due = t + debounce;
+                                }
+                            }
+                        }
+                    }
+
+                    void run() {
+                        while (true) {
+                            int timeout = -1;
+                            std::vector<size_t> ready;
+                            {
+                                std::unique_lock<std::mutex> lock(mtx);
+                                if (stop)return;
+                                const auto t = now();
+                                for (auto &e: entries) {
+                                    if (!e.second.due)continue;
+                                    if (e.second.due <= t)ready.push_back(e.first), e.second.due = 0;
+                                    else if (timeout < 0 || e.second.due - t < timeout)
+                                        timeout = (int) (e.second.due - t);
+                                }
+                            }
+                            for (const auto id: ready)check(id);
+                            if (!ready.empty())continue;
+                            pollfd pfd[2] = {{fd, POLLIN, 0},
+                                             {wake, POLLIN, 0}};
+                            if (poll(pfd, 2, timeout) < 0 && errno != EINTR)return;
+                            if (pfd[1].revents & POLLIN) {
+                                uint64_t v;
+                                if (read(wake, &v, sizeof(v)) < 0) {}
+                            }
+                            if (pfd[0].revents & POLLIN)read_events();
+                        }
+                    }
+
+                    /**读取文件, 内容与已知的不同时调用回调*/
+                    void check(size_t id) {
+                        std::unique_lock<std::recursive_mutex> lock(call_mtx);
+                        std::function<uint64_t()> known;
+                        callback_t cb;
+                        std::string path;
+                        {
+                            std::unique_lock<std::mutex> lock2(mtx);
+                            const auto itr = entries.find(id);
+                            if (itr == entries.end())return;//已停止监视
+                            known = itr->second.known, cb = itr->second.cb;
+                            path = itr->second.dir + '/' + itr->second.name;
+                        }
+                        std::ifstream in(path, std::ios::binary);
+                        if (!in.is_open())return;//已删除
+                        const std::string content((std::istreambuf_iterator<char>(in)),
+                                                  std::istreambuf_iterator<char>());
+                        const auto h = Persist::hash(content);
+                        if (known && known() == h)return;//自身写入的内容
+                        try {
+                            cb(content, h);
+                        } catch (std::exception &err) {
+                            ifr::logger::err("Config", "Watch callback error", path + ", err: " + err.what());
+                        } catch (...) {
+                            ifr::logger::err("Config", "Watch callback error", path);
+                        }
+                    }
+
+                    void remove(size_t id) {
+                        {
+                            std::unique_lock<std::mutex> lock(mtx);
+                            const auto itr = entries.find(id);
+                            if (itr == entries.end())return;
+                            const auto d = dirs.find(itr->second.dir);
+                            if (d != dirs.end() && !--d->second.second) {
+                                inotify_rm_watch(fd, d->second.first);
+                                dirs.erase(d);
+                            }
+                            entries.erase(itr);
+                        }
+                        std::unique_lock<std::recursive_mutex> lock(call_mtx);//等待正在执行的回调
+                    }
+                };
+
+                /**不被析构: 静态的配置文件控制器可能在其之后释放*/
+                Watcher &watcher() {
+                    static Watcher *const w = []() {
+                        std::atexit([]() { watcher().shutdown(); });
+                        return new Watcher;
+                    }();
+                    return *w;
+                }
+            }
+
+            std::shared_ptr<void> add(const std::string &path, std::function<uint64_t()> known, callback_t cb) {
+                std::error_code ec;
+                const auto abs = std::filesystem::absolute(path, ec);
+                if (ec)return nullptr;
+                const auto dir = abs.parent_path().string(), name = abs.filename().string();
+                auto &w = watcher();
+                size_t id;
+                {
+                    std::unique_lock<std::mutex> lock(w.mtx);
+                    if (w.fd < 0) {
+                        w.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+                        w.wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                        if (w.fd < 0 || w.wake < 0) {
+                            ifr::logger::err("Config", "Can not init inotify", strerror(errno));
+                            if (w.fd >= 0)close(w.fd), w.fd = -1;
+                            if (w.wake >= 0)close(w.wake), w.wake = -1;
+                            return nullptr;
+                        }
+                    }
+                    auto d = w.dirs.find(dir);
+                    if (d == w.dirs.end()) {
+                        //写入(IN_CLOSE_WRITE)及替换(IN_MOVED_TO, 包括原子保存及多数编辑器的保存方式)
+                        const int wd = inotify_add_watch(w.fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+                        if (wd < 0) {
+                            ifr::logger::err("Config", "Can not watch dir", dir + ", err: " + strerror(errno));
+                            return nullptr;
+                        }
+                        d = w.dirs.emplace(dir, std::make_pair(wd, (size_t) 0)).first;
+                    }
+                    d->second.second++;
+                    id = w.nextId++;
+                    w.entries[id] = {dir, name, std::move(known), std::move(cb)};
+                    if (!w.thread.joinable() && !w.stop)w.thread = std::thread([&w]() { w.run(); });
+                }
+                return std::shared_ptr<size_t>(new size_t(id), [](size_t *p) {
+                    watcher().remove(*p);
+                    delete p;
+                });
+            }
+
+            void setDebounce(int ms) {
+                auto &w = watcher();
+                std::unique_lock<std::mutex> lock(w.mtx);
+                w.debounce = std::max(ms, 0);
+            }
+#else
+
+            std::shared_ptr<void> add(const std::string &, std::function<uint64_t()>, callback_t) { return nullptr; }
+
+            void setDebounce(int) {}
+
+#endif
+        }
+
 #if !IFR_CONFIG_USE_FS
         void mkDir(std::string path) {
             if (path.empty())return;
@@ -14,6 +14,9 @@
 #include <string>
 #include <fstream>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include "logger/logger.hpp"
 #include "tools/tools.hpp"
 
@@ -38,8 +41,10 @@ namespace ifr {
          * 配置文件控制器
          */
         struct ConfigController {
-            std::function<void()> save;//保存
-            std::function<void()> load;//加载
+            std::function<void()> save;//保存 (内容未变化时跳过, 由后台线程合并写入)
+            std::function<void()> load;//加载 (先写入未完成的保存)
+            std::function<void()> flush;//立即写入未完成的保存
+            std::shared_ptr<void> watch;//文件监视, 所有副本释放后停止监视
         };
         /**
          * 配置文件信息
@@ -49,8 +54,86 @@ namespace ifr {
         struct ConfigInfo {
             std::function<void(T *const, rapidjson::Writer<OStreamWrapper> &)> serialize;//序列化
             std::function<void(T *const, const rapidjson::Document &)> deserialize;//反序列化
+            std::function<bool(T *const, const std::string &)> parse;//从文本读取, 设置时代替deserialize (见schema.h)
         };
 
+        /**
+         * 配置文件的持久化
+         * @details save只在调用线程中序列化, 写入由后台线程在delay后进行: 期间多次保存只写入最后一次的内容
+         * @details 写入时先写入临时文件(<文件名>.tmp)并同步到磁盘, 再重命名覆盖原文件, 崩溃时原文件保持完整
+         */
+        namespace Persist {
+            /**一个配置文件的写入状态*/
+            struct File {
+                const std::string path;//文件路径
+                std::mutex write_mtx;//写入锁: 同一文件的写入依次进行, 先于mtx获取
+                std::mutex mtx;//访问锁: 以下数据 (写入文件时不持有)
+                uint64_t written = 0;//文件内容的hash (最后一次写入或加载)
+                bool pending = false;//是否有未写入的内容
+                std::string content;//未写入的内容
+                uint64_t hash = 0;//未写入内容的hash
+                int64_t due = 0;//最晚写入时间 (ms, steady_clock)
+
+                explicit File(std::string path) : path(std::move(path)) {}
+            };
+
+            /**@return 内容的hash (FNV-1a)*/
+            uint64_t hash(const std::string &content);
+
+            /**
+             * @brief 原子地写入文件: 写入临时文件, 同步后重命名
+             * @return 是否成功
+             */
+            bool writeAtomic(const std::string &path, const std::string &content);
+
+            /**
+             * @brief 提交新的内容
+             * @details 与文件(或未写入的)内容相同时不做任何事; 否则在delay后由后台线程写入
+             */
+            void submit(const std::shared_ptr<File> &file, std::string content);
+
+            /**立即写入未完成的保存*/
+            void flush(const std::shared_ptr<File> &file);
+
+            /**立即写入所有未完成的保存 (程序退出时自动调用)*/
+            void flushAll();
+
+            /**
+             * @brief 设置合并写入的等待时间
+             * @param ms 等待时间 (ms), 0为在save中同步写入 (默认200ms)
+             */
+            void setDelay(int ms);
+        }
+
+        /**
+         * 配置文件的监视 (Linux inotify, 其它系统上不做任何事)
+         * @details 监视文件所在的文件夹, 文件被写入或替换(重命名)后等待debounce, 期间没有新的修改时读取文件
+         * @details 内容的hash与known返回的相同(即自身写入或加载的内容)时忽略, 否则调用回调
+         */
+        namespace Watch {
+            /**
+             * 文件修改回调, 在监视线程中调用
+             * @param content 文件内容
+             * @param hash 内容的hash
+             */
+            typedef std::function<void(const std::string &content, uint64_t hash)> callback_t;
+
+            /**
+             * @brief 开始监视文件
+             * @param path 文件路径
+             * @param known 返回已知内容的hash, 在监视线程中调用
+             * @param cb 回调
+             * @return 监视句柄, 释放后停止监视 (释放时等待正在执行的回调); 无法监视时为空
+             */
+            std::shared_ptr<void> add(const std::string &path, std::function<uint64_t()> known, callback_t cb);
+
+            /**
+             * @brief 设置修改后等待的时间
+             * @param ms 等待时间 (ms), 默认300ms
+             */
+            void setDebounce(int ms);
+        }
+
 #if !IFR_CONFIG_USE_FS
         /**
          * 创建文件夹 (递归创建, 调用系统命令)
@@ -87,56 +170,65 @@ namespace ifr {
             const auto path = dir + name + ".json";
             mkDir(getDir(path));
 #endif
+            const auto file = std::make_shared<Persist::File>(IFR_CONFIG_PATH2STR(path));
+            //读取内容: 格式错误时不调用deserialize, 保留当前数据
+            const auto apply = [&info, data, path](const std::string &content) {
+                try {
+                    if (info.parse) {
+                        if (info.parse(data, content))return true;
+                        ifr::logger::err("Config", "Can not parse file", path);
+                        return false;
+                    }
+                    Document d;
+                    d.Parse(content.c_str(), content.size());
+                    if (d.HasParseError()) {
+                        ifr::logger::err("Config", "Can not parse file", path);
+                        return false;
+                    }
+                    info.deserialize(data, d);
+                    return true;
+                } catch (std::exception &err) {
+                    ifr::logger::err("Config", "Can not deserialize file",
+                                     IFR_CONFIG_PATH2STR(path) + ", err: " + err.what());
+                } catch (...) {
+                    ifr::logger::err("Config", "Can not deserialize file", path);
+                }
+                return false;
+            };
             ConfigController cc = {
-                    [&info, data, path]() {
-                        try {
-                            std::ofstream fout(path);
-                            if (fout.is_open()) {
-                                rapidjson::OStreamWrapper osw(fout);
-                                rapidjson::Writer<OStreamWrapper> w(osw);
-
-                                try {
-                                    info.serialize(data, w);
-                                } catch (std::exception &err) {
-                                    ifr::logger::err("Config", "Can not serialize file",
-                                                     IFR_CONFIG_PATH2STR(path) + ", err: " + err.what());
-                                } catch (...) {
-                                    ifr::logger::err("Config", "Can not serialize file", path);
-                                }
-
-                                w.Flush();
-                                osw.Flush();
-                                fout.flush();
-                                fout.close();
-
-                            } else {
-                                ifr::logger::err("Config", "Can not open file (w)", path);
+                    [&info, data, path, file]() {
+                        std::ostringstream out;
+                        {
+                            rapidjson::OStreamWrapper osw(out);
+                            rapidjson::Writer<OStreamWrapper> w(osw);
+                            try {
+                                info.serialize(data, w);
+                            } catch (std::exception &err) {
+                                ifr::logger::err("Config", "Can not serialize file",
+                                                 IFR_CONFIG_PATH2STR(path) + ", err: " + err.what());
+                                return;
+                            } catch (...) {
+                                ifr::logger::err("Config", "Can not serialize file", path);
                                 return;
                             }
-                        } catch (std::exception &err) {
-                            ifr::logger::err("Config", "Can not write file",
-                                             IFR_CONFIG_PATH2STR(path) + ", err: " + err.what());
-                        } catch (...) {
-                            ifr::logger::err("Config", "Can not write file", path);
+                            w.Flush();
+                            osw.Flush();
                         }
+                        Persist::submit(file, out.str());
                     },
-                    [&info, data, path]() {
+                    [apply, path, file]() {
+                        Persist::flush(file);
                         try {
-                            std::ifstream fin(path);
+                            std::ifstream fin(path, std::ios::binary);
                             if (fin.is_open()) {
-                                Document d;
-                                rapidjson::IStreamWrapper isw(fin);
-                                d.ParseStream(isw);
-
-                                try {
-                                    info.deserialize(data, d);
-                                } catch (std::exception &err) {
-                                    ifr::logger::err("Config", "Can not deserialize file",
-                                                     IFR_CONFIG_PATH2STR(path) + ", err: " + err.what());
-                                } catch (...) {
-                                    ifr::logger::err("Config", "Can not deserialize file", path);
-                                }
+                                const std::string content((std::istreambuf_iterator<char>(fin)),
+                                                          std::istreambuf_iterator<char>());
                                 fin.close();
+                                {
+                                    std::unique_lock<std::mutex> lock(file->mtx);
+                                    file->written = Persist::hash(content);
+                                }
+                                apply(content);
                             } else {
                                 ifr::logger::err("Config", "Can not open file (r)", path);
                                 return;
@@ -147,8 +239,21 @@ namespace ifr {
                         } catch (...) {
                             ifr::logger::err("Config", "Can not read file", path);
                         }
-                    }
+                    },
+                    [file]() { Persist::flush(file); }
             };
+            cc.watch = Watch::add(file->path, [file]() {
+                std::unique_lock<std::mutex> lock(file->mtx);
+                return file->written;
+            }, [apply, file](const std::string &content, uint64_t hash) {
+                {
+                    std::unique_lock<std::mutex> lock(file->mtx);
+                    file->written = hash;
+                    if (file->pending)file->pending = false, std::string().swap(file->content);//以外部修改为准
+                }
+                if (apply(content))ifr::logger::log("Config", "Reload", file->path);
+                else ifr::logger::err("Config", "Ignore bad file", file->path);
+            });
             return cc;
         }
 
@@ -0,0 +1,595 @@
+#ifndef IFR_OPENCV_CONFIG_SCHEMA_H
+#define IFR_OPENCV_CONFIG_SCHEMA_H
+
+#include "config.h"
+#include "rapidjson/reader.h"
+#include "rapidjson/memorystream.h"
+#include "rapidjson/error/en.h"
+#include <limits>
+#include <map>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace ifr {
+    namespace Config {
+        /**
+         * 声明式的配置绑定
+         * @details 结构体通过静态函数schema()描述一次其字段(名称, 默认值, 校验), 由此生成序列化及反序列化
+         * @details 读取使用rapidjson的SAX Reader, 直接写入结构体, 不构建DOM
+         */
+        namespace Schema {
+            /**SAX事件中的基本值*/
+            struct Scalar {
+                enum Type {
+                    NUL, BOOL, INT, UINT, DOUBLE, STRING
+                } type = NUL;
+                bool b = false;
+                int64_t i = 0;
+                uint64_t u = 0;
+                double d = 0;
+                std::string_view s;
+            };
+
+            /**正在读取的对象/数组*/
+            struct Frame {
+                virtual ~Frame() = default;
+
+                /**对象的键 (数组不会调用)*/
+                virtual void key(std::string_view k) = 0;
+
+                /**当前键/元素为基本值*/
+                virtual bool value(const Scalar &v, std::string &error) = 0;
+
+                /**当前键/元素为对象, 返回读取它的帧, 类型不符时为空*/
+                virtual std::unique_ptr<Frame> object() = 0;
+
+                /**当前键/元素为数组, 返回读取它的帧, 类型不符时为空*/
+                virtual std::unique_ptr<Frame> array() = 0;
+
+                /**当前键/元素的对象/数组读取结束*/
+                virtual bool done(std::string &error) { return true; }
+
+                /**本对象/数组读取结束*/
+                virtual bool end(std::string &error) { return true; }
+
+                /**@return 当前键/元素的名称, 用于错误信息*/
+                [[nodiscard]] virtual std::string where() const = 0;
+            };
+
+            /**跳过未知的键*/
+            struct Skip : Frame {
+                void key(std::string_view) override {}
+
+                bool value(const Scalar &, std::string &) override { return true; }
+
+                std::unique_ptr<Frame> object() override { return std::make_unique<Skip>(); }
+
+                std::unique_ptr<Frame> array() override { return std::make_unique<Skip>(); }
+
+                [[nodiscard]] std::string where() const override { return "?"; }
+            };
+
+            /**
+             * 一个字段的描述
+             * @tparam C 结构体类型
+             * @tparam M 字段类型
+             */
+            template<class C, class M>
+            struct Field {
+                const char *name;//json中的键
+                M C::*ptr;//字段
+                std::optional<M> def_;//默认值: 缺少此键时使用
+                bool required_ = false;//是否必须存在
+                std::optional<double> min_, max_;//取值范围 (数字)
+                std::function<bool(const M &)> check_;//校验
+                const char *message = "invalid value";//校验失败的信息
+
+                /**@param v 默认值, 缺少此键时使用 (未设置时保留结构体的初始值)*/
+                Field def(M v) const {
+                    auto f = *this;
+                    f.def_ = std::move(v);
+                    return f;
+                }
+
+                /**缺少此键时读取失败*/
+                Field required() const {
+                    auto f = *this;
+                    f.required_ = true;
+                    return f;
+                }
+
+                /**取值范围 (闭区间)*/
+                Field range(double lo, double hi) const {
+                    static_assert(std::is_arithmetic_v<M>, "range() requires a numeric field");
+                    auto f = *this;
+                    f.min_ = lo, f.max_ = hi;
+                    return f;
+                }
+
+                /**
+                 * @param fn 校验函数, 返回false时读取失败
+                 * @param msg 失败的信息
+                 */
+                Field check(std::function<bool(const M &)> fn, const char *msg = "invalid value") const {
+                    auto f = *this;
+                    f.check_ = std::move(fn), f.message = msg;
+                    return f;
+                }
+
+                /**校验读取到的值*/
+                bool validate(const M &v, std::string &error) const {
+                    if constexpr (std::is_arithmetic_v<M>) {
+                        if ((min_ && (double) v < *min_) || (max_ && (double) v > *max_)) {
+                            error = "out of range [" + std::to_string(*min_) + ", " + std::to_string(*max_) + "]";
+                            return false;
+                        }
+                    }
+                    if (check_ && !check_(v))return error = message, false;
+                    return true;
+                }
+            };
+
+            /**
+             * @brief 描述一个字段
+             * @param name json中的键
+             * @param ptr 字段
+             */
+            template<class C, class M>
+            Field<C, M> field(const char *name, M C::*ptr) { return {name, ptr}; }
+
+            /**带有schema()的结构体*/
+            template<class T>
+            concept Described = requires { T::schema(); };
+
+            /**@return 结构体的字段描述 (只创建一次)*/
+            template<Described T>
+            const auto &fieldsOf() {
+                static const auto fields = T::schema();
+                return fields;
+            }
+
+            /**
+             * 类型的编解码
+             * @details read: 从基本值读取; object/array: 返回读取对象/数组的帧; write: 写入
+             */
+            template<class T, class = void>
+            struct Codec;
+
+            /**不是基本值的类型*/
+            struct Composite {
+                template<class T>
+                static bool read(T &, const Scalar &) { return false; }
+            };
+
+            /**不是对象/数组的类型*/
+            struct Plain {
+                template<class T>
+                static std::unique_ptr<Frame> object(T &) { return nullptr; }
+
+                template<class T>
+                static std::unique_ptr<Frame> array(T &) { return nullptr; }
+            };
+
+            template<>
+            struct Codec<bool> : Plain {
+                static bool read(bool &v, const Scalar &s) {
+                    if (s.type != Scalar::BOOL)return false;
+                    return v = s.b, true;
+                }
+
+                template<class W>
+                static void write(W &w, bool v) { w.Bool(v); }
+            };
+
+            /**整数: 超出类型范围时读取失败*/
+            template<class T>
+            struct Codec<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>> : Plain {
+                static bool read(T &v, const Scalar &s) {
+                    if (s.type == Scalar::INT) {
+                        if (s.i < (int64_t) std::numeric_limits<T>::min() ||
+                            (s.i > 0 && (uint64_t) s.i > (uint64_t) std::numeric_limits<T>::max()))
+                            return false;
+                        return v = (T) s.i, true;
+                    }
+                    if (s.type == Scalar::UINT) {
+                        if (s.u > (uint64_t) std::numeric_limits<T>::max())return false;
+                        return v = (T) s.u, true;
+                    }
+                    return false;
+                }
+
+                template<class W>
+                static void write(W &w, T v) {
+                    if constexpr (std::is_signed_v<T>)w.Int64(v);
+                    else w.Uint64(v);
+                }
+            };
+
+            template<class T>
+            struct Codec<T, std::enable_if_t<std::is_floating_point_v<T>>> : Plain {
+                static bool read(T &v, const Scalar &s) {
+                    switch (s.type) {
+                        case Scalar::INT:return v = (T) s.i, true;
+                        case Scalar::UINT:return v = (T) s.u, true;
+                        case Scalar::DOUBLE:return v = (T) s.d, true;
+                        default:return false;
+                    }
+                }
+
+                template<class W>
+                static void write(W &w, T v) { w.Double(v); }
+            };
+
+            /**枚举: 以整数保存*/
+            template<class T>
+            struct Codec<T, std::enable_if_t<std::is_enum_v<T>>> : Plain {
+                static bool read(T &v, const Scalar &s) {
+                    std::underlying_type_t<T> i;
+                    if (!Codec<decltype(i)>::read(i, s))return false;
+                    return v = (T) i, true;
+                }
+
+                template<class W>
+                static void write(W &w, T v) { w.Int64((int64_t) v); }
+            };
+
+            template<>
+            struct Codec<std::string> : Plain {
+                static bool read(std::string &v, const Scalar &s) {
+                    if (s.type != Scalar::STRING)return false;
+                    return v.assign(s.s.data(), s.s.size()), true;
+                }
+
+                template<class W>
+                static void write(W &w, const std::string &v) { w.String(v.data(), (rapidjson::SizeType) v.size()); }
+            };
+
+            /**读取std::vector的帧*/
+            template<class V>
+            struct VectorFrame : Frame {
+                typedef typename V::value_type E;
+                V &v;
+
+                explicit VectorFrame(V &v) : v(v) { v.clear(); }
+
+                void key(std::string_view) override {}
+
+                bool value(const Scalar &s, std::string &error) override {
+                    if (!Codec<E>::read(v.emplace_back(), s))return error = "type mismatch", false;
+                    return true;
+                }
+
+                std::unique_ptr<Frame> object() override { return Codec<E>::object(v.emplace_back()); }
+
+                std::unique_ptr<Frame> array() override { return Codec<E>::array(v.emplace_back()); }
+
+                [[nodiscard]] std::string where() const override { return "[" + std::to_string(v.size() - 1) + "]"; }
+            };
+
+            template<class E>
+            struct Codec<std::vector<E>> : Composite {
+                static std::unique_ptr<Frame> object(std::vector<E> &) { return nullptr; }
+
+                static std::unique_ptr<Frame> array(std::vector<E> &v) {
+                    return std::make_unique<VectorFrame<std::vector<E>>>(v);
+                }
+
+                template<class W>
+                static void write(W &w, const std::vector<E> &v) {
+                    w.StartArray();
+                    for (const auto &e: v)Codec<E>::write(w, e);
+                    w.EndArray();
+                }
+            };
+
+            /**读取以字符串为键的std::map的帧*/
+            template<class M>
+            struct MapFrame : Frame {
+                typedef typename M::mapped_type E;
+                M &m;
+                std::string k;
+
+                explicit MapFrame(M &m) : m(m) { m.clear(); }
+
+                void key(std::string_view key) override { k.assign(key.data(), key.size()); }
+
+                E &slot() {
+                    auto &e = m[k];
+                    e = E{};//重复的键以最后一个为准
+                    return e;
+                }
+
+                bool value(const Scalar &s, std::string &error) override {
+                    if (!Codec<E>::read(slot(), s))return error = "type mismatch", false;
+                    return true;
+                }
+
+                std::unique_ptr<Frame> object() override { return Codec<E>::object(slot()); }
+
+                std::unique_ptr<Frame> array() override { return Codec<E>::array(slot()); }
+
+                [[nodiscard]] std::string where() const override { return k; }
+            };
+
+            template<class K, class E, class Cmp, class A>
+            struct Codec<std::map<K, E, Cmp, A>, std::enable_if_t<std::is_same_v<std::remove_const_t<K>, std::string>>>
+                    : Composite {
+                typedef std::map<K, E, Cmp, A> M;
+
+                static std::unique_ptr<Frame> object(M &m) { return std::make_unique<MapFrame<M>>(m); }
+
+                static std::unique_ptr<Frame> array(M &) { return nullptr; }
+
+                template<class W>
+                static void write(W &w, const M &m) {
+                    w.StartObject();
+                    for (const auto &e: m) {
+                        w.Key(e.first.data(), (rapidjson::SizeType) e.first.size());
+                        Codec<E>::write(w, e.second);
+                    }
+                    w.EndObject();
+                }
+            };
+
+            /**读取结构体的帧*/
+            template<Described T>
+            struct StructFrame : Frame {
+                static const constexpr size_t npos = -1;
+                static const constexpr size_t count = std::tuple_size_v<std::decay_t<decltype(fieldsOf<T>())>>;
+                T &obj;
+                size_t current = npos;//当前字段, npos为未知的键
+                std::string unknown;//未知的键
+                bool seen[count ? count : 1]{};//已读取的字段
+
+                explicit StructFrame(T &obj) : obj(obj) {}
+
+                /**对第i个字段调用fn*/
+                template<class F>
+                static void visit(size_t i, F &&fn) {
+                    [&]<size_t... I>(std::index_sequence<I...>) {
+                        ((i == I ? (fn(std::get<I>(fieldsOf<T>())), 0) : 0), ...);
+                    }(std::make_index_sequence<count>());
+                }
+
+                void key(std::string_view k) override {
+                    current = npos;
+                    [&]<size_t... I>(std::index_sequence<I...>) {
+                        ((current == npos && k == std::get<I>(fieldsOf<T>()).name ? (current = I, 0) : 0), ...);
+                    }(std::make_index_sequence<count>());
+                    if (current == npos)unknown.assign(k.data(), k.size());
+                }
+
+                bool value(const Scalar &s, std::string &error) override {
+                    if (current == npos)return true;
+                    bool ok = true;
+                    visit(current, [&](const auto &f) {
+                        using M = std::decay_t<decltype(obj.*(f.ptr))>;
+                        if (!Codec<M>::read(obj.*(f.ptr), s))ok = false, error = "type mismatch";
+                        else ok = f.validate(obj.*(f.ptr), error);
+                    });
+                    seen[current] = true;
+                    return ok;
+                }
+
+                std::unique_ptr<Frame> object() override {
+                    if (current == npos)return std::make_unique<Skip>();
+                    std::unique_ptr<Frame> child;
+                    visit(current, [&](const auto &f) {
+                        using M = std::decay_t<decltype(obj.*(f.ptr))>;
+                        child = Codec<M>::object(obj.*(f.ptr));
+                    });
+                    return child;
+                }
+
+                std::unique_ptr<Frame> array() override {
+                    if (current == npos)return std::make_unique<Skip>();
+                    std::unique_ptr<Frame> child;
+                    visit(current, [&](const auto &f) {
+                        using M = std::decay_t<decltype(obj.*(f.ptr))>;
+                        child = Codec<M>::array(obj.*(f.ptr));
+                    });
+                    return child;
+                }
+
+                bool done(std::string &error) override {
+                    if (current == npos)return true;
+                    bool ok = true;
+                    visit(current, [&](const auto &f) { ok = f.validate(obj.*(f.ptr), error); });
+                    seen[current] = true;
+                    return ok;
+                }
+
+                /**缺少的字段: 使用默认值, 或读取失败*/
+                bool end(std::string &error) override {
+                    bool ok = true;
+                    for (size_t i = 0; ok && i < count; i++) {
+                        if (seen[i])continue;
+                        visit(i, [&](const auto &f) {
+                            if (f.required_)ok = false, current = i, error = "missing";
+                            else if (f.def_)obj.*(f.ptr) = *f.def_;
+                        });
+                    }
+                    return ok;
+                }
+
+                [[nodiscard]] std::string where() const override {
+                    if (current == npos)return unknown;
+                    std::string name;
+                    visit(current, [&](const auto &f) { name = f.name; });
+                    return name;
+                }
+            };
+
+            template<Described T>
+            struct Codec<T> : Composite {
+                static std::unique_ptr<Frame> object(T &v) { return std::make_unique<StructFrame<T>>(v); }
+
+                static std::unique_ptr<Frame> array(T &) { return nullptr; }
+
+                template<class W>
+                static void write(W &w, const T &v) {
+                    w.StartObject();
+                    std::apply([&](const auto &...f) {
+                        ((w.Key(f.name), Codec<std::decay_t<decltype(v.*(f.ptr))>>::write(w, v.*(f.ptr))), ...);
+                    }, fieldsOf<T>());
+                    w.EndObject();
+                }
+            };
+
+            /**SAX事件处理器, 将事件分发给帧栈*/
+            template<class T>
+            struct Handler : rapidjson::BaseReaderHandler<rapidjson::UTF8<>, Handler<T>> {
+                T &out;
+                std::vector<std::unique_ptr<Frame>> stack;
+                std::string error;
+
+                explicit Handler(T &out) : out(out) {}
+
+                bool fail(const std::string &msg) {
+                    std::string path;
+                    for (const auto &f: stack) {
+                        const auto w = f->where();
+                        path += (path.empty() || w[0] == '[' ? "" : ".") + w;
+                    }
+                    error = path.empty() ? msg : path + ": " + msg;
+                    return false;
+                }
+
+                bool scalar(const Scalar &s) {
+                    if (stack.empty())return fail("root should be an object or array");
+                    std::string msg;
+                    return stack.back()->value(s, msg) || fail(msg);
+                }
+
+                bool push(std::unique_ptr<Frame> f, const char *type) {
+                    if (!f)return fail(std::string("unexpected ") + type);
+                    stack.push_back(std::move(f));
+                    return true;
+                }
+
+                bool pop() {
+                    std::string msg;
+                    if (!stack.back()->end(msg))return fail(msg);
+                    stack.pop_back();
+                    return stack.empty() || stack.back()->done(msg) || fail(msg);
+                }
+
+                bool Null() { return scalar({Scalar::NUL}); }
+
+                bool Bool(bool b) {
+                    Scalar s{Scalar::BOOL};
+                    s.b = b;
+                    return scalar(s);
+                }
+
+                bool Int(int i) { return Int64(i); }
+
+                bool Uint(unsigned u) { return Uint64(u); }
+
+                bool Int64(int64_t i) {
+                    Scalar s{Scalar::INT};
+                    s.i = i;
+                    return scalar(s);
+                }
+
+                bool Uint64(uint64_t u) {
+                    Scalar s{Scalar::UINT};
+                    s.u = u;
+                    return scalar(s);
+                }
+
+                bool Double(double d) {
+                    Scalar s{Scalar::DOUBLE};
+                    s.d = d;
+                    return scalar(s);
+                }
+
+                bool String(const char *str, rapidjson::SizeType len, bool) {
+                    Scalar s{Scalar::STRING};
+                    s.s = {str, len};
+                    return scalar(s);
+                }
+
+                bool StartObject() {
+                    return push(stack.empty() ? Codec<T>::object(out) : stack.back()->object(), "object");
+                }
+
+                bool Key(const char *str, rapidjson::SizeType len, bool) {
+                    stack.back()->key({str, len});
+                    return true;
+                }
+
+                bool EndObject(rapidjson::SizeType) { return pop(); }
+
+                bool StartArray() {
+                    return push(stack.empty() ? Codec<T>::array(out) : stack.back()->array(), "array");
+                }
+
+                bool EndArray(rapidjson::SizeType) { return pop(); }
+            };
+
+            /**
+             * @brief 从json文本读取
+             * @details 缺少的键使用默认值(或保留out中的值), 未知的键被忽略; 失败时out中可能已写入部分内容
+             * @param json json文本
+             * @param out 输出
+             * @param error 失败的原因 (包括位置, 如"tasks.a.enable: type mismatch")
+             * @return 是否成功
+             */
+            template<class T>
+            bool read(std::string_view json, T &out, std::string &error) {
+                Handler<T> h(out);
+                rapidjson::Reader reader;
+                rapidjson::MemoryStream ms(json.data(), json.size());
+                const auto r = reader.Parse(ms, h);
+                if (r)return true;
+                if (!h.error.empty())error = h.error;
+                else error = std::string(rapidjson::GetParseError_En(r.Code())) + " (offset " +
+                             std::to_string(r.Offset()) + ")";
+                return false;
+            }
+
+            /**
+             * @brief 写入json
+             * @param w rapidjson的Writer
+             * @param v 数据
+             */
+            template<class W, class T>
+            void write(W &w, const T &v) { Codec<T>::write(w, v); }
+
+            /**
+             * @brief 创建结构体的配置文件信息
+             * @details 读取到临时对象中, 成功后整体替换data; 返回值应保存为静态变量(createConfig保存其引用)
+             * @param mtx 访问锁, 读写data时加锁, 为空时不加锁
+             * @return 配置文件信息
+             */
+            template<Described T, class Mutex = std::mutex>
+            ConfigInfo<T> info(Mutex *mtx = nullptr) {
+                return {
+                        [mtx](T *const data, rapidjson::Writer<OStreamWrapper> &w) {
+                            std::unique_lock<Mutex> lock;
+                            if (mtx)lock = std::unique_lock<Mutex>(*mtx);
+                            write(w, *data);
+                        },
+                        nullptr,
+                        [mtx](T *const data, const std::string &content) {
+                            T tmp{};
+                            std::string error;
+                            if (!read(content, tmp, error)) {
+                                ifr::logger::err("Config", "Bad config", error);
+                                return false;
+                            }
+                            std::unique_lock<Mutex> lock;
+                            if (mtx)lock = std::unique_lock<Mutex>(*mtx);
+                            *data = std::move(tmp);
+                            return true;
+                        }
+                };
+            }
+        }
+    }
+}
+#endif //IFR_OPENCV_CONFIG_SCHEMA_H
@@ -8,6 +8,22 @@
 #include "string"
 #include "iostream"
 #include "mutex"
+#include <sstream>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <functional>
+#include <algorithm>
+#include <condition_variable>
+#include <string_view>
+#include <charconv>
+#include <fstream>
+#include <unordered_map>
+#include "recorder/recorder.hpp"
 
 namespace ifr {
     namespace logger {
@@ -15,8 +31,957 @@ namespace ifr {
 #define IFR_LOGGER(type, __Expr__) ifr::logger::log(type,#__Expr__,__Expr__) //打印表达式字符串及其结果
 #define IFR_LOGGER_LOE(type, __Expr__) ifr::logger::log_or_err(type,#__Expr__,__Expr__)//打印表达式及其结果(若结果为false(或0等)则使用err打印)
 #define IFR_LOC_LOGGER(__Expr__) ifr::logger::log_loc(__FILE__, __LINE__, __func__,#__Expr__,__Expr__)//定位打印
-        static std::mutex log_mtx;
 
+        /**日志级别*/
+        enum Level : uint8_t {
+            LV_TRACE = 0, LV_DEBUG = 1, LV_INFO = 2, LV_WARN = 3, LV_ERROR = 4, LV_OFF = 5
+        };
+
+#ifndef IFR_LOG_LEVEL
+#define IFR_LOG_LEVEL 0 //编译期日志级别, 低于此级别的宏调用不会被编译 (0 = TRACE ... 5 = OFF)
+#endif
+
+        /**@return 级别名称*/
+        inline const char *levelName(Level level) {
+            static const char *const names[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "OFF"};
+            return level <= LV_OFF ? names[level] : "UNKNOWN";
+        }
+
+        /**
+         * @brief 解析级别名称
+         * @param name 名称 (大写)
+         * @param level 输出
+         * @return 是否成功
+         */
+        inline bool parseLevel(std::string_view name, Level &level) {
+            for (uint8_t i = LV_TRACE; i <= LV_OFF; i++)
+                if (name == levelName((Level) i))return level = (Level) i, true;
+            return false;
+        }
+
+        /**
+         * 运行时级别
+         * @details 每个分类(type)可以单独设置级别, 未设置的使用默认级别(INFO)
+         * @details 修改时增加版本号; 各线程/调用点缓存查询结果, 版本号不变时不加锁
+         */
+        namespace Levels {
+            struct State {
+                std::mutex mtx;//访问锁: modules
+                std::unordered_map<std::string, Level> modules;//分类 - 级别
+                std::atomic<uint8_t> def{LV_INFO};//默认级别
+                std::atomic<uint32_t> gen{1};//版本号
+            };
+
+            inline State &state() {
+                static State *const s = new State();
+                return *s;
+            }
+
+            /**@return 分类的级别*/
+            inline Level threshold(const std::string &type) {
+                auto &s = state();
+                thread_local uint32_t gen = 0;
+                thread_local std::unordered_map<std::string, Level> cache;
+                const auto g = s.gen.load(std::memory_order_acquire);
+                if (g != gen)cache.clear(), gen = g;
+                const auto itr = cache.find(type);
+                if (itr != cache.end()) [[likely]] return itr->second;
+                std::unique_lock<std::mutex> lock(s.mtx);
+                const auto m = s.modules.find(type);
+                const auto level = m == s.modules.end() ? (Level) s.def.load() : m->second;
+                if (cache.size() > 256)cache.clear();
+                return cache[type] = level;
+            }
+
+            /**
+             * @brief 设置级别
+             * @param type 分类, 为空时设置默认级别
+             * @param level 级别
+             */
+            inline void set(const std::string &type, Level level) {
+                auto &s = state();
+                std::unique_lock<std::mutex> lock(s.mtx);
+                if (type.empty())s.def = level;
+                else s.modules[type] = level;
+                s.gen.fetch_add(1, std::memory_order_release);
+            }
+
+            /**
+             * @brief 移除分类的级别, 恢复使用默认级别
+             * @return 是否存在
+             */
+            inline bool reset(const std::string &type) {
+                auto &s = state();
+                std::unique_lock<std::mutex> lock(s.mtx);
+                if (!s.modules.erase(type))return false;
+                s.gen.fetch_add(1, std::memory_order_release);
+                return true;
+            }
+
+            /**@return 默认级别*/
+            inline Level getDefault() { return (Level) state().def.load(); }
+
+            /**@return 所有单独设置的级别*/
+            inline std::unordered_map<std::string, Level> modules() {
+                auto &s = state();
+                std::unique_lock<std::mutex> lock(s.mtx);
+                return s.modules;
+            }
+        }
+
+        /**@return 分类在此级别的日志是否输出*/
+        inline bool enabled(const std::string &type, Level level) {
+            return level >= IFR_LOG_LEVEL && level < LV_OFF && level >= Levels::threshold(type);
+        }
+
+        /**
+         * 延迟格式化
+         * @details 调用处只记录静态的调用点ID及参数的原始值, 由后台线程或离线工具格式化
+         */
+        namespace Deferred {
+            /**参数类型*/
+            enum Tag : uint8_t {
+                I64 = 1, U64 = 2, F64 = 3, BOOL = 4, CHAR = 5, STR = 6
+            };
+
+            template<class T>
+            constexpr Tag tagOf() {
+                typedef std::remove_cv_t<std::remove_reference_t<T>> U;
+                if constexpr (std::is_same_v<U, bool>)return BOOL;
+                else if constexpr (std::is_same_v<U, char>)return CHAR;
+                else if constexpr (std::is_enum_v<U>)return std::is_signed_v<std::underlying_type_t<U>> ? I64 : U64;
+                else if constexpr (std::is_integral_v<U>)return std::is_signed_v<U> ? I64 : U64;
+                else if constexpr (std::is_floating_point_v<U>)return F64;
+                else {
+                    static_assert(std::is_convertible_v<const U &, std::string_view>,
+                                  "[logger] Deferred argument must be a number, bool, char or string");
+                    return STR;
+                }
+            }
+
+            /**调用点 (静态存储, 首次记录时注册)*/
+            struct Site {
+                const char *type;//log分类
+                const char *fmt;//格式, 使用{}作为参数占位符
+                const char *file;
+                int line;
+                Level level;//级别
+                std::atomic<uint32_t> id{0};//注册后的ID, 从1开始
+                std::atomic<uint64_t> cache{0};//级别检查缓存: 版本号<<1 | 是否输出
+
+                /**@return 是否输出, 运行时级别未修改时只读取两个原子变量*/
+                inline bool enabled() {
+                    const uint64_t g = Levels::state().gen.load(std::memory_order_acquire);
+                    auto c = cache.load(std::memory_order_relaxed);
+                    if (c >> 1 != g) [[unlikely]] {
+                        c = g << 1 | (uint64_t) ifr::logger::enabled(type, level);
+                        cache.store(c, std::memory_order_relaxed);
+                    }
+                    return c & 1;
+                }
+            };
+
+            /**已注册的调用点信息*/
+            struct SiteInfo {
+                uint32_t id;
+                Level level;
+                int line;
+                std::string type, fmt, file;
+                std::vector<Tag> tags;
+            };
+
+            /**调用点注册表, 不析构*/
+            struct Registry {
+                std::mutex mtx;
+                std::vector<std::shared_ptr<const SiteInfo>> sites;//下标为ID-1
+            };
+
+            inline Registry &registry() {
+                static Registry *const r = new Registry();
+                return *r;
+            }
+
+            /**@return 调用点信息, 不存在时为空*/
+            inline std::shared_ptr<const SiteInfo> site(uint32_t id) {
+                auto &r = registry();
+                std::unique_lock<std::mutex> lock(r.mtx);
+                return id && id <= r.sites.size() ? r.sites[id - 1] : nullptr;
+            }
+
+            /**注册调用点, 多个线程同时注册时只有一个生效*/
+            inline uint32_t registerSite(Site &s, std::vector<Tag> tags) {
+                auto &r = registry();
+                std::unique_lock<std::mutex> lock(r.mtx);
+                if (const auto id = s.id.load(std::memory_order_relaxed))return id;
+                const auto id = (uint32_t) r.sites.size() + 1;
+                r.sites.push_back(std::make_shared<const SiteInfo>(
+                        SiteInfo{id, s.level, s.line, s.type, s.fmt, s.file, std::move(tags)}));
+                s.id.store(id, std::memory_order_release);
+                return id;
+            }
+
+            /**@return 参数编码后的长度: 数字固定8字节, 字符串为u32长度加内容*/
+            template<class T>
+            inline size_t argSize(const T &v) {
+                if constexpr (tagOf<T>() == STR)return 4 + std::string_view(v).size();
+                else return 8;
+            }
+
+            template<class T>
+            inline char *writeArg(char *p, const T &v) {
+                constexpr auto tag = tagOf<T>();
+                if constexpr (tag == STR) {
+                    const std::string_view sv(v);
+                    const auto n = (uint32_t) sv.size();
+                    std::memcpy(p, &n, 4), std::memcpy(p + 4, sv.data(), n);
+                    return p + 4 + n;
+                } else {
+                    uint64_t u;
+                    if constexpr (tag == F64) {
+                        const double d = (double) v;
+                        std::memcpy(&u, &d, 8);
+                    } else if constexpr (tag == I64)u = (uint64_t) (int64_t) v;
+                    else u = (uint64_t) v;
+                    std::memcpy(p, &u, 8);
+                    return p + 8;
+                }
+            }
+
+            /**将参数以文本形式追加到记录中, 不分配内存*/
+            template<class T>
+            inline void textArg(Recorder::Text &t, const T &v) {
+                constexpr auto tag = tagOf<T>();
+                if constexpr (tag == STR)t.add(std::string_view(v));
+                else if constexpr (tag == F64)t.num((double) v);
+                else if constexpr (tag == I64)t.num((int64_t) v);
+                else if constexpr (tag == U64)t.num((uint64_t) v);
+                else if constexpr (tag == BOOL)t.add(v ? "true" : "false");
+                else t.add(std::string_view(&v, 1));
+            }
+
+            /**
+             * @brief 格式化到定长的记录中 (用于飞行记录仪)
+             * @details 规则与format相同
+             */
+            template<class... A>
+            inline void formatInto(Recorder::Text &t, std::string_view fmt, const A &... args) {
+                size_t pos = 0;
+                [[maybe_unused]] const auto one = [&](const auto &v) {
+                    const auto ph = fmt.find("{}", pos);
+                    if (ph == std::string_view::npos)t.add(fmt.substr(pos)).add(" "), pos = fmt.size();
+                    else t.add(fmt.substr(pos, ph - pos)), pos = ph + 2;
+                    textArg(t, v);
+                };
+                (one(args), ...);
+                if (pos < fmt.size())t.add(fmt.substr(pos));
+            }
+
+            /**
+             * @brief 按格式及参数生成文本
+             * @details 按顺序替换{}, 多余的参数以空格分隔追加在末尾; 参数数据不完整时停止解析
+             * @param fmt 格式
+             * @param tags 参数类型
+             * @param args 参数数据
+             * @return 文本
+             */
+            inline std::string format(std::string_view fmt, const std::vector<Tag> &tags, std::string_view args) {
+                std::string out;
+                out.reserve(fmt.size() + args.size());
+                size_t pos = 0;
+                const char *p = args.data(), *const end = args.data() + args.size();
+                for (const auto tag: tags) {
+                    std::string v;
+                    if (tag == STR) {
+                        uint32_t n;
+                        if (end - p < 4)break;
+                        std::memcpy(&n, p, 4), p += 4;
+                        if ((size_t) (end - p) < n)break;
+                        v.assign(p, n), p += n;
+                    } else {
+                        uint64_t u;
+                        if (end - p < 8)break;
+                        std::memcpy(&u, p, 8), p += 8;
+                        char buf[32];
+                        char *e = buf;
+                        switch (tag) {
+                            case I64:e = std::to_chars(buf, buf + sizeof(buf), (int64_t) u).ptr;
+                                break;
+                            case U64:e = std::to_chars(buf, buf + sizeof(buf), u).ptr;
+                                break;
+                            case F64: {
+                                double d;
+                                std::memcpy(&d, &u, 8);
+                                e = std::to_chars(buf, buf + sizeof(buf), d).ptr;
+                                break;
+                            }
+                            case BOOL:e = std::strcpy(buf, u ? "true" : "false") + (u ? 4 : 5);
+                                break;
+                            case CHAR:buf[0] = (char) u, e = buf + 1;
+                                break;
+                            default:break;
+                        }
+                        v.assign(buf, e);
+                    }
+                    const auto ph = fmt.find("{}", pos);
+                    if (ph == std::string_view::npos) {
+                        out.append(fmt.substr(pos)), pos = fmt.size();
+                        out += ' ', out += v;
+                    } else out.append(fmt.substr(pos, ph - pos)), out += v, pos = ph + 2;
+                }
+                if (pos < fmt.size())out.append(fmt.substr(pos));
+                return out;
+            }
+        }
+
+        /**一条日志, 由后台线程解析后交给输出器*/
+        struct Entry {
+            int64_t ts;//时间 (ns, system_clock)
+            bool error;//是否为错误日志
+            int id;//分类ID(小于0不输出)
+            std::string type;//分类
+            std::string sub_type;//子分类(为空不输出)
+            std::string text;//内容, 延迟格式化的日志为空
+            uint32_t site = 0;//延迟格式化的调用点ID, 0表示文本日志
+            std::string args;//延迟格式化的参数数据
+            Level level = LV_INFO;//级别
+
+            /**@return 内容, 延迟格式化的日志在此时格式化*/
+            std::string message() const {
+                if (!site)return text;
+                const auto info = Deferred::site(site);
+                return info ? Deferred::format(info->fmt, info->tags, args) : "<unknown site " + std::to_string(site) + ">";
+            }
+
+            /**@return 格式化后的一行 (不含换行)*/
+            std::string line() const {
+                const auto text = message();
+                std::string str;
+                str.reserve(type.size() + sub_type.size() + text.size() + 16);
+                str += '[', str += type;
+                if (id >= 0)str += ' ', str += std::to_string(id);
+                str += ']';
+                if (!sub_type.empty())str += ' ', str += sub_type, str += ':';
+                str += ' ', str += text;
+                return str;
+            }
+        };
+
+        /**
+         * 输出器: 在后台线程中按时间顺序批量接收日志
+         * @details 同步模式下每条日志调用一次, 在调用log的线程中执行
+         */
+        typedef std::function<void(const std::vector<Entry> &)> sink_t;
+
+        /**
+         * 异步后端
+         * @details 每个线程一个单生产者单消费者的字节环形缓冲区, 记录日志时只复制字节, 不加锁;
+         * @details 后台线程轮询所有缓冲区, 按时间合并后批量交给输出器, 每批只刷新一次终端
+         */
+        namespace Async {
+            static const constexpr size_t ring_size = 1 << 16;//每个线程的缓冲区大小 (字节, 2的幂)
+            static const constexpr int interval_ms = 2;//后台线程空闲时的轮询间隔
+
+            /**记录头, 记录按8字节对齐*/
+            struct Header {
+                uint32_t size;//记录总长度 (含头)
+                uint8_t kind;//0 = 填充 (跳到缓冲区开头), 1 = 文本, 2 = 延迟格式化
+                uint8_t level;
+                uint16_t type_len;
+                int32_t id;
+                uint32_t sub_len;
+                uint32_t text_len;//文本/参数数据长度
+                uint32_t site;//调用点ID
+                int64_t ts;
+            };
+            static_assert(sizeof(Header) % 8 == 0);
+
+            /**一个线程的缓冲区*/
+            struct Ring {
+                alignas(64) std::atomic<uint64_t> head{0};//写入位置, 仅生产者修改
+                alignas(64) std::atomic<uint64_t> tail{0};//读取位置, 仅后台线程修改
+                std::atomic_bool closed{false};//线程已退出
+                std::unique_ptr<char[]> buf = std::make_unique<char[]>(ring_size);
+
+                /**
+                 * @brief 预留一段连续空间
+                 * @param n 长度 (8字节对齐)
+                 * @return 写入位置, 空间不足时为空
+                 */
+                char *reserve(uint32_t n) {
+                    const auto h = head.load(std::memory_order_relaxed);
+                    const auto t = tail.load(std::memory_order_acquire);
+                    const auto off = h & (ring_size - 1);
+                    const auto pad = off + n > ring_size ? ring_size - off : 0;//记录不跨越缓冲区末尾
+                    if (ring_size - (h - t) < pad + n)return nullptr;
+                    if (pad) {
+                        auto &hd = *(Header *) (buf.get() + off);
+                        hd.size = (uint32_t) pad, hd.kind = 0;
+                        head.store(h + pad, std::memory_order_release);
+                        return buf.get();
+                    }
+                    return buf.get() + off;
+                }
+
+                /**提交预留的空间*/
+                void commit(uint32_t n) {
+                    head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release);
+                }
+            };
+
+            /**后台状态, 不析构 (进程退出时后台线程可能仍在运行)*/
+            struct State {
+                std::mutex mtx;//访问锁: rings, sinks
+                std::vector<std::shared_ptr<Ring>> rings;
+                std::vector<sink_t> sinks;
+                std::vector<sink_t> taps;//附加输出器, 不替代默认的终端输出
+                std::mutex cv_mtx;
+                std::condition_variable cv;//唤醒后台线程 / 通知刷新完成
+                std::atomic_bool sleeping{false};//后台线程是否在等待
+                std::atomic<uint64_t> flushReq{0}, flushDone{0};//刷新请求/完成的序号
+                std::atomic_bool async{true};//是否异步输出
+                std::atomic_bool started{false};
+                std::once_flag start_flag;
+                std::mutex sync_mtx;//同步输出锁
+            };
+
+            inline State &state() {
+                static State *const s = new State();
+                return *s;
+            }
+
+            /**输出到终端: 连续的同类日志合并写入, 每批刷新一次*/
+            inline void consoleSink(const std::vector<Entry> &entries) {
+                std::string out, err;
+                const auto write = [&]() {
+                    if (!out.empty())std::cout.write(out.data(), (std::streamsize) out.size()), out.clear();
+                    if (!err.empty())std::cerr.write(err.data(), (std::streamsize) err.size()), err.clear();
+                };
+                for (const auto &e: entries) {
+                    if (e.error ? !out.empty() : !err.empty())write();
+                    (e.error ? err : out) += e.line() += '\n';
+                }
+                write();
+                std::cout.flush(), std::cerr.flush();
+            }
+
+            /**将一批日志交给所有输出器*/
+            inline void dispatch(const std::vector<Entry> &entries) {
+                auto &s = state();
+                std::vector<sink_t> sinks, taps;
+                {
+                    std::unique_lock<std::mutex> lock(s.mtx);
+                    sinks = s.sinks, taps = s.taps;
+                }
+                if (sinks.empty())consoleSink(entries);
+                for (const auto &sink: sinks)sink(entries);
+                for (const auto &tap: taps)tap(entries);
+            }
+
+            /**@return 当前时间 (ns)*/
+            inline int64_t now() {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()).count();
+            }
+
+            /**解析一个缓冲区中的所有记录*/
+            inline void drain(Ring &r, std::vector<Entry> &out) {
+                const auto h = r.head.load(std::memory_order_acquire);
+                auto t = r.tail.load(std::memory_order_relaxed);
+                while (t < h) {
+                    const char *p = r.buf.get() + (t & (ring_size - 1));
+                    const auto &hd = *(const Header *) p;
+                    if (hd.kind == 1) {
+                        p += sizeof(Header);
+                        Entry e{hd.ts, hd.level >= LV_ERROR, hd.id};
+                        e.level = (Level) hd.level;
+                        e.type.assign(p, hd.type_len), p += hd.type_len;
+                        e.sub_type.assign(p, hd.sub_len), p += hd.sub_len;
+                        e.text.assign(p, hd.text_len);
+                        out.push_back(std::move(e));
+                    } else if (hd.kind == 2) {
+                        Entry e{hd.ts, hd.level >= LV_ERROR, hd.id};
+                        e.level = (Level) hd.level;
+                        if (const auto info = Deferred::site(hd.site))e.type = info->type;
+                        e.site = hd.site;
+                        e.args.assign(p + sizeof(Header), hd.text_len);
+                        out.push_back(std::move(e));
+                    }
+                    t += hd.size;
+                }
+                r.tail.store(t, std::memory_order_release);
+            }
+
+            /**后台线程: 轮询所有缓冲区, 合并后输出*/
+            inline void loop() {
+                auto &s = state();
+                std::vector<Entry> batch;
+                std::vector<std::shared_ptr<Ring>> rings;
+                for (;;) {
+                    const auto req = s.flushReq.load(std::memory_order_acquire);
+                    {
+                        std::unique_lock<std::mutex> lock(s.mtx);
+                        rings = s.rings;
+                        s.rings.erase(std::remove_if(s.rings.begin(), s.rings.end(), [](const auto &r) {
+                            return r->closed.load(std::memory_order_acquire) &&
+                                   r->tail.load(std::memory_order_relaxed) == r->head.load(std::memory_order_acquire);
+                        }), s.rings.end());
+                    }
+                    batch.clear();
+                    for (const auto &r: rings)drain(*r, batch);
+                    if (!batch.empty()) {
+                        std::stable_sort(batch.begin(), batch.end(),
+                                         [](const Entry &a, const Entry &b) { return a.ts < b.ts; });
+                        dispatch(batch);
+                    }
+                    if (s.flushDone.load(std::memory_order_relaxed) != req) {
+                        std::unique_lock<std::mutex> lock(s.cv_mtx);
+                        s.flushDone.store(req, std::memory_order_release);
+                        s.cv.notify_all();
+                    }
+                    if (!batch.empty())continue;
+                    std::unique_lock<std::mutex> lock(s.cv_mtx);
+                    s.sleeping.store(true);
+                    if (s.flushReq.load() == req)
+                        s.cv.wait_for(lock, std::chrono::milliseconds(interval_ms));
+                    s.sleeping.store(false);
+                }
+            }
+
+            /**
+             * @brief 等待已记录的日志全部输出
+             * @param timeout_ms 最长等待时间
+             */
+            inline void flush(int timeout_ms = 1000) {
+                auto &s = state();
+                if (!s.started.load(std::memory_order_acquire))return;
+                std::unique_lock<std::mutex> lock(s.cv_mtx);
+                const auto req = s.flushReq.fetch_add(1) + 1;
+                s.cv.notify_all();
+                s.cv.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                              [&s, req]() { return s.flushDone.load(std::memory_order_acquire) >= req; });
+            }
+
+            /**启动后台线程, 并在进程退出时输出剩余日志*/
+            inline void start() {
+                auto &s = state();
+                std::call_once(s.start_flag, [&s]() {
+                    std::thread(loop).detach();
+                    std::atexit([]() { flush(); });
+                    s.started.store(true, std::memory_order_release);
+                });
+            }
+
+            /**线程局部的缓冲区持有者, 线程退出时关闭缓冲区*/
+            struct Holder {
+                std::shared_ptr<Ring> ring;
+
+                ~Holder() { if (ring)ring->closed.store(true, std::memory_order_release); }
+            };
+
+            /**@return 当前线程的缓冲区*/
+            inline Ring &local() {
+                thread_local Holder holder;
+                if (holder.ring) [[likely]] return *holder.ring;
+                start();
+                holder.ring = std::make_shared<Ring>();
+                auto &s = state();
+                std::unique_lock<std::mutex> lock(s.mtx);
+                s.rings.push_back(holder.ring);
+                return *holder.ring;
+            }
+
+            /**预留空间, 缓冲区已满时等待后台线程取出*/
+            inline char *acquire(Ring &r, uint32_t n) {
+                char *p;
+                while (!(p = r.reserve(n))) {
+                    state().cv.notify_one();
+                    std::this_thread::yield();
+                }
+                return p;
+            }
+
+            /**提交记录, 缓冲区将满时立即唤醒后台线程, 否则等待下次轮询*/
+            inline void release(Ring &r, uint32_t n) {
+                r.commit(n);
+                auto &s = state();
+                if (s.sleeping.load(std::memory_order_relaxed) &&
+                    ring_size - (r.head.load(std::memory_order_relaxed) - r.tail.load(std::memory_order_relaxed)) <
+                    ring_size / 4)
+                    s.cv.notify_one();
+            }
+
+            /**@return 日志行的前缀: [type id] sub_type: */
+            inline Recorder::Text &linePrefix(Recorder::Text &t, std::string_view type, int id,
+                                              std::string_view sub_type) {
+                t.add("[").add(type);
+                if (id >= 0)t.add(" ").num(id);
+                t.add("] ");
+                if (!sub_type.empty())t.add(sub_type).add(": ");
+                return t;
+            }
+
+            /**
+             * @brief 记录一条文本日志
+             * @details 缓冲区已满时等待后台线程取出; 过长的内容被截断
+             */
+            inline void push(Level level, const std::string_view &type, int id, const std::string_view &sub_type,
+                             std::string_view text) {
+                if (Recorder::enabled()) [[unlikely]] {
+                    Recorder::Text t;
+                    Recorder::record(Recorder::LOG, level, {linePrefix(t, type, id, sub_type), text});
+                }
+                auto &s = state();
+                const auto ts = now();
+                if (!s.async.load(std::memory_order_relaxed)) {
+                    std::vector<Entry> one{{ts, level >= LV_ERROR, id, std::string(type), std::string(sub_type),
+                                                   std::string(text)}};
+                    one[0].level = level;
+                    std::unique_lock<std::mutex> lock(s.sync_mtx);
+                    dispatch(one);
+                    return;
+                }
+                const size_t max = ring_size / 2 - sizeof(Header) - type.size() - sub_type.size();
+                if (text.size() > max)text = text.substr(0, max);
+                const auto n = (uint32_t) ((sizeof(Header) + type.size() + sub_type.size() + text.size() + 7) & ~7ULL);
+                auto &r = local();
+                char *p = acquire(r, n);
+                auto &hd = *(Header *) p;
+                hd = {n, 1, (uint8_t) level, (uint16_t) type.size(), id, (uint32_t) sub_type.size(),
+                      (uint32_t) text.size(), 0, ts};
+                p += sizeof(Header);
+                std::memcpy(p, type.data(), type.size()), p += type.size();
+                std::memcpy(p, sub_type.data(), sub_type.size()), p += sub_type.size();
+                std::memcpy(p, text.data(), text.size());
+                release(r, n);
+            }
+
+            /**
+             * @brief 记录一条延迟格式化的日志
+             * @details 只复制调用点ID及参数的原始值; 同步模式下立即格式化输出
+             */
+            template<class... A>
+            inline void pushDeferred(Deferred::Site &site, int id, const A &... args) {
+                if (!site.enabled())return;
+                auto sid = site.id.load(std::memory_order_acquire);
+                if (!sid) [[unlikely]] sid = Deferred::registerSite(site, {Deferred::tagOf<A>()...});
+                if (Recorder::enabled()) [[unlikely]] {
+                    Recorder::Text t;
+                    Deferred::formatInto(linePrefix(t, site.type, id, {}), site.fmt, args...);
+                    Recorder::record(Recorder::LOG, site.level, {t});
+                }
+                const size_t len = (0 + ... + Deferred::argSize(args));
+                const auto n = (uint32_t) ((sizeof(Header) + len + 7) & ~7ULL);
+                auto &s = state();
+                if (!s.async.load(std::memory_order_relaxed) || n > ring_size / 2) [[unlikely]] {
+                    std::string data(len, 0);
+                    if constexpr (sizeof...(A) > 0) {
+                        char *p = data.data();
+                        ((p = Deferred::writeArg(p, args)), ...);
+                    }
+                    std::vector<Entry> one{{now(), site.level >= LV_ERROR, id, site.type}};
+                    one[0].site = sid, one[0].args = std::move(data), one[0].level = site.level;
+                    std::unique_lock<std::mutex> lock(s.sync_mtx);
+                    dispatch(one);
+                    return;
+                }
+                auto &r = local();
+                char *p = acquire(r, n);
+                auto &hd = *(Header *) p;
+                hd = {n, 2, (uint8_t) site.level, 0, id, 0, (uint32_t) len, sid, now()};
+                p += sizeof(Header);
+                ((p = Deferred::writeArg(p, args)), ...);
+                release(r, n);
+            }
+
+            /**@return data的文本形式, 使用线程局部的流, 避免重复分配*/
+            template<typename T>
+            inline std::string_view format(const T &data) {
+                if constexpr (std::is_convertible_v<const T &, std::string_view>) {
+                    return std::string_view(data);
+                } else {
+                    thread_local std::ostringstream os;
+                    thread_local std::string str;
+                    os.str(""), os.clear();
+                    os << data;
+                    str = os.str();
+                    return str;
+                }
+            }
+        }
+
+        /**
+         * @brief 添加一个输出器
+         * @details 添加任意输出器后不再默认输出到终端, 需要时可同时添加consoleSink
+         */
+        inline void addSink(sink_t sink) {
+            auto &s = Async::state();
+            std::unique_lock<std::mutex> lock(s.mtx);
+            s.sinks.push_back(std::move(sink));
+        }
+
+        /**
+         * @brief 添加一个附加输出器
+         * @details 与输出器一样在后台线程中批量接收日志, 但不影响默认的终端输出; 用于转发日志(如websocket)
+         */
+        inline void addTap(sink_t tap) {
+            auto &s = Async::state();
+            std::unique_lock<std::mutex> lock(s.mtx);
+            s.taps.push_back(std::move(tap));
+        }
+
+        /**移除所有输出器, 恢复默认的终端输出*/
+        inline void clearSinks() {
+            Async::flush();
+            auto &s = Async::state();
+            std::unique_lock<std::mutex> lock(s.mtx);
+            s.sinks.clear();
+        }
+
+        /**
+         * @brief 设置是否异步输出 (默认异步)
+         * @details 同步模式下在调用线程中直接输出, 用于调试
+         */
+        inline void setAsync(bool async) {
+            Async::flush();
+            Async::state().async = async;
+        }
+
+        /**等待已记录的日志全部输出*/
+        inline void flush() { Async::flush(); }
+
+///延迟格式化日志: 级别, 分类(字符串字面量), 格式(字符串字面量, {}为占位符), 参数(数字/bool/char/字符串)...
+#define IFR_LOGF_AT(level, type, fmt, ...) do { \
+            if constexpr ((level) >= IFR_LOG_LEVEL) { \
+                static ifr::logger::Deferred::Site _ifr_logf_site{type, fmt, __FILE__, __LINE__, level}; \
+                ifr::logger::Async::pushDeferred(_ifr_logf_site, -1 __VA_OPT__(,) __VA_ARGS__); \
+            } \
+        } while (0)
+#define IFR_LOGF_TRACE(type, fmt, ...) IFR_LOGF_AT(ifr::logger::LV_TRACE, type, fmt __VA_OPT__(,) __VA_ARGS__)
+#define IFR_LOGF_DEBUG(type, fmt, ...) IFR_LOGF_AT(ifr::logger::LV_DEBUG, type, fmt __VA_OPT__(,) __VA_ARGS__)
+#define IFR_LOGF(type, fmt, ...) IFR_LOGF_AT(ifr::logger::LV_INFO, type, fmt __VA_OPT__(,) __VA_ARGS__)
+#define IFR_WARNF(type, fmt, ...) IFR_LOGF_AT(ifr::logger::LV_WARN, type, fmt __VA_OPT__(,) __VA_ARGS__)
+#define IFR_ERRF(type, fmt, ...) IFR_LOGF_AT(ifr::logger::LV_ERROR, type, fmt __VA_OPT__(,) __VA_ARGS__)
+
+///文本日志: 级别, 分类, [ID], [子分类], 内容; 参数与log相同. 未输出时不计算其余参数
+#define IFR_LOG_AT(level, type, ...) do { \
+            if constexpr ((level) >= IFR_LOG_LEVEL) \
+                if (ifr::logger::enabled(type, level)) ifr::logger::logAt(level, type, __VA_ARGS__); \
+        } while (0)
+#define IFR_LOG_TRACE(...) IFR_LOG_AT(ifr::logger::LV_TRACE, __VA_ARGS__)
+#define IFR_LOG_DEBUG(...) IFR_LOG_AT(ifr::logger::LV_DEBUG, __VA_ARGS__)
+#define IFR_LOG_INFO(...) IFR_LOG_AT(ifr::logger::LV_INFO, __VA_ARGS__)
+#define IFR_LOG_WARN(...) IFR_LOG_AT(ifr::logger::LV_WARN, __VA_ARGS__)
+#define IFR_LOG_ERROR(...) IFR_LOG_AT(ifr::logger::LV_ERROR, __VA_ARGS__)
+
+///限流的延迟格式化日志: 级别, 每秒最多输出次数, 分类, 格式, 参数...; 恢复输出时报告被抑制的次数
+#define IFR_LOGF_LIMIT(level, per_sec, type, fmt, ...) do { \
+            if constexpr ((level) >= IFR_LOG_LEVEL) { \
+                static ifr::logger::Deferred::Site _ifr_logf_site{type, fmt, __FILE__, __LINE__, level}; \
+                static ifr::logger::Limit::Rate _ifr_log_rate{per_sec}; \
+                ifr::logger::Limit::deferredRate(_ifr_log_rate, _ifr_logf_site __VA_OPT__(,) __VA_ARGS__); \
+            } \
+        } while (0)
+///重复抑制的延迟格式化日志: 级别, 分类, 格式, 参数...; 参数与上一次相同时不输出
+#define IFR_LOGF_DEDUP(level, type, fmt, ...) do { \
+            if constexpr ((level) >= IFR_LOG_LEVEL) { \
+                static ifr::logger::Deferred::Site _ifr_logf_site{type, fmt, __FILE__, __LINE__, level}; \
+                static ifr::logger::Limit::Dedup _ifr_log_dedup; \
+                ifr::logger::Limit::deferredDedup(_ifr_log_dedup, _ifr_logf_site __VA_OPT__(,) __VA_ARGS__); \
+            } \
+        } while (0)
+///限流的文本日志: 级别, 每秒最多输出次数, 分类, [ID], [子分类], 内容
+#define IFR_LOG_LIMIT(level, per_sec, ...) do { \
+            if constexpr ((level) >= IFR_LOG_LEVEL) { \
+                static ifr::logger::Limit::Rate _ifr_log_rate{per_sec}; \
+                ifr::logger::Limit::textRate(_ifr_log_rate, level, __VA_ARGS__); \
+            } \
+        } while (0)
+///重复抑制的文本日志: 级别, 分类, [ID], [子分类], 内容
+#define IFR_LOG_DEDUP(level, ...) do { \
+            if constexpr ((level) >= IFR_LOG_LEVEL) { \
+                static ifr::logger::Limit::Dedup _ifr_log_dedup; \
+                ifr::logger::Limit::textDedup(_ifr_log_dedup, level, __VA_ARGS__); \
+            } \
+        } while (0)
+///调用点限流: 表达式, 每秒最多为true的次数, 可用于sendWs等非日志的输出
+#define IFR_RATE_LIMIT(per_sec) ([]() -> ifr::logger::Limit::Rate & { \
+            static ifr::logger::Limit::Rate _ifr_rate{per_sec}; \
+            return _ifr_rate; \
+        }().allow())
+
+        /**
+         * 二进制日志文件
+         * @details 格式: 8字节魔数, 之后为若干块, 每块以1字节类型开头 (小端序, str16为u16长度加字节):
+         * @details 'S' 调用点: u32 ID, u8 级别, u32 行号, u8 参数数量, 参数类型..., str16 分类, str16 格式, str16 文件
+         * @details 'R' 延迟格式化日志: i64 时间, u32 调用点ID, i32 分类ID, u32 参数长度, 参数数据
+         * @details 'T' 文本日志: i64 时间, u8 级别, i32 分类ID, str16 分类, str16 子分类, u32 长度, 内容
+         * @details 类型为0时表示数据结束 (预分配文件中未写入的部分)
+         * @details 调用点在文件中第一次被引用前写入, 因此每个文件都可以独立解码
+         */
+        namespace Binary {
+            static const constexpr char magic[8] = {'I', 'F', 'R', 'L', 'O', 'G', '2', '\n'};
+
+            template<class T>
+            inline void put(std::string &out, const T &v) { out.append((const char *) &v, sizeof(T)); }
+
+            inline void putStr16(std::string &out, std::string_view s) {
+                s = s.substr(0, 0xffff);
+                put(out, (uint16_t) s.size()), out.append(s);
+            }
+
+            /**
+             * @brief 编码一条日志
+             * @param e 日志
+             * @param out 输出
+             * @param written 已写入的调用点 (下标为ID)
+             */
+            inline void encode(const Entry &e, std::string &out, std::vector<bool> &written) {
+                if (e.site) {
+                    if (written.size() <= e.site)written.resize(e.site + 1);
+                    if (!written[e.site]) {
+                        written[e.site] = true;
+                        if (const auto info = Deferred::site(e.site)) {
+                            out += 'S';
+                            put(out, info->id), put(out, (uint8_t) info->level), put(out, (uint32_t) info->line);
+                            put(out, (uint8_t) info->tags.size());
+                            for (const auto t: info->tags)put(out, (uint8_t) t);
+                            putStr16(out, info->type), putStr16(out, info->fmt), putStr16(out, info->file);
+                        }
+                    }
+                    out += 'R';
+                    put(out, e.ts), put(out, e.site), put(out, (int32_t) e.id), put(out, (uint32_t) e.args.size());
+                    out.append(e.args);
+                } else {
+                    out += 'T';
+                    put(out, e.ts), put(out, (uint8_t) e.level), put(out, (int32_t) e.id);
+                    putStr16(out, e.type), putStr16(out, e.sub_type);
+                    put(out, (uint32_t) e.text.size()), out.append(e.text);
+                }
+            }
+
+            /**
+             * @brief 创建二进制文件输出器 (覆盖已有文件)
+             * @details 只复制参数数据, 不格式化延迟格式化的日志
+             * @param path 文件路径
+             * @return 输出器, 文件无法打开时为空
+             */
+            inline sink_t fileSink(const std::string &path) {
+                struct File {
+                    std::ofstream out;
+                    std::vector<bool> written;
+                    std::string buf;
+                };
+                auto f = std::make_shared<File>();
+                f->out.open(path, std::ios::binary | std::ios::trunc);
+                if (!f->out.is_open())return nullptr;
+                f->out.write(magic, sizeof(magic));
+                return [f](const std::vector<Entry> &entries) {
+                    f->buf.clear();
+                    for (const auto &e: entries)encode(e, f->buf, f->written);
+                    f->out.write(f->buf.data(), (std::streamsize) f->buf.size());
+                    f->out.flush();
+                };
+            }
+
+            /**
+             * @brief 解码二进制日志
+             * @details 延迟格式化的日志使用文件中的调用点格式化, 输出的Entry均为文本日志
+             * @param data 文件内容
+             * @param fn 回调
+             * @return 是否完整 (数据被截断时返回false, 已解码的部分仍会回调)
+             */
+            inline bool decode(std::string_view data, const std::function<void(const Entry &)> &fn) {
+                if (data.size() < sizeof(magic) || data.substr(0, sizeof(magic)) != std::string_view(magic, 8))
+                    return false;
+                std::unordered_map<uint32_t, Deferred::SiteInfo> sites;
+                const char *p = data.data() + sizeof(magic), *const end = data.data() + data.size();
+                const auto get = [&](auto &v) {
+                    if ((size_t) (end - p) < sizeof(v))return false;
+                    std::memcpy(&v, p, sizeof(v)), p += sizeof(v);
+                    return true;
+                };
+                const auto getStr = [&](std::string &s, auto len) {
+                    if (!get(len) || (size_t) (end - p) < len)return false;
+                    s.assign(p, len), p += len;
+                    return true;
+                };
+                while (p < end) {
+                    const char kind = *p++;
+                    if (kind == 0)break;
+                    if (kind == 'S') {
+                        Deferred::SiteInfo info;
+                        uint8_t level, n;
+                        uint32_t line;
+                        if (!get(info.id) || !get(level) || !get(line) || !get(n))return false;
+                        info.level = (Level) level, info.line = (int) line;
+                        for (uint8_t i = 0; i < n; i++) {
+                            uint8_t t;
+                            if (!get(t))return false;
+                            info.tags.push_back((Deferred::Tag) t);
+                        }
+                        if (!getStr(info.type, (uint16_t) 0) || !getStr(info.fmt, (uint16_t) 0) ||
+                            !getStr(info.file, (uint16_t) 0))
+                            return false;
+                        sites[info.id] = std::move(info);
+                    } else if (kind == 'R') {
+                        Entry e{};
+                        uint32_t site;
+                        int32_t id;
+                        std::string args;
+                        if (!get(e.ts) || !get(site) || !get(id) || !getStr(args, (uint32_t) 0))return false;
+                        e.id = id;
+                        const auto itr = sites.find(site);
+                        if (itr != sites.end()) {
+                            e.level = itr->second.level, e.error = e.level >= LV_ERROR, e.type = itr->second.type;
+                            e.text = Deferred::format(itr->second.fmt, itr->second.tags, args);
+                        } else e.text = "<unknown site " + std::to_string(site) + ">";
+                        fn(e);
+                    } else if (kind == 'T') {
+                        Entry e{};
+                        uint8_t level;
+                        int32_t id;
+                        if (!get(e.ts) || !get(level) || !get(id) || !getStr(e.type, (uint16_t) 0) ||
+                            !getStr(e.sub_type, (uint16_t) 0) || !getStr(e.text, (uint32_t) 0))
+                            return false;
+                        e.level = (Level) level, e.error = e.level >= LV_ERROR, e.id = id;
+                        fn(e);
+                    } else return false;
+                }
+                return true;
+            }
+        }
+
+
+        /**
+         * @brief 以指定级别打印一行日志
+         * @details 低于分类当前级别时直接返回, 不格式化内容
+         * @param level 级别
+         * @param type log分类
+         * @param id 分类ID(小于0不输出)
+         * @param sub_type log子分类(为空不输出)
+         * @param data log内容
+         */
+        template<typename T>
+        inline void logAt(Level level, const std::string &type, int id, const std::string &sub_type, const T &data) {
+            if (!enabled(type, level))return;
+            Async::push(level, type, id, sub_type, Async::format(data));
+        }
+
+        /**@brief 以指定级别打印一行日志*/
+        template<typename T>
+        inline void logAt(Level level, const std::string &type, const std::string &sub_type, const T &data) {
+            logAt(level, type, -1, sub_type, data);
+        }
+
+        /**@brief 以指定级别打印一行日志*/
+        template<typename T>
+        inline void logAt(Level level, const std::string &type, int id, const T &data) {
+            logAt(level, type, id, "", data);
+        }
+
+        /**@brief 以指定级别打印一行日志*/
+        template<typename T>
+        inline void logAt(Level level, const std::string &type, const T &data) { logAt(level, type, -1, "", data); }
 
         /**
          * @brief 打印一行日志
@@ -33,11 +998,7 @@ namespace ifr {
          */
         template<typename T>
         inline void log(const std::string &type, const std::string &sub_type, const T &data) {
-            std::unique_lock<std::mutex> lock(log_mtx);
-            std::cout << '[' << type;
-            std::cout << ']';
-            if (!sub_type.empty())std::cout << ' ' << sub_type << ':';
-            std::cout << ' ' << data << std::endl;
+            logAt(LV_INFO, type, -1, sub_type, data);
         }
 
         /**
@@ -68,12 +1029,7 @@ namespace ifr {
          */
         template<typename T>
         inline void log(const std::string &type, int id, const std::string &sub_type, const T &data) {
-            std::unique_lock<std::mutex> lock(log_mtx);
-            std::cout << '[' << type;
-            if (id >= 0)std::cout << ' ' << id;
-            std::cout << ']';
-            if (!sub_type.empty())std::cout << ' ' << sub_type << ':';
-            std::cout << ' ' << data << std::endl;
+            logAt(LV_INFO, type, id, sub_type, data);
         }
 
         /**
@@ -105,11 +1061,7 @@ namespace ifr {
          */
         template<typename T>
         inline void err(const std::string &type, const std::string &sub_type, const T &data) {
-            std::unique_lock<std::mutex> lock(log_mtx);
-            std::cerr << '[' << type;
-            std::cerr << ']';
-            if (!sub_type.empty())std::cerr << ' ' << sub_type << ':';
-            std::cerr << ' ' << data << std::endl;
+            logAt(LV_ERROR, type, -1, sub_type, data);
         }
 
         /**
@@ -140,12 +1092,7 @@ namespace ifr {
          */
         template<typename T>
         inline void err(const std::string &type, int id, const std::string &sub_type, const T &data) {
-            std::unique_lock<std::mutex> lock(log_mtx);
-            std::cerr << '[' << type;
-            if (id >= 0)std::cerr << ' ' << id;
-            std::cerr << ']';
-            if (!sub_type.empty())std::cerr << ' ' << sub_type << ':';
-            std::cerr << ' ' << data << std::endl;
+            logAt(LV_ERROR, type, id, sub_type, data);
         }
 
         /**
@@ -193,9 +1140,161 @@ namespace ifr {
         inline void
         log_loc(const std::string &file, const int &line, const std::string &func, const std::string &expr,
                 const T &data) {
-            std::unique_lock<std::mutex> lock(log_mtx);
-            std::cout << '[' << file << ':' << line << ':' << func << "] "
-                      << expr << " -> " << data << std::endl;
+            const std::string type = file + ':' + std::to_string(line) + ':' + func;
+            if (!enabled(type, LV_INFO))return;
+            logAt(LV_INFO, type, -1, "", expr + " -> " + std::string(Async::format(data)));
+        }
+
+        /**
+         * 限流及重复抑制
+         * @details 每个调用点一个静态状态, 只使用原子变量, 多个线程同时使用时计数可能有少量误差
+         */
+        namespace Limit {
+            /**@return 当前时间 (ns, steady_clock)*/
+            inline int64_t clock() {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+            /**限流: 每秒(按整秒划分窗口)最多输出per_sec次*/
+            struct Rate {
+                const uint32_t per_sec;
+                std::atomic<int64_t> window{-1};//当前窗口 (s)
+                std::atomic<uint32_t> count{0};//当前窗口内的次数
+                std::atomic<uint32_t> suppressed{0};//上次输出后被抑制的次数
+
+                /**
+                 * @param skipped 输出: 上次输出后被抑制的次数
+                 * @return 是否允许输出
+                 */
+                inline bool allow(uint32_t &skipped) {
+                    const int64_t w = clock() / 1000000000;
+                    auto cur = window.load(std::memory_order_relaxed);
+                    if (cur != w && window.compare_exchange_strong(cur, w, std::memory_order_relaxed)) {
+                        count.store(1, std::memory_order_relaxed);
+                        skipped = suppressed.exchange(0, std::memory_order_relaxed);
+                        return true;
+                    }
+                    if (count.fetch_add(1, std::memory_order_relaxed) < per_sec)return skipped = 0, true;
+                    suppressed.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+
+                /**@return 是否允许输出*/
+                inline bool allow() {
+                    uint32_t skipped;
+                    return allow(skipped);
+                }
+            };
+
+            /**重复抑制: 与上一条内容相同时不输出, 内容变化时报告重复次数; 持续重复时每秒报告一次*/
+            struct Dedup {
+                static const constexpr int64_t report_ns = 1000000000;
+                std::atomic<uint64_t> last{0};//上一条内容的hash
+                std::atomic<uint32_t> repeats{0};//未报告的重复次数
+                std::atomic<int64_t> since{0};//上次输出或报告的时间 (ns)
+
+                /**
+                 * @param hash 内容的hash
+                 * @param repeated 输出: 需要报告的重复次数, 0为不报告
+                 * @return 是否输出内容
+                 */
+                inline bool admit(uint64_t hash, uint32_t &repeated) {
+                    const auto now = clock();
+                    if (last.exchange(hash, std::memory_order_relaxed) != hash) {
+                        repeated = repeats.exchange(0, std::memory_order_relaxed);
+                        since.store(now, std::memory_order_relaxed);
+                        return true;
+                    }
+                    repeats.fetch_add(1, std::memory_order_relaxed);
+                    auto s = since.load(std::memory_order_relaxed);
+                    repeated = now - s >= report_ns && since.compare_exchange_strong(s, now)
+                               ? repeats.exchange(0, std::memory_order_relaxed) : 0;
+                    return false;
+                }
+            };
+
+            /**FNV-1a*/
+            inline uint64_t mix(uint64_t h, const void *data, size_t n) {
+                for (size_t i = 0; i < n; i++)h = (h ^ ((const uint8_t *) data)[i]) * 0x100000001b3ULL;
+                return h;
+            }
+
+            /**@return 延迟格式化参数的hash, 与编码后的内容一致*/
+            template<class... A>
+            inline uint64_t hashArgs(const A &... args) {
+                uint64_t h = 0xcbf29ce484222325ULL;
+                const auto one = [&h](const auto &v) {
+                    using T = std::decay_t<decltype(v)>;
+                    if constexpr (Deferred::tagOf<T>() == Deferred::STR) {
+                        const std::string_view sv(v);
+                        const auto n = (uint32_t) sv.size();
+                        h = mix(mix(h, &n, 4), sv.data(), n);
+                    } else h = mix(h, &v, sizeof(v));
+                };
+                (one(args), ...);
+                return h ? h : 1;
+            }
+
+            /**@return 文本日志参数的hash*/
+            template<class... A>
+            inline uint64_t hashText(const A &... args) {
+                uint64_t h = 0xcbf29ce484222325ULL;
+                const auto one = [&h](const auto &v) {
+                    const auto sv = Async::format(v);
+                    h = mix(mix(h, sv.data(), sv.size()), "", 1);
+                };
+                (one(args), ...);
+                return h ? h : 1;
+            }
+
+            inline void reportSuppressed(Level level, std::string_view type, uint32_t n) {
+                Async::push(level, type, -1, "", std::to_string(n) + " similar messages suppressed");
+            }
+
+            inline void reportRepeated(Level level, std::string_view type, uint32_t n) {
+                Async::push(level, type, -1, "", "last message repeated " + std::to_string(n) + " times");
+            }
+
+            /**限流的延迟格式化日志*/
+            template<class... A>
+            inline void deferredRate(Rate &rate, Deferred::Site &site, const A &... args) {
+                if (!site.enabled())return;
+                uint32_t skipped;
+                if (!rate.allow(skipped))return;
+                if (skipped)reportSuppressed(site.level, site.type, skipped);
+                Async::pushDeferred(site, -1, args...);
+            }
+
+            /**重复抑制的延迟格式化日志*/
+            template<class... A>
+            inline void deferredDedup(Dedup &dedup, Deferred::Site &site, const A &... args) {
+                if (!site.enabled())return;
+                uint32_t repeated;
+                const bool emit = dedup.admit(hashArgs(args...), repeated);
+                if (repeated)reportRepeated(site.level, site.type, repeated);
+                if (emit)Async::pushDeferred(site, -1, args...);
+            }
+
+            /**限流的文本日志, 参数与logAt相同*/
+            template<class... A>
+            inline void textRate(Rate &rate, Level level, const std::string &type, const A &... args) {
+                if (!enabled(type, level))return;
+                uint32_t skipped;
+                if (!rate.allow(skipped))return;
+                if (skipped)reportSuppressed(level, type, skipped);
+                logAt(level, type, args...);
+            }
+
+            /**重复抑制的文本日志, 参数与logAt相同*/
+            template<class... A>
+            inline void textDedup(Dedup &dedup, Level level, const std::string &type, const A &... args) {
+                if (!enabled(type, level))return;
+                uint32_t repeated;
+                const bool emit = dedup.admit(hashText(args...), repeated);
+                if (repeated)reportRepeated(level, type, repeated);
+                if (emit)logAt(level, type, args...);
+            }
         }
 
     }
@@ -0,0 +1,204 @@
+#ifndef COMMON_MODULES_LOGGER_ROTATING_HPP
+#define COMMON_MODULES_LOGGER_ROTATING_HPP
+
+#include "logger.hpp"
+#include <filesystem>
+#include <ctime>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace ifr {
+    namespace logger {
+        /**
+         * 滚动日志文件
+         * @details 日志以二进制格式(见Binary)写入目录中的若干分段文件, 每个分段是一个独立可解码的文件
+         * @details 分段创建时预分配空间并映射到内存, 写入只是内存复制; 进程崩溃时已写入的内容由内核保留
+         * @details 崩溃时仍在各线程缓冲区(Async)中、尚未被后台线程取出的日志不会写入; 需要时使用Recorder保留崩溃前的日志
+         * @details 每块先写入内容, 最后写入类型字节, 崩溃时写了一半的块在解码时被视为数据结束
+         */
+        namespace Rotating {
+            /**配置*/
+            struct Options {
+                std::string dir;//目录
+                std::string prefix = "log";//文件名前缀: <prefix>-<日期>-<时间>-<6位序号>.ifrlog
+                size_t segment_size = 8 << 20;//分段大小 (字节)
+                int64_t segment_seconds = 0;//分段最长时长 (s), 0为不按时间滚动
+                size_t max_segments = 16;//目录中保留的分段数量 (含正在写入的), 0为不限制
+            };
+
+            static const constexpr char *const suffix = ".ifrlog";
+
+            /**
+             * @brief 列出目录中的分段文件
+             * @param dir 目录
+             * @param prefix 文件名前缀, 为空时列出所有分段
+             * @return 按文件名(即创建时间)排序的路径
+             */
+            inline std::vector<std::filesystem::path> list(const std::string &dir, const std::string &prefix = "") {
+                std::vector<std::filesystem::path> files;
+                std::error_code ec;
+                for (const auto &e: std::filesystem::directory_iterator(dir, ec)) {
+                    const auto name = e.path().filename().string();
+                    if (!e.is_regular_file(ec) || !name.ends_with(suffix))continue;
+                    if (!prefix.empty() && !name.starts_with(prefix + '-'))continue;
+                    files.push_back(e.path());
+                }
+                std::sort(files.begin(), files.end(), [](const auto &a, const auto &b) {
+                    return a.filename() < b.filename();
+                });
+                return files;
+            }
+
+            /**分段写入器, 仅在输出线程中使用*/
+            class Writer {
+                const Options opt;
+                int fd = -1;
+                char *map = nullptr;
+                size_t pos = 0;//已写入的长度
+                int64_t opened = 0;//当前分段的创建时间 (ns)
+                uint32_t seq = 0;//分段序号
+                std::vector<bool> written;//当前分段已写入的调用点
+                std::string buf;
+
+                /**结束当前分段: 解除映射并截断到已写入的长度*/
+                void close() {
+                    if (map)munmap(map, opt.segment_size), map = nullptr;
+                    if (fd >= 0) {
+                        if (ftruncate(fd, (off_t) pos) != 0) {}//失败时保留预分配的大小, 解码时忽略0填充
+                        ::close(fd), fd = -1;
+                    }
+                }
+
+                /**删除超出数量的旧分段*/
+                void prune() {
+                    if (!opt.max_segments)return;
+                    auto files = list(opt.dir, opt.prefix);
+                    std::error_code ec;
+                    for (size_t i = 0; i + opt.max_segments < files.size(); i++)std::filesystem::remove(files[i], ec);
+                }
+
+                /**
+                 * @brief 创建新的分段
+                 * @return 是否成功 (目录不可写或磁盘空间不足时失败)
+                 */
+                bool open(int64_t ts) {
+                    close();
+                    const time_t sec = (time_t) (ts / 1000000000);
+                    tm t{};
+                    localtime_r(&sec, &t);
+                    char date[24], name[40];
+                    std::strftime(date, sizeof(date), "%Y%m%d-%H%M%S", &t);
+                    std::string file;
+                    do {//同一秒内(包括上次运行)已存在的分段不覆盖, 使用下一个序号
+                        std::snprintf(name, sizeof(name), "%s-%06u", date, seq++ % 1000000);
+                        file = opt.dir + '/' + opt.prefix + '-' + name + suffix;
+                        fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+                    } while (fd < 0 && errno == EEXIST && seq % 1000000);
+                    if (fd < 0)return false;
+                    //预分配磁盘空间: 空间不足时写入映射内存会触发SIGBUS
+                    if (posix_fallocate(fd, 0, (off_t) opt.segment_size) != 0) {
+                        ::close(fd), fd = -1;
+                        unlink(file.c_str());
+                        return false;
+                    }
+                    void *m = mmap(nullptr, opt.segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                    if (m == MAP_FAILED) {
+                        ::close(fd), fd = -1;
+                        unlink(file.c_str());
+                        return false;
+                    }
+                    map = (char *) m;
+                    std::memcpy(map, Binary::magic, sizeof(Binary::magic));
+                    pos = sizeof(Binary::magic), opened = ts, written.clear();
+                    prune();
+                    return true;
+                }
+
+                /**
+                 * @brief 写入一块或多块: 先写入除第一个字节外的内容, 再写入第一个字节(块类型)
+                 * @param data 编码后的数据
+                 */
+                void append(const std::string &data) {
+                    std::memcpy(map + pos + 1, data.data() + 1, data.size() - 1);
+                    std::atomic_signal_fence(std::memory_order_release);
+                    map[pos] = data[0];
+                    pos += data.size();
+                }
+
+            public:
+                size_t dropped = 0;//无法写入的日志数量
+
+                explicit Writer(Options options) : opt(std::move(options)) {
+                    std::error_code ec;
+                    std::filesystem::create_directories(opt.dir, ec);
+                }
+
+                ~Writer() { close(); }
+
+                Writer(const Writer &) = delete;
+
+                Writer &operator=(const Writer &) = delete;
+
+                /**写入一批日志*/
+                void write(const std::vector<Entry> &entries) {
+                    bool failed = false;//每批只尝试创建一次分段
+                    for (const auto &e: entries) {
+                        if (map && opt.segment_seconds > 0 && e.ts - opened >= opt.segment_seconds * 1000000000)
+                            close();
+                        for (int attempt = 0;; attempt++) {
+                            if (!map && (failed || !open(e.ts))) {
+                                failed = true, dropped++;
+                                break;
+                            }
+                            buf.clear();
+                            const bool site = e.site && (written.size() <= e.site || !written[e.site]);
+                            Binary::encode(e, buf, written);
+                            if (pos + buf.size() < opt.segment_size) {//至少保留1字节的0作为结束
+                                append(buf);
+                                break;
+                            }
+                            if (site)written[e.site] = false;
+                            if (attempt) {//单条日志大于分段大小
+                                dropped++;
+                                break;
+                            }
+                            close();
+                        }
+                    }
+                }
+            };
+
+            /**
+             * @brief 创建滚动日志文件输出器
+             * @param options 配置
+             * @return 输出器
+             */
+            inline sink_t fileSink(const Options &options) {
+                auto w = std::make_shared<Writer>(options);
+                return [w](const std::vector<Entry> &entries) { w->write(entries); };
+            }
+
+            /**
+             * @brief 解码目录中的所有分段
+             * @param dir 目录
+             * @param fn 回调
+             * @param prefix 文件名前缀, 为空时解码所有分段
+             * @return 是否全部完整
+             */
+            inline bool decodeDir(const std::string &dir, const std::function<void(const Entry &)> &fn,
+                                  const std::string &prefix = "") {
+                bool ok = true;
+                for (const auto &f: list(dir, prefix)) {
+                    std::ifstream in(f, std::ios::binary);
+                    const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+                    ok &= Binary::decode(data, fn);
+                }
+                return ok;
+            }
+        }
+    }
+}
+#endif //COMMON_MODULES_LOGGER_ROTATING_HPP
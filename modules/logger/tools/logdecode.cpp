@@ -0,0 +1,58 @@
+#include "logger/rotating.hpp"
+#include <ctime>
+#include <cstdio>
+
+/**
+ * 二进制日志解码工具
+ *
+ * 用法: ifr-logdecode [-l LEVEL] <file|dir>...
+ * 目录: 按创建顺序解码其中所有的滚动日志分段
+ * -l: 只输出不低于此级别的日志
+ * 输出: 时间 级别 日志行
+ */
+int main(int argc, char **argv) {
+    ifr::logger::Level min = ifr::logger::LV_TRACE;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "-l" && i + 1 < argc) {
+            if (!ifr::logger::parseLevel(argv[++i], min)) {
+                std::fprintf(stderr, "Unknown level: %s\n", argv[i]);
+                return 1;
+            }
+        } else paths.push_back(arg);
+    }
+    if (paths.empty()) {
+        std::fprintf(stderr, "Usage: %s [-l LEVEL] <file|dir>...\n", argv[0]);
+        return 1;
+    }
+
+    const auto print = [min](const ifr::logger::Entry &e) {
+        if (e.level < min)return;
+        const time_t sec = (time_t) (e.ts / 1000000000);
+        char buf[32];
+        std::strftime(buf, sizeof(buf), "%F %T", std::localtime(&sec));
+        std::printf("%s.%03d %-5s %s\n", buf, (int) (e.ts / 1000000 % 1000), ifr::logger::levelName(e.level),
+                    e.line().c_str());
+    };
+    int ret = 0;
+    for (const auto &path: paths) {
+        std::vector<std::filesystem::path> files;
+        if (std::filesystem::is_directory(path))files = ifr::logger::Rotating::list(path);
+        else files.emplace_back(path);
+        for (const auto &file: files) {
+            std::ifstream in(file, std::ios::binary);
+            if (!in.is_open()) {
+                std::fprintf(stderr, "Can not open file: %s\n", file.c_str());
+                ret = 1;
+                continue;
+            }
+            const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            if (!ifr::logger::Binary::decode(data, print)) {
+                std::fprintf(stderr, "Truncated or bad file: %s\n", file.c_str());
+                ret = 1;
+            }
+        }
+    }
+    return ret;
+}
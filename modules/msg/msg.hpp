@@ -8,9 +8,15 @@
 #include <mutex>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <atomic>
+#include <algorithm>
 #include <queue>
 #include <random>
 #include <condition_variable>
+#include "trace/trace.hpp"
+#include "recorder/recorder.hpp"
 /**
  * 数据通讯模块
  *
@@ -98,6 +104,51 @@ namespace ifr {
         };
 
 
+        /**共享频道访问锁*/
+        inline std::mutex SHARED_MTX;
+        /**所有共享频道*/
+        inline std::unordered_set<std::string> SHARED;
+
+        /**
+         * @brief 设置频道是否共享
+         * @details 共享频道允许订阅者在发布者锁定后加入, 且订阅者销毁时仅退出频道而不破坏频道, 用于在多个计划之间共享数据。
+         * @details 发布者销毁时仍会破坏频道上的所有订阅者。
+         * @param channel 频道名称
+         * @param shared 是否共享
+         */
+        inline void setShared(const std::string &channel, bool shared) {
+            std::unique_lock<std::mutex> lock(SHARED_MTX);
+            if (shared)SHARED.insert(channel);
+            else SHARED.erase(channel);
+        }
+
+        /**
+         * @param channel 频道名称
+         * @return 频道是否共享
+         */
+        inline bool isShared(const std::string &channel) {
+            std::unique_lock<std::mutex> lock(SHARED_MTX);
+            return SHARED.count(channel);
+        }
+
+        /**消息钩子: 参数为频道名称, 在推送/接收消息的线程上调用*/
+        typedef void (*Hook)(const std::string &);
+        /**推送钩子*/
+        inline std::atomic<Hook> HOOK_PUSH{nullptr};
+        /**接收钩子*/
+        inline std::atomic<Hook> HOOK_POP{nullptr};
+
+        /**
+         * @brief 设置消息钩子
+         * @details 钩子在每次成功推送/接收消息后调用, 用于耗时统计及心跳等, 应尽量轻量
+         * @param push 推送钩子 (可为空)
+         * @param pop 接收钩子 (可为空)
+         */
+        inline void setHooks(Hook push, Hook pop) {
+            HOOK_PUSH = push;
+            HOOK_POP = pop;
+        }
+
         template<class T>
         class Publisher {
             friend class Subscriber<T>;
@@ -108,6 +159,7 @@ namespace ifr {
             static std::unordered_map<std::string, std::vector<Subscriber<T> *>> SUBSCRIBERS;//所有的订阅者
 
             std::string name;//频道名称
+            ifr::Recorder::Channel *stat = nullptr;//飞行记录仪中的频道统计
             DistributeType type = same;//消息分发策略
 
             bool locked = false;//锁定, 在锁定之后不可添加新的订阅者
@@ -138,6 +190,13 @@ namespace ifr {
                 PUBLISHERS.erase(name);
             }
 
+            //订阅者数量变化后, 更新分发策略所需的数据
+            void updateDistribute() {
+                if (subs.size() > 1 && (type == rand || type == DistributeType::wait_fst))
+                    rand_u = std::uniform_int_distribution<size_t>(0, subs.size() - 1);
+                if (!subs.empty())nextIndex %= subs.size();
+            }
+
         public:
             Publisher() = default;
 
@@ -190,6 +249,7 @@ namespace ifr {
 
                 this->name = _name;
                 this->type = _type;
+                stat = ifr::Recorder::channel(_name);
             }
 
 
@@ -212,8 +272,7 @@ namespace ifr {
                             MODULE_MSG_PUB_OUTPUT_PREFIX "Channel \"" + name +
                             "\" has no subscribers, but requires at least one.");
                 locked = true;
-                if (subs.size() > 1 && (type == rand || type == DistributeType::wait_fst))
-                    rand_u = std::uniform_int_distribution<size_t>(0, subs.size() - 1);
+                updateDistribute();
             }
 
             /**
@@ -240,6 +299,9 @@ namespace ifr {
                     throw MessageError_BadUse(MODULE_MSG_PUB_OUTPUT_PREFIX "Channel \"" + name + "\" is not locked");
                 }
                 const auto size = subs.size();
+                if (const auto hook = HOOK_PUSH.load(std::memory_order_relaxed))hook(name);
+                ifr::Trace::instant(ifr::Trace::MSG, "push:", name);
+                ifr::Recorder::pushed(stat);
                 if (size < 1 || breaked)return;
                 if (size == 1) {
                     subs[0]->write_obj(obj);
@@ -279,6 +341,7 @@ namespace ifr {
 
         private:
             std::string name;//频道名
+            ifr::Recorder::Channel *stat = nullptr;//飞行记录仪中的频道统计
             bool registered = false;//是否已经注册
             Publisher<T> *pub = nullptr;//所属的发布者
             bool breaked = false;//是否被破坏
@@ -301,6 +364,18 @@ namespace ifr {
 
             void doBreak() {
                 if (breaked)return;
+                if (registered && isShared(name) && leave())return;
+                if (registered) {//pub由发布者在全局锁内设置, 须先加锁再读取
+                    std::unique_lock<std::mutex> lock1(Publisher<T>::MTX);
+                    if (pub == nullptr) {//尚无发布者: 从等待列表中移除, 防止之后的发布者访问已销毁的订阅者
+                        const auto itr = Publisher<T>::SUBSCRIBERS.find(name);
+                        if (itr != Publisher<T>::SUBSCRIBERS.end()) {
+                            itr->second.erase(std::remove(itr->second.begin(), itr->second.end(), this),
+                                              itr->second.end());
+                            if (itr->second.empty())Publisher<T>::SUBSCRIBERS.erase(itr);
+                        }
+                    }
+                }
                 std::unique_lock<std::mutex> lock(mtx);
                 if (breaked)return;
                 breaked = true;
@@ -308,6 +383,31 @@ namespace ifr {
                 if (pub != nullptr) pub->doBreak();
             }
 
+            //退出共享频道 (不破坏频道), 返回是否成功退出
+            bool leave() {
+                if (pub == nullptr) {
+                    std::unique_lock<std::mutex> lock1(Publisher<T>::MTX);
+                    if (pub == nullptr) {
+                        const auto itr = Publisher<T>::SUBSCRIBERS.find(name);
+                        if (itr != Publisher<T>::SUBSCRIBERS.end())
+                            itr->second.erase(std::remove(itr->second.begin(), itr->second.end(), this),
+                                              itr->second.end());
+                        std::unique_lock<std::mutex> lock(mtx);
+                        breaked = true;
+                        cv.notify_all();
+                        return true;
+                    }
+                }
+                std::unique_lock<std::recursive_mutex> lock1(pub->mtx);
+                if (pub->breaked)return false;//发布者正在破坏频道
+                pub->subs.erase(std::remove(pub->subs.begin(), pub->subs.end(), this), pub->subs.end());
+                pub->updateDistribute();
+                std::unique_lock<std::mutex> lock(mtx);
+                breaked = true;
+                cv.notify_all();
+                return true;
+            }
+
         public:
             Subscriber() = default;
 
@@ -351,10 +451,11 @@ namespace ifr {
                 if (Publisher<T>::PUBLISHERS.count(_name)) {
                     const auto _pub = Publisher<T>::PUBLISHERS[_name];
                     std::unique_lock<std::recursive_mutex> lock3(_pub->mtx);
-                    if (_pub->locked)
+                    if (_pub->locked && !isShared(_name))
                         throw MessageError_BadUse(
                                 MODULE_MSG_SUB_OUTPUT_PREFIX "Channel \"" + _name + "\" locked");
                     _pub->subs.push_back(this);
+                    if (_pub->locked)_pub->updateDistribute();//共享频道: 锁定后加入
                     pub = _pub;
                 } else if (Publisher<T>::SUBSCRIBERS.count(_name)) {
                     Publisher<T>::SUBSCRIBERS[_name].push_back(this);
@@ -366,6 +467,7 @@ namespace ifr {
                 }
                 name = _name;
                 maxSize = _maxSize;
+                stat = ifr::Recorder::channel(_name);
             }
 
             /**
@@ -401,6 +503,9 @@ namespace ifr {
                 if (!que.empty()) [[likely]] {
                     auto tmp = std::move(que.front());
                     que.pop();
+                    if (const auto hook = HOOK_POP.load(std::memory_order_relaxed))hook(name);
+                    ifr::Trace::instant(ifr::Trace::MSG, "pop:", name);
+                    ifr::Recorder::popped(stat);
                     return tmp;
                 }
                 throw MessageError_Broke(MODULE_MSG_SUB_OUTPUT_PREFIX "Broke");
@@ -431,6 +536,9 @@ namespace ifr {
                 if (!que.empty()) [[likely]] {
                     auto tmp = std::move(que.front());
                     que.pop();
+                    if (const auto hook = HOOK_POP.load(std::memory_order_relaxed))hook(name);
+                    ifr::Trace::instant(ifr::Trace::MSG, "pop:", name);
+                    ifr::Recorder::popped(stat);
                     return tmp;
                 }
                 throw MessageError_Broke(MODULE_MSG_SUB_OUTPUT_PREFIX "Broke");
@@ -461,6 +569,9 @@ namespace ifr {
                 if (!que.empty()) [[likely]] {
                     auto tmp = std::move(que.front());
                     que.pop();
+                    if (const auto hook = HOOK_POP.load(std::memory_order_relaxed))hook(name);
+                    ifr::Trace::instant(ifr::Trace::MSG, "pop:", name);
+                    ifr::Recorder::popped(stat);
                     return tmp;
                 }
                 throw MessageError_Broke(MODULE_MSG_SUB_OUTPUT_PREFIX "Broke");
@@ -3,8 +3,21 @@
 //
 
 #include "Plans.h"
+#include "trace/trace.hpp"
+#include "recorder/recorder.hpp"
 
 #include <utility>
+#include <sstream>
+#include <chrono>
+
+#if __OS__ == __OS_Linux__
+
+#include <sys/syscall.h>
+#include <execinfo.h>
+#include <csignal>
+#include <unistd.h>
+
+#endif
 
 namespace ifr {
     namespace Plans {
@@ -16,7 +29,9 @@ namespace ifr {
 
 
         /**所有任务的注册数据*/
-        std::map<std::string, const Task> tasks;
+        std::map<std::string, const TypedTask> tasks;
+        /**所有任务的描述信息*/
+        TaskDescriptions descriptions;
 
 
         std::map<std::string, PlanInfo> plans;  //所有计划信息
@@ -52,55 +67,99 @@ namespace ifr {
         }
 
         /**检查plan名称是否合格*/
-        inline bool checkPlanName(std::string str) {
-            return std::all_of(str.begin(), str.end(), [](const auto &x) {
-                return (('a' <= x && x <= 'z') || ('A' <= x && x <= 'Z') || ('0' <= x && x <= '9') || x == '_' ||
-                        x == ' ' || x == '-');
-            });
+        inline bool checkPlanName(const std::string &str) { return PlanInfo::checkName(str); }
+
+        /**计划文件内容的hash (最后一次读取或写入), 用于忽略自身写入引起的文件修改*/
+        std::map<std::string, uint64_t> planHashes;
+        /**计划文件的监视句柄*/
+        std::map<std::string, std::shared_ptr<void>> planWatches;
+
+        inline std::string planFile(const std::string &name) { return "runtime/plans/" + name + ".json"; }
+
+        /**计划文件被外部修改: 重新读取并停止此计划 (与savePlanInfo一致)*/
+        void reloadPlanInfo(const std::string &name, const std::string &content, uint64_t hash) {
+            std::string error;
+            auto info = PlanInfo::read(content, error);
+            if (!info.loaded || info.name != name) {
+                ifr::logger::err("Plan", "Ignore bad plan file", name + ": " + (error.empty() ? "name mismatch" : error));
+                return;
+            }
+            std::unique_lock<std::recursive_mutex> lock(mtx);
+            if (!plans.count(name))return;//已被删除
+            planHashes[name] = hash;
+            plans[name] = std::move(info);
+            ifr::logger::log("Plan", "Reload plan", name);
+            outMsg(LOG, "Plan", "reload", name);
+            stopPlan(name);
+        }
+
+        /**监视计划文件, 调用时应持有mtx*/
+        void watchPlanInfo(const std::string &name) {
+            if (planWatches.count(name))return;
+#if IFR_CONFIG_USE_FS
+            std::error_code ec;
+            std::filesystem::create_directories("runtime/plans", ec);
+#else
+            ifr::Config::mkDir("runtime/plans");
+#endif
+            planWatches[name] = Config::Watch::add(planFile(name), [name]() {
+                std::unique_lock<std::recursive_mutex> lock(mtx);
+                const auto itr = planHashes.find(name);
+                return itr == planHashes.end() ? (uint64_t) 0 : itr->second;
+            }, [name](const std::string &content, uint64_t hash) { reloadPlanInfo(name, content, hash); });
         }
 
         void readPlanInfo(const std::string &name) {
-            std::ifstream fin("runtime/plans/" + name + ".json");
+            std::ifstream fin(planFile(name), std::ios::binary);
             if (fin.is_open()) {
-                rapidjson::IStreamWrapper isw(fin);
-                Document d;
-                d.ParseStream(isw);
-                plans.insert(std::pair<std::string, PlanInfo>(name, PlanInfo::read(d)));
+                const std::string content((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
                 fin.close();
+                std::string error;
+                auto info = PlanInfo::read(content, error);
+                if (!info.loaded)ifr::logger::err("Plan", "Bad plan file", name + ": " + error);
+                planHashes[name] = Config::Persist::hash(content);
+                plans.insert(std::pair<std::string, PlanInfo>(name, std::move(info)));
             } else {
                 plans.insert(std::pair<std::string, PlanInfo>(name, {}));
             }
+            watchPlanInfo(name);
         }
 
         void writePlanInfo(const PlanInfo &info) {
             if (!info.loaded)return;
 #if IFR_CONFIG_USE_FS
-            std::filesystem::path file("runtime/plans/" + info.name + ".json");
+            std::filesystem::path file(planFile(info.name));
             file = absolute(file);
             {
                 const auto parent = file.parent_path();
                 if (!parent.empty() && !exists(parent))std::filesystem::create_directories(parent);
             }
 #else
-            std::string file = "runtime/plans/" + info.name + ".json";
+            std::string file = planFile(info.name);
             ifr::Config::mkDir(ifr::Config::getDir(file));
 #endif
-            std::ofstream fout(file, std::ios_base::out | std::ios_base::trunc);
-            if (fout.is_open()) {
-                rapidjson::OStreamWrapper osw(fout);
-                rapidjson::Writer<OStreamWrapper> w(osw);
-                info(w);
-                w.Flush();
-                osw.Flush();
-                fout.flush();
-                fout.close();
-            }
+            StringBuffer buf;
+            Writer<StringBuffer> w(buf);
+            info(w);
+            w.Flush();
+            const std::string content(buf.GetString(), buf.GetLength());
+            if (Config::Persist::writeAtomic(IFR_CONFIG_PATH2STR(file), content))
+                planHashes[info.name] = Config::Persist::hash(content);
         }
 
         void registerTask(const std::string &name, const TaskDescription &description, const Task &registerTask) {
+            registerTypedTask(name, description, [registerTask](const auto &io, const auto &args, auto state,
+                                                                const auto &cb) {
+                registerTask(io, args.toMap(), state, cb);
+            });
+        }
+
+        void registerTypedTask(const std::string &name, const TaskDescription &description,
+                               const TypedTask &registerTask) {
             std::unique_lock<std::recursive_mutex> lock(mtx);
             updateTaskDescriptionsJson(name, description);
-            tasks.insert(std::pair<std::string, const Task>(name, registerTask));
+            descriptions[name] = description;
+            tasks.insert(std::pair<std::string, const TypedTask>(name, registerTask));
         }
 
         std::string getTaskDescriptionsJson() {
@@ -131,36 +190,75 @@ namespace ifr {
             w.Key("current"), w.String(currentPlans);
             w.Key("running"), w.Bool(isRunning());
             w.Key("state"), w.Int(getState());
+            w.Key("plans"), w.StartObject();
+            for (const auto &name: getRunningPlans())w.Key(name), w.Int(getState(name));
+            w.EndObject();
+            w.EndObject();
+            w.Flush();
+
+            return buf.GetString();
+        }
+
+        std::string getPlanStateJson(const std::string &name) {
+            StringBuffer buf;
+            Writer<StringBuffer> w(buf);
+
+            w.StartObject();
+            w.Key("name"), w.String(name);
+            w.Key("running"), w.Bool(isRunning(name));
+            w.Key("state"), w.Int(getState(name));
             w.EndObject();
             w.Flush();
 
             return buf.GetString();
         }
 
+        /**计划列表的配置文件*/
+        struct PlanList {
+            std::vector<std::string> list;//所有计划
+            std::string current;//当前选中的计划
+
+            static auto schema() {
+                using Config::Schema::field;
+                return std::make_tuple(field("list", &PlanList::list).required(),
+                                       field("current", &PlanList::current));
+            }
+        };
+
         void init() {
             static ifr::Config::ConfigInfo<void> info = {
                     [](auto *a, auto &w) {
                         std::unique_lock<std::recursive_mutex> lock(mtx);
-                        w.StartObject();
-
-                        w.Key("list");
-                        w.StartArray();
-                        for (const auto &e: plans)w.String(e.first);
-                        w.EndArray();
-
-                        w.Key("current"), w.String(currentPlans);
-
-                        w.EndObject();
+                        PlanList l{getPlanList(), currentPlans};
+                        Config::Schema::write(w, l);
                     },
-                    [](auto *a, const rapidjson::Document &d) {
+                    nullptr,
+                    [](auto *a, const std::string &content) {
+                        PlanList l;
+                        std::string error;
+                        if (!Config::Schema::read(content, l, error)) {
+                            ifr::logger::err("Plan", "Bad plan list", error);
+                            return false;
+                        }
+                        std::vector<std::shared_ptr<void>> watches;//在释放mtx后停止监视 (见removePlanInfo)
                         std::unique_lock<std::recursive_mutex> lock(mtx);
-                        for (const auto &item: d["list"].GetArray()) {
-                            std::string name = item.GetString();
-                            if (!checkPlanName(name))continue;
-                            readPlanInfo(name);
+                        std::set<std::string> listed;
+                        for (const auto &name: l.list)if (checkPlanName(name))listed.insert(name), readPlanInfo(name);
+                        for (auto itr = plans.begin(); itr != plans.end();) {//重新加载时以列表为准: 移除未列出的计划
+                            if (listed.count(itr->first)) {
+                                ++itr;
+                                continue;
+                            }
+                            const auto name = itr->first;
+                            itr = plans.erase(itr);
+                            planHashes.erase(name);
+                            if (const auto w = planWatches.find(name); w != planWatches.end())
+                                watches.push_back(std::move(w->second)), planWatches.erase(w);
+                            stopPlan(name);
                         }
                         planListJson = "";
-                        currentPlans = d["current"].GetString();
+                        currentPlans = l.current;
+                        return true;
                     }
             };
             cc = ifr::Config::createConfig("plan-list", (void *) nullptr, info);
@@ -180,173 +278,849 @@ namespace ifr {
             return plans[name];
         }
 
+        ///资源预算及运行时资源统计
+        namespace Budget {
+            double capacityCpu = 0;//可用CPU核心数, <=0: 硬件线程数
+            double capacityMemory = 0;//可用内存(MB), <=0: 系统可用内存
+
+            std::mutex usage_mtx;//访问锁: 资源统计
+            std::map<std::string, std::map<std::string, std::set<long>>> threads;//计划名称 - 任务名称 - 线程ID(TID)
+            std::map<long, std::pair<long, std::chrono::steady_clock::time_point>> samples;//TID - 上次采样(CPU时钟, 时间)
+
+            /**@return 当前线程的TID*/
+            inline long currentTid() {
+#if __OS__ == __OS_Linux__
+                return (long) syscall(SYS_gettid);
+#else
+                return -1;
+#endif
+            }
+
+            /**
+             * 读取线程已使用的CPU时钟数 (/proc/self/task/TID/stat 中的 utime + stime)
+             * @param tid 线程ID
+             * @return CPU时钟数, 小于0表示读取失败 (线程已退出等)
+             */
+            long readThreadTicks(long tid) {
+#if __OS__ == __OS_Linux__
+                std::ifstream fin("/proc/self/task/" + std::to_string(tid) + "/stat");
+                if (!fin.is_open())return -1;
+                std::string line;
+                std::getline(fin, line);
+                const auto pos = line.rfind(')');//进程名中可能包含空格
+                if (pos == std::string::npos)return -1;
+                std::istringstream iss(line.substr(pos + 1));
+                std::string field;
+                long utime = -1, stime = -1;
+                for (int i = 3; i <= 15 && iss >> field; i++) {
+                    if (i == 14)utime = std::stol(field);
+                    else if (i == 15)stime = std::stol(field);
+                }
+                if (utime < 0 || stime < 0)return -1;
+                return utime + stime;
+#else
+                return -1;
+#endif
+            }
+
+            /**@return 进程常驻内存 (MB), 小于0表示读取失败*/
+            double readRssMB() {
+#if __OS__ == __OS_Linux__
+                std::ifstream fin("/proc/self/statm");
+                long size, resident;
+                if (!(fin >> size >> resident))return -1;
+                return (double) resident * (double) sysconf(_SC_PAGESIZE) / 1024.0 / 1024.0;
+#else
+                return -1;
+#endif
+            }
+
+            /**@return 可用CPU核心数*/
+            double getCpuCapacity() {
+                if (capacityCpu > 0)return capacityCpu;
+                return std::max(1u, std::thread::hardware_concurrency());
+            }
+
+            /**@return 可用内存 (MB), 小于等于0表示未知 (不限制)*/
+            double getMemoryCapacity() {
+                if (capacityMemory > 0)return capacityMemory;
+#if __OS__ == __OS_Linux__
+                std::ifstream fin("/proc/meminfo");
+                std::string key, unit;
+                long value;
+                while (fin >> key >> value >> unit)
+                    if (key == "MemAvailable:")return (double) value / 1024.0;
+#endif
+                return 0;
+            }
+
+            /**
+             * 获取任务的实际预算
+             * @param tname 任务名称
+             * @param task 任务数据
+             * @return 任务描述中的默认预算, 被任务数据中的预算覆盖后的结果
+             */
+            TaskBudget getBudget(const std::string &tname, const TaskInfo &task) {
+                const auto itr = descriptions.find(tname);
+                const auto def = itr == descriptions.end() ? TaskBudget() : itr->second.budget;
+                return def.override(task.budget);
+            }
+
+            /**
+             * 准入检查
+             * @param plans 需要同时运行的所有计划
+             * @return 错误信息, 为空表示通过
+             */
+            std::string admit(const std::vector<const PlanInfo *> &plans) {
+                double cpu = 0, memory = 0;
+                for (const auto plan: plans)
+                    for (const auto &ele: plan->tasks) {
+                        if (!ele.second.enable)continue;
+                        const auto budget = getBudget(ele.first, ele.second);
+                        if (budget.cpu > 0)cpu += budget.cpu;
+                        if (budget.memory > 0)memory += budget.memory;
+                    }
+                const auto capCpu = getCpuCapacity(), capMemory = getMemoryCapacity();
+                if (cpu > capCpu)
+                    return "cpu budget " + std::to_string(cpu) + " > capacity " + std::to_string(capCpu);
+                if (capMemory > 0 && memory > capMemory)
+                    return "memory budget " + std::to_string(memory) + "MB > capacity " + std::to_string(capMemory) +
+                           "MB";
+                return "";
+            }
+
+            /**
+             * 登记当前线程
+             * @param plan 计划名称
+             * @param task 任务名称
+             */
+            void registerThread(const std::string &plan, const std::string &task) {
+                const auto tid = currentTid();
+                if (tid < 0)return;
+                std::unique_lock<std::mutex> lock(usage_mtx);
+                threads[plan][task].insert(tid);
+            }
+
+            /**
+             * 注销当前线程
+             * @param plan 计划名称
+             * @param task 任务名称
+             */
+            void unregisterThread(const std::string &plan, const std::string &task) {
+                const auto tid = currentTid();
+                std::unique_lock<std::mutex> lock(usage_mtx);
+                const auto itr = threads.find(plan);
+                if (itr != threads.end() && itr->second.count(task))itr->second[task].erase(tid);
+                samples.erase(tid);
+            }
+
+            /**
+             * 清除计划登记的所有线程
+             * @param plan 计划名称
+             */
+            void clear(const std::string &plan) {
+                std::unique_lock<std::mutex> lock(usage_mtx);
+                const auto itr = threads.find(plan);
+                if (itr == threads.end())return;
+                for (const auto &e: itr->second)for (const auto &tid: e.second)samples.erase(tid);
+                threads.erase(itr);
+            }
+
+            /**
+             * 采样线程的CPU占用
+             * @param tid 线程ID
+             * @return CPU占用 (核心数), 首次采样为0, 小于0表示线程已退出
+             */
+            double sample(long tid) {
+                const auto ticks = readThreadTicks(tid);
+                if (ticks < 0)return -1;
+                const auto now = std::chrono::steady_clock::now();
+                const auto itr = samples.find(tid);
+                double usage = 0;
+                if (itr != samples.end()) {
+                    const auto sec = std::chrono::duration<double>(now - itr->second.second).count();
+#if __OS__ == __OS_Linux__
+                    static const auto hz = (double) sysconf(_SC_CLK_TCK);
+#else
+                    static const auto hz = 100.0;
+#endif
+                    if (sec > 0)usage = (double) (ticks - itr->second.first) / hz / sec;
+                }
+                samples[tid] = {ticks, now};
+                return usage;
+            }
+        }
+
+        ///计划之间共享的频道
+        namespace Channels {
+            std::mutex channel_mtx;//访问锁: 频道计数
+            std::map<std::string, int> users;//频道名称 - 使用此频道的运行中计划数量
+
+            /**@return 计划使用的所有频道*/
+            std::set<std::string> of(const PlanInfo &plan) {
+                std::set<std::string> set;
+                for (const auto &task: plan.tasks) {
+                    if (!task.second.enable)continue;
+                    for (const auto &io: task.second.io)if (!io.second.channel.empty())set.insert(io.second.channel);
+                }
+                return set;
+            }
 
+            /**
+             * 登记/注销计划使用的频道
+             * @details 被多个运行中计划使用的频道会标记为 Msg 共享频道, 允许订阅者在发布者锁定后加入
+             * @param channels 频道
+             * @param use true: 登记 / false: 注销
+             */
+            void use(const std::set<std::string> &channels, bool use) {
+                std::unique_lock<std::mutex> lock(channel_mtx);
+                for (const auto &c: channels) {
+                    const auto n = users[c] += use ? 1 : -1;
+                    if (n <= 0)users.erase(c);
+                    ifr::Msg::setShared(c, n > 1);
+                }
+            }
+        }
+
+        ///任务运行时统计 (单帧耗时)
+        namespace Stats {
+            /**一个任务的运行时统计*/
+            struct TaskStats {
+                std::atomic<uint64_t> frames{0};//帧数
+                std::atomic<int64_t> sum{0};//总耗时 (ns)
+                std::atomic<int64_t> max{0};//最大耗时 (ns)
+                std::atomic<int64_t> last{0};//最近一帧耗时 (ns)
+                std::atomic<int64_t> beat{0};//最近一次心跳时间 (ns)
+                std::atomic<long> tid{-1};//任务运行主体所在线程的TID
+
+                template<class T>
+                void operator()(rapidjson::Writer<T> &w) const {
+                    const auto n = frames.load();
+                    w.StartObject();
+                    w.Key("frames"), w.Uint64(n);
+                    w.Key("avg"), w.Double(n ? (double) sum.load() / (double) n / 1e6 : 0);
+                    w.Key("max"), w.Double((double) max.load() / 1e6);
+                    w.Key("last"), w.Double((double) last.load() / 1e6);
+                    w.EndObject();
+                }
+            };
+
+            thread_local std::shared_ptr<TaskStats> current;//当前线程所属任务的统计
+            thread_local int64_t lastPop = 0;//当前线程最近一次接收消息的时间 (ns)
+
+            inline int64_t now() {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+            /**Msg接收钩子: 记录接收时间及心跳*/
+            void onPop(const std::string &) { if (current)lastPop = current->beat = now(); }
+
+            /**Msg推送钩子: 记录心跳及从接收到推送的耗时 (每次接收仅记录第一次推送)*/
+            void onPush(const std::string &) {
+                if (!current)return;
+                const auto t0 = current->beat = now();
+                if (lastPop == 0)return;
+                const auto t = t0 - lastPop;
+                lastPop = 0;
+                current->frames++;
+                current->sum += t;
+                current->last = t;
+                for (auto m = current->max.load(); t > m && !current->max.compare_exchange_weak(m, t););
+            }
+
+            /**安装Msg钩子*/
+            void install() {
+                static std::once_flag flag;
+                std::call_once(flag, []() { ifr::Msg::setHooks(onPush, onPop); });
+            }
+        }
 
         ///运行数据, 包括全部流程控制
         namespace RunData {
             const auto delay = SLEEP_TIME(0.1);// 自旋等待间隔
-            std::recursive_mutex state_mtx;//访问锁: 状态相关
-            std::recursive_mutex running_mtx;//访问锁: 运行相关
-            std::string currentPlan;//前流程名称
-            std::atomic_int runID;//运行ID, 每次启动任务时改变, 防止不同批次任务混淆
 
-            bool running = false;
+            /**记录计划事件: 轨迹中的阶段计数器及飞行记录仪*/
+            void planEvent(const std::string &name, int state, std::string_view what) {
+                ifr::Trace::counter(ifr::Trace::PLAN, name, state);
+                if (!ifr::Recorder::enabled())return;
+                ifr::Recorder::Text t;
+                ifr::Recorder::record(ifr::Recorder::PLAN, ifr::logger::LV_INFO,
+                                      {t.add(name).add(" ").add(what).add(" state=").num(state)});
+            }
 
-            int state;//当前运行阶段, 详见Task描述
-            std::set<std::string> runningTasks;//运行中的task名称
-            std::set<std::string> waitingTasks;//等待中的task名称 (等待运行阶段完成)
-            std::set<std::string> finishingTasks;//等待完毕的task名称 (等待程序退出)
+            /**
+             * 获取任务实际使用的IO
+             * @details 影子任务的输入使用被比较任务同名IO的频道, 输出使用镜像频道
+             * @param plan 计划信息
+             * @param tname 任务名称
+             * @param task 任务数据
+             * @return IO信息
+             * @throw PlanError 被比较的任务未启用/也是影子任务
+             */
+            std::map<const std::string, TaskIOInfo>
+            resolveIO(const PlanInfo &plan, const std::string &tname, const TaskInfo &task) {
+                std::map<const std::string, TaskIOInfo> io(task.io.begin(), task.io.end());
+                if (task.shadow.empty())return io;
+                const auto primary = plan.tasks.find(task.shadow);
+                if (primary == plan.tasks.end() || !primary->second.enable)
+                    throw PlanError("Shadow target not enabled: " + tname + " -> " + task.shadow);
+                if (!primary->second.shadow.empty())
+                    throw PlanError("Shadow target is a shadow task: " + tname + " -> " + task.shadow);
+                for (const auto &e: descriptions[tname].io) {
+                    auto &info = io[e.first];
+                    if (e.second.isIn) {
+                        const auto itr = primary->second.io.find(e.first);
+                        if (itr != primary->second.io.end())info = itr->second;
+                    } else info.channel = shadowChannel(info.channel.empty() ? e.first : info.channel, tname);
+                }
+                return io;
+            }
+
+            /**
+             * 计划的运行实例
+             * @details 每个计划拥有独立的状态机及任务集合, 不同的计划可以同时运行
+             */
+            class PlanRunner : public std::enable_shared_from_this<PlanRunner> {
+            public:
+                const std::string name;//计划名称
+                std::recursive_mutex state_mtx;//访问锁: 状态相关
+                std::recursive_mutex running_mtx;//访问锁: 运行相关
+                std::atomic_int runID{0};//运行ID, 每次启动任务时改变, 防止不同批次任务混淆
+
+                std::atomic_bool running{false};
+
+                int state = 0;//当前运行阶段, 详见Task描述
+                std::set<std::string> runningTasks;//运行中的task名称
+                std::set<std::string> waitingTasks;//等待中的task名称 (等待运行阶段完成)
+                std::set<std::string> finishingTasks;//等待完毕的task名称 (等待程序退出)
+                std::set<std::string> channels;//使用的所有频道
+                std::map<std::string, std::shared_ptr<Stats::TaskStats>> stats;//任务名称 - 运行时统计
+                std::map<std::string, std::string> shadows;//影子任务名称 - 被比较的任务名称
+                std::atomic<int64_t> stateSince{0};//进入当前阶段的时间 (ns)
+                std::atomic_int restarts{0};//被看门狗重启的次数
+                std::map<std::string, std::shared_ptr<Stats::TaskStats>> abandoned;//被放弃且线程仍未退出的任务 (重启时继承)
+
+                explicit PlanRunner(std::string name) : name(std::move(name)) {}
+
+                /**@return 当前阶段是否运行完毕*/
+                bool isStepFinish() {
+                    std::unique_lock<std::recursive_mutex> lock(state_mtx);
+                    return waitingTasks.empty();
+                }
 
+                /**
+                 * 进入下一阶段
+                 * @return false = 当前阶段还未执行, 不可进入下一阶段
+                 * @return true = 成功进入下一阶段 (但不代表下一阶段执行完毕)
+                 */
+                bool nextStep() {
+                    std::unique_lock<std::recursive_mutex> lock(state_mtx);
+                    if (!isStepFinish())return false;
+                    waitingTasks = std::set<std::string>(runningTasks.begin(), runningTasks.end());
+                    state++;
+                    stateSince = Stats::now();
+                    planEvent(name, state, "nextStep");
+                    IFR_LOG_DEBUG("Plan", "nextStep(): " + name + " arrive state", state);
+                    outMsg(LOG, "Plan", "nextStep()", name + " arrive state = " + std::to_string(state));
+                    return true;
+                }
 
-            /**@return 当前阶段是否运行完毕*/
-            bool isStepFinish() {
-                std::unique_lock<std::recursive_mutex> lock(RunData::state_mtx);
-                return waitingTasks.empty();
+                /**
+                 * 自动执行步骤, 直到到达了指定的步骤
+                 *
+                 * @param target 目标步骤
+                 * @param waitFinish 是否等待步骤结束
+                 */
+                void untilStep(int target, bool waitFinish = false) {
+                    for (bool b = false; state < target; b = true) {
+                        if (b)SLEEP(delay);
+                        nextStep();
+                    }
+                    if (waitFinish)while (state == target && !isStepFinish())SLEEP(delay);
+                }
+
+                /**
+                 * 自动执行步骤, 但立即返回
+                 * @param target
+                 */
+                void goStep(int target) {
+                    std::thread t = std::thread([self = shared_from_this(), target]() {
+                        self->untilStep(target);
+                    });
+                    while (!t.joinable());
+                    t.detach();
+                }
+
+                /**
+                 * 停止流程并重置
+                 */
+                void reset() {
+                    std::unique_lock<std::recursive_mutex> lock(running_mtx);
+                    IFR_LOG_DEBUG("Plan", "reset(): " + name + " running", running ? "true" : "false");
+                    outMsg(LOG, "Plan", "reset()", name + " running = " + std::string(running ? "true" : "false")
+                                                   + ", eor = " + std::string(exitOnReset ? "true" : "false"));
+
+                    if (exitOnReset) {
+                        ifr::logger::log("Plan", "reset()", "exit");
+                        exit(-10);
+                    }
+
+                    if (!running)return;
+
+                    untilStep(4, true);//结束
+                    while (!finishingTasks.empty()) SLEEP(delay);
+
+                    std::unique_lock<std::recursive_mutex> lock2(state_mtx);
+                    state = 0;
+                    planEvent(name, state, "reset");
+                    runningTasks.clear();
+                    waitingTasks.clear();
+                    finishingTasks.clear();
+                    std::set<std::string> used;
+                    used.swap(channels);
+                    lock2.unlock();
+                    Budget::clear(name);
+                    Channels::use(used, false);
+
+                    running = false;
+                }
+
+                /**
+                 * 放弃当前批次的任务 (由看门狗调用)
+                 * @details 卡死的任务线程无法被终止: 放弃后其回调均被忽略, 阶段被置为4, 以便其恢复后自行退出。
+                 * @details 不获取运行锁, 因此可以解除正卡在reset中的等待
+                 */
+                void abandon() {
+                    std::unique_lock<std::recursive_mutex> lock(state_mtx);
+                    ++runID;
+                    state = 4;
+                    planEvent(name, state, "abandon");
+                    runningTasks.clear();
+                    waitingTasks.clear();
+                    finishingTasks.clear();
+                    std::set<std::string> used;
+                    used.swap(channels);
+                    lock.unlock();
+                    Budget::clear(name);
+                    Channels::use(used, false);
+                    running = false;
+                }
+
+                /**
+                 * 停止流程并重置, 但立即返回
+                 */
+                void resetAsync() {
+                    std::thread t([self = shared_from_this()]() { self->reset(); });
+                    while (!t.joinable());
+                    t.detach();
+                }
+
+                /**
+                 * 启动流程
+                 * @param plan 计划信息
+                 */
+                bool start(const PlanInfo &plan) {
+                    std::unique_lock<std::recursive_mutex> lock(running_mtx);
+                    outMsg(LOG, "Plan", "start()", name + " running = " + std::string(running ? "true" : "false"));
+                    if (running)reset();
+
+                    const int rid = ++runID;
+                    if (!plan.loaded)return false;
+
+                    std::map<std::string, TaskArgs> args;//所有启用任务的参数, 在任何任务启动前校验并转换
+                    std::map<std::string, std::map<const std::string, TaskIOInfo>> ios;//所有启用任务的IO
+                    for (const auto &ele: plan.tasks) {
+                        const auto &tname = ele.first;
+                        if (!ele.second.enable)continue;
+                        try {
+                            if (!tasks.count(tname))throw PlanError("Task not registered: " + tname);
+                            args[tname] = TaskArgs::parse(tname, descriptions[tname], ele.second.args);
+                            ios[tname] = resolveIO(plan, tname, ele.second);
+                        } catch (PlanError &err) {
+                            ifr::logger::err("Plan", "start(): bad plan", name + ", " + err.what());
+                            outMsg(POPUP, "Plan", "PlanError", name + ": " + err.what());
+                            return false;
+                        }
+                    }
+
+                    channels = Channels::of(plan);
+                    Channels::use(channels, true);
+                    Stats::install();
+
+                    std::unique_lock<std::recursive_mutex> lock2(state_mtx);
+                    stats.clear(), shadows.clear();
+                    stateSince = Stats::now();
+
+                    int cnt = 0;//任务启动计数
+                    for (const auto &ele: plan.tasks) {
+                        const auto &tname = ele.first;
+                        const auto &task = ele.second;
+                        if (!task.enable)continue;
+                        cnt++;
+
+                        runningTasks.insert(tname);
+                        const auto stat = stats[tname] = std::make_shared<Stats::TaskStats>();
+                        if (!task.shadow.empty())shadows[tname] = task.shadow;
+
+                        const auto regTask = tasks.at(tname);
+                        std::thread t = std::thread(
+                                [](const auto self, const auto regTask, const auto rid, const auto tname, auto io,
+                                   auto args, auto stat) {
+                                    Budget::registerThread(self->name, tname);
+                                    ifr::Trace::setThreadName(self->name + "/" + tname);
+                                    if (ifr::Recorder::enabled())ifr::Recorder::altStack();//栈溢出时仍可输出记录
+                                    Stats::current = stat;
+                                    stat->tid = Budget::currentTid();
+                                    try {
+                                        regTask(io, args, &self->state, [&self, &rid, &tname, &stat](const auto finish) {
+                                            stat->beat = Stats::now();
+                                            std::unique_lock<std::recursive_mutex> lock(self->state_mtx);
+                                            if (self->runID != rid || finish != self->state)return;
+                                            self->waitingTasks.erase(tname);
+                                        });
+                                        std::unique_lock<std::recursive_mutex> lock(self->state_mtx);
+                                        if (self->runID == rid && self->state == 4)
+                                            self->waitingTasks.erase(tname);//可以自动释放最后一步
+                                    } catch (PlanError &err) {
+                                        ifr::logger::err("Plan", "PlanError", tname + ", " + err.what());
+                                        outMsg(POPUP, "Plan", "PlanError", tname + ": " + err.what());
+                                        self->resetAsync();
+                                    } catch (std::exception &err) {
+                                        ifr::logger::err("Plan", "Error", tname + ", " + err.what());
+                                        outMsg(POPUP, "Plan", "Error", tname + ": " + err.what());
+                                    } catch (...) {
+                                        ifr::logger::err("Plan", "Error", tname);
+                                        outMsg(POPUP, "Plan", "UnknownError", tname);
+                                    }
+                                    IFR_LOG_DEBUG("Plan", "Exit Running", tname);
+                                    ifr::Recorder::record(ifr::Recorder::PLAN, ifr::logger::LV_INFO,
+                                                          {self->name, " exit task ", tname});
+                                    outMsg(POPUP, "Plan", "Exit Running", tname);
+                                    Budget::unregisterThread(self->name, tname);
+                                    stat->tid = -1;//线程已退出
+                                    Stats::current = nullptr;
+                                    if (self->runID != rid)return;
+                                    std::unique_lock<std::recursive_mutex> lock(self->state_mtx);
+                                    self->finishingTasks.erase(tname);
+                                    self->runningTasks.erase(tname);
+                                    self->waitingTasks.erase(tname);
+
+                                    self->resetAsync();//重置
+
+                                }, shared_from_this(), regTask, rid, tname, std::move(ios[tname]), std::move(args[tname]),
+                                stat);
+                        IFR_LOG_DEBUG("Plan", "start() - " + name + " - " + tname, t.get_id());
+                        ifr::Recorder::record(ifr::Recorder::PLAN, ifr::logger::LV_INFO, {name, " start task ", tname});
+                        outMsg(LOG, "Plan", "start()", name + " - " + tname);
+                        while (!t.joinable());
+                        t.detach();
+                    }
+                    finishingTasks = std::set<std::string>(runningTasks.begin(),
+                                                           runningTasks.end());
+                    running = cnt > 0;
+                    if (running)goStep(2);//进入运行阶段
+                    else Channels::use(channels, false), channels.clear();
+                    return running;
+                }
+            };
+
+            std::mutex runners_mtx;//访问锁: 运行实例
+            std::map<std::string, std::shared_ptr<PlanRunner>> runners;//计划名称 - 运行实例
+
+            /**
+             * 获取计划的运行实例
+             * @param name 计划名称
+             * @param create 不存在时是否创建
+             * @return 运行实例, 不存在且不创建时为空
+             */
+            std::shared_ptr<PlanRunner> get(const std::string &name, bool create = false) {
+                std::unique_lock<std::mutex> lock(runners_mtx);
+                const auto itr = runners.find(name);
+                if (itr != runners.end())return itr->second;
+                if (!create)return nullptr;
+                return runners[name] = std::make_shared<PlanRunner>(name);
+            }
+
+            /**@return 所有运行中的实例*/
+            std::vector<std::shared_ptr<PlanRunner>> getRunning() {
+                std::unique_lock<std::mutex> lock(runners_mtx);
+                std::vector<std::shared_ptr<PlanRunner>> vec;
+                for (const auto &e: runners)if (e.second->running)vec.push_back(e.second);
+                return vec;
             }
+        }
+
+        /**
+         * 计划的准入检查: 与其他运行中的计划一同计算预算
+         * @param info 计划数据
+         * @param extra 额外占用资源的计划, 可为空
+         * @return 错误信息, 为空表示通过
+         */
+        std::string admitPlan(const PlanInfo &info, const PlanInfo *extra = nullptr) {
+            std::vector<const PlanInfo *> running = {&info};//需要同时运行的所有计划
+            if (extra)running.push_back(extra);
+            for (const auto &r: RunData::getRunning()) {
+                if (r->name == info.name)continue;
+                const auto other = plans.find(r->name);
+                if (other != plans.end())running.push_back(&other->second);
+            }
+            return Budget::admit(running);
+        }
+
+        ///看门狗: 检测并处理卡死的任务
+        namespace Watchdog {
+            /**每个阶段的超时时间 (ns), 小于等于0表示不检测*/
+            std::atomic<int64_t> deadlines[5] = {0, 30'000'000'000, 0, 10'000'000'000, 10'000'000'000};
+            std::atomic_int maxRestarts{3};//自动重启次数上限
+
+#if __OS__ == __OS_Linux__
 
             /**
-             * 进入下一阶段
-             * @return false = 当前阶段还未执行, 不可进入下一阶段
-             * @return true = 成功进入下一阶段 (但不代表下一阶段执行完毕)
+             * 线程调用栈采集
+             * @details 向目标线程发送SIGURG(默认忽略, 未安装处理器时无副作用), 由目标线程在信号处理器内记录调用栈
+             * @details 处理器只将返回地址写入预先分配的缓冲区, 不分配内存; backtrace在安装时预先调用一次,
+             * 以在信号处理器外完成其首次调用时的库加载; 符号在采集线程中解析
              */
-            bool nextStep() {
-                std::unique_lock<std::recursive_mutex> lock(RunData::state_mtx);
-                if (!isStepFinish())return false;
-                waitingTasks = std::set<std::string>(runningTasks.begin(), runningTasks.end());
-                state++;
-                ifr::logger::log("Plan", "nextStep(): arrive state", state);
-                outMsg(LOG, "Plan", "nextStep()", "arrive state = " + std::to_string(state));
-                return true;
+            namespace Stack {
+                std::mutex mtx;//访问锁: 同一时间仅采集一个线程
+                void *frames[64];//预先分配的缓冲区, 仅由被请求的处理器写入
+                std::atomic_int size{-1};//写入的帧数, -1为尚未写入
+                std::atomic_bool armed{false};//是否等待处理器写入, 超时后收回, 迟到的信号不再写入
+
+                void handler(int) {
+                    if (!armed.exchange(false))return;
+                    size.store(backtrace(frames, 64), std::memory_order_release);
+                }
+
+                void install() {
+                    static std::once_flag flag;
+                    std::call_once(flag, []() {
+                        backtrace(frames, 1);//预加载, 避免在信号处理器内首次加载
+                        struct sigaction sa{};
+                        sa.sa_handler = handler;
+                        sa.sa_flags = SA_RESTART;
+                        sigemptyset(&sa.sa_mask);
+                        sigaction(SIGURG, &sa, nullptr);
+                    });
+                }
+
+                /**
+                 * 采集线程的调用栈
+                 * @param tid 线程ID
+                 * @return 每一帧的符号, 采集失败时为空
+                 */
+                std::vector<std::string> dump(long tid) {
+                    std::vector<std::string> vec;
+                    if (tid <= 0)return vec;
+                    install();
+                    std::unique_lock<std::mutex> lock(mtx);
+                    size = -1, armed = true;
+                    if (syscall(SYS_tgkill, getpid(), tid, SIGURG) != 0)return armed = false, vec;
+                    for (int i = 0; i < 20 && size < 0; i++)SLEEP(SLEEP_TIME(0.01));
+                    if (armed.exchange(false))return vec;//超时, 处理器未开始执行
+                    while (size < 0)std::this_thread::yield();//处理器已开始执行, 等待写入完成
+                    const int n = size.load(std::memory_order_acquire);
+                    if (n <= 0)return vec;
+                    char **symbols = backtrace_symbols(frames, n);
+                    if (!symbols)return vec;
+                    for (int i = 0; i < n; i++)vec.emplace_back(symbols[i]);
+                    free(symbols);
+                    return vec;
+                }
+            }
+
+            /**
+             * 读取线程状态 (/proc/self/task/TID/stat 中的状态 及 wchan)
+             * @param tid 线程ID
+             * @return 状态, 读取失败时为空
+             */
+            std::string readThreadStatus(long tid) {
+                const auto dir = "/proc/self/task/" + std::to_string(tid);
+                std::ifstream fin(dir + "/stat");
+                std::string line, wchan;
+                if (!fin.is_open() || !std::getline(fin, line))return "";
+                const auto pos = line.rfind(')');
+                if (pos == std::string::npos || pos + 2 >= line.size())return "";
+                std::ifstream win(dir + "/wchan");
+                if (win.is_open())std::getline(win, wchan);
+                return std::string(1, line[pos + 2]) + (wchan.empty() || wchan == "0" ? "" : " " + wchan);
             }
 
+#endif
+
             /**
-             * 自动执行步骤, 直到到达了指定的步骤
-             *
-             * @param target 目标步骤
-             * @param waitFinish 是否等待步骤结束
+             * 生成卡死时的现场信息
+             * @param r 运行实例
+             * @param stalled 卡死的任务
+             * @return json
              */
-            inline void untilStep(int target, bool waitFinish = false) {
-                for (bool b = false; state < target; b = true) {
-                    if (b)SLEEP(delay);
-                    nextStep();
+            std::string dump(const std::shared_ptr<RunData::PlanRunner> &r, const std::vector<std::string> &stalled) {
+                struct Task {
+                    std::string name;
+                    bool waiting;
+                    int64_t beat;
+                    long tid;
+                };
+                std::vector<Task> tasks;
+                int state;
+                int64_t stateSince;
+                const auto t = Stats::now();
+                {//只在复制状态时加锁, 采集调用栈需要等待目标线程
+                    std::unique_lock<std::recursive_mutex> lock(r->state_mtx);
+                    state = r->state, stateSince = r->stateSince;
+                    for (const auto &e: r->stats)
+                        if (r->runningTasks.count(e.first))
+                            tasks.push_back({e.first, r->waitingTasks.count(e.first) > 0, e.second->beat,
+                                             e.second->tid});
+                }
+
+                StringBuffer buf;
+                Writer<StringBuffer> w(buf);
+                w.StartObject();
+                w.Key("plan"), w.String(r->name);
+                w.Key("state"), w.Int(state);
+                w.Key("stateAge"), w.Double((double) (t - stateSince) / 1e9);
+                w.Key("tasks"), w.StartObject();
+                for (const auto &e: tasks) {
+                    w.Key(e.name), w.StartObject();
+                    w.Key("waiting"), w.Bool(e.waiting);
+                    w.Key("idle"), w.Double(e.beat ? (double) (t - e.beat) / 1e9 : -1);
+                    w.Key("tid"), w.Int64(e.tid);
+#if __OS__ == __OS_Linux__
+                    w.Key("thread"), w.String(readThreadStatus(e.tid));
+                    if (std::find(stalled.begin(), stalled.end(), e.name) != stalled.end()) {
+                        w.Key("stack"), w.StartArray();
+                        for (const auto &frame: Stack::dump(e.tid))w.String(frame);
+                        w.EndArray();
+                    }
+#endif
+                    w.EndObject();
                 }
-                if (waitFinish)while (state == target && !isStepFinish())SLEEP(delay);
+                w.EndObject();
+                w.EndObject();
+                w.Flush();
+
+                return buf.GetString();
             }
 
             /**
-             * 自动执行步骤, 但立即返回
-             * @param target
+             * 重启计划 (使用新的运行实例, 卡死的任务仍保留在旧实例上)
+             * @details 与启动计划相同需要通过准入检查, 卡死且线程未退出的任务仍计入预算
+             * @param r 被放弃的运行实例
+             * @param stalled 卡死的任务
              */
-            inline void goStep(int target) {
-                std::thread t = std::thread([target]() {
-                    untilStep(target);
+            void restart(const std::shared_ptr<RunData::PlanRunner> &r, const std::vector<std::string> &stalled) {
+                std::thread t([r, stalled]() {
+                    std::unique_lock<std::recursive_mutex> lock(mtx);
+                    const auto itr = plans.find(r->name);
+                    if (itr == plans.end() || !itr->second.loaded)return;
+                    const auto n = std::make_shared<RunData::PlanRunner>(r->name);
+                    n->restarts = r->restarts + 1;
+                    {
+                        std::unique_lock<std::recursive_mutex> lock_s(r->state_mtx);
+                        n->abandoned = r->abandoned;
+                        for (const auto &tname: stalled)
+                            if (const auto s = r->stats.find(tname); s != r->stats.end())
+                                n->abandoned[tname + "#" + std::to_string(n->restarts)] = s->second;
+                    }
+                    PlanInfo stuck;//被放弃但仍在运行的任务
+                    for (auto e = n->abandoned.begin(); e != n->abandoned.end();) {
+                        if (e->second->tid < 0) {
+                            e = n->abandoned.erase(e);
+                            continue;
+                        }
+                        const auto tname = e->first.substr(0, e->first.rfind('#'));
+                        if (const auto task = itr->second.tasks.find(tname); task != itr->second.tasks.end()) {
+                            auto &info = stuck.tasks[e->first] = task->second;
+                            info.budget = Budget::getBudget(tname, task->second);//名称带有后缀, 需先解析默认预算
+                        }
+                        ++e;
+                    }
+                    const auto reject = admitPlan(itr->second, &stuck);
+                    if (!reject.empty()) {
+                        ifr::logger::err("Plan", "Watchdog: restart over budget", r->name + ", " + reject);
+                        outMsg(POPUP, "Plan", "Over budget", r->name + ": " + reject);
+                        return;
+                    }
+                    std::unique_lock<std::mutex> lock_r(RunData::runners_mtx);
+                    auto &slot = RunData::runners[r->name];
+                    if (slot != r)return;//已被替换
+                    slot = n;
+                    lock_r.unlock();
+                    ifr::logger::log("Plan", "Watchdog: restart", r->name);
+                    outMsg(LOG, "Plan", "Watchdog", "restart " + r->name);
+                    n->start(itr->second);
                 });
                 while (!t.joinable());
                 t.detach();
             }
 
             /**
-             * 停止流程并重置
+             * 处理卡死的计划: 报告, 输出现场信息, 放弃当前批次并重启
+             * @details 卡死发生在停止阶段(3/4)时仅放弃, 不重启; 开启exitOnReset时直接退出程序, 交由外部守护进程重启
+             * @param r 运行实例
+             * @param state 卡死的阶段
+             * @param stalled 卡死的任务
              */
-            void reset() {
-                std::unique_lock<std::recursive_mutex> lock(RunData::running_mtx);
-                ifr::logger::log("Plan", "reset(): running", running ? "true" : "false");
-                outMsg(LOG, "Plan", "reset()", "running = " + std::string(running ? "true" : "false")
-                                               + ", eor = " + std::string(exitOnReset ? "true" : "false"));
+            void escalate(const std::shared_ptr<RunData::PlanRunner> &r, int state,
+                          const std::vector<std::string> &stalled) {
+                std::string names;
+                for (const auto &tname: stalled)names += (names.empty() ? "" : ", ") + tname;
+                const auto msg = r->name + " state " + std::to_string(state) + ": " + names;
+                ifr::logger::err("Plan", "Watchdog: stall", msg);
+                outMsg(POPUP, "Plan", "Stall", msg);
+                const auto info = dump(r, stalled);
+                ifr::logger::err("Plan", "Watchdog: dump", info);
+                outMsg(ERR, "Plan", "Watchdog", info);
 
                 if (exitOnReset) {
-                    ifr::logger::log("Plan", "reset()", "exit");
-                    exit(-10);
+                    ifr::logger::log("Plan", "Watchdog", "exit");
+                    exit(-11);
                 }
+                r->abandon();
+                if (state >= 3)return;
+                if (r->restarts >= maxRestarts) {
+                    ifr::logger::err("Plan", "Watchdog: restart limit", r->name);
+                    outMsg(POPUP, "Plan", "Restart limit", r->name);
+                    return;
+                }
+                restart(r, stalled);
+            }
 
-                if (!running)return;
-
-                untilStep(4, true);//结束
-                while (!finishingTasks.empty()) SLEEP(delay);
-
-                std::unique_lock<std::recursive_mutex> lock2(RunData::state_mtx);
-                state = 0;
-                runningTasks.clear();
-                waitingTasks.clear();
-                finishingTasks.clear();
-                lock2.unlock();
-
-                running = false;
+            /**检查所有运行中的计划*/
+            void check() {
+                const auto t = Stats::now();
+                for (const auto &r: RunData::getRunning()) {
+                    std::unique_lock<std::recursive_mutex> lock(r->state_mtx);
+                    const int state = r->state;
+                    if (state < 1 || state > 4)continue;
+                    const auto deadline = deadlines[state].load();
+                    if (deadline <= 0)continue;
+                    std::vector<std::string> stalled;
+                    for (const auto &tname: state == 2 ? r->runningTasks : r->waitingTasks) {
+                        const auto itr = r->stats.find(tname);
+                        const int64_t beat = itr == r->stats.end() ? 0 : itr->second->beat.load();
+                        if (t - std::max<int64_t>(beat, r->stateSince) > deadline)stalled.push_back(tname);
+                    }
+                    lock.unlock();
+                    if (!stalled.empty())escalate(r, state, stalled);
+                }
             }
 
-            /**
-             * 启动流程
-             */
-            bool start(const std::string &name) {
-                std::unique_lock<std::recursive_mutex> lock(RunData::running_mtx);
-                outMsg(LOG, "Plan", "start()", "running = " + std::string(running ? "true" : "false"));
-                if (running)reset();
-                currentPlan = name;
-
-                const int rid = ++runID;
-                const auto plan = plans[name];
-                if (!plan.loaded)return false;
-
-                std::unique_lock<std::recursive_mutex> lock2(RunData::state_mtx);
-
-                int cnt = 0;//任务启动计数
-                for (const auto &ele: plan.tasks) {
-                    const auto &tname = ele.first;
-                    const auto &task = ele.second;
-                    if (!task.enable)continue;
-                    cnt++;
-
-                    std::map<const std::string, TaskIOInfo> io(task.io.begin(), task.io.end());
-                    std::map<const std::string, std::string> args(task.args.begin(), task.args.end());
-                    runningTasks.insert(tname);
-
-                    const auto regTask = tasks[tname];
-                    std::thread t = std::thread(
-                            [](const auto regTask, const auto rid, const auto tname, auto io, auto args) {
-                                try {
-                                    regTask(io, args, &state, [&rid, &tname](const auto finish) {
-                                        std::unique_lock<std::recursive_mutex> lock(RunData::state_mtx);
-                                        if (runID != rid || finish != state)return;
-                                        waitingTasks.erase(tname);
-                                    });
-                                    std::unique_lock<std::recursive_mutex> lock(RunData::state_mtx);
-                                    if (runID == rid && state == 4)waitingTasks.erase(tname);//可以自动释放最后一步
-                                } catch (PlanError &err) {
-                                    ifr::logger::err("Plan", "PlanError", tname + ", " + err.what());
-                                    outMsg(POPUP, "Plan", "PlanError", tname + ": " + err.what());
-                                    std::thread t(reset);
-                                    while (!t.joinable());
-                                    t.detach();
-                                } catch (std::exception &err) {
-                                    ifr::logger::err("Plan", "Error", tname + ", " + err.what());
-                                    outMsg(POPUP, "Plan", "Error", tname + ": " + err.what());
-                                } catch (...) {
-                                    ifr::logger::err("Plan", "Error", tname);
-                                    outMsg(POPUP, "Plan", "UnknownError", tname);
-                                }
-                                ifr::logger::log("Plan", "Exit Running", tname);
-                                outMsg(POPUP, "Plan", "Exit Running", tname);
-                                if (runID != rid)return;
-                                std::unique_lock<std::recursive_mutex> lock(RunData::state_mtx);
-                                finishingTasks.erase(tname);
-                                runningTasks.erase(tname);
-                                waitingTasks.erase(tname);
-
-
-                                std::thread t(reset);//重置
-                                while (!t.joinable());
-                                t.detach();
-
-                            }, regTask, rid, tname, io, args);
-                    ifr::logger::log("Plan", "start() - " + tname, t.get_id());
-                    outMsg(LOG, "Plan", "start()", tname);
+            /**启动看门狗线程*/
+            void start() {
+                static std::once_flag flag;
+                std::call_once(flag, []() {
+                    std::thread t([]() {
+                        while (true) {
+                            SLEEP(RunData::delay);
+                            check();
+                        }
+                    });
                     while (!t.joinable());
                     t.detach();
-                }
-                finishingTasks = std::set<std::string>(runningTasks.begin(),
-                                                       runningTasks.end());
-                goStep(2);//进入运行阶段
-                return running = cnt > 0;
+                });
             }
         }
 
@@ -355,17 +1129,22 @@ namespace ifr {
             planListJson = "";
             plans[info.name] = info;
             writePlanInfo(info);
+            watchPlanInfo(info.name);
             cc.save();
-            if (currentPlans == info.name)stopPlan();
+            stopPlan(info.name);
         }
 
         bool removePlanInfo(const std::string &name) {
+            std::shared_ptr<void> watch;//在释放mtx后停止监视: 停止时等待可能正在等待mtx的回调
             std::unique_lock<std::recursive_mutex> lock(mtx);
             if (currentPlans == name)currentPlans = "";
             planListJson = "";
             plans.erase(name);
+            planHashes.erase(name);
+            if (const auto itr = planWatches.find(name); itr != planWatches.end())
+                watch.swap(itr->second), planWatches.erase(itr);
             cc.save();
-            stopPlan();
+            stopPlan(name);
             return true;
         }
 
@@ -373,35 +1152,177 @@ namespace ifr {
             std::unique_lock<std::recursive_mutex> lock(mtx);
             ifr::logger::log("Plan", "usePlan", name);
             if (currentPlans != name) {
+                const auto last = currentPlans;
                 currentPlans = name;
                 cc.save();
-                stopPlan();
+                stopPlan(last);
             }
         }
 
-        /**启动计划*/
         bool startPlan() {
             std::unique_lock<std::recursive_mutex> lock(mtx);
-            ifr::logger::log("Plan", "startPlan", currentPlans);
-            if (currentPlans.empty() || !plans[currentPlans].loaded)return false;
-            return RunData::start(currentPlans);
+            return startPlan(currentPlans);
+        }
+
+        bool startPlan(const std::string &name) {
+            std::unique_lock<std::recursive_mutex> lock(mtx);
+            ifr::logger::log("Plan", "startPlan", name);
+            const auto itr = plans.find(name);
+            if (name.empty() || itr == plans.end() || !itr->second.loaded)return false;
+
+            const auto reject = admitPlan(itr->second);
+            if (!reject.empty()) {
+                ifr::logger::err("Plan", "startPlan: over budget", name + ", " + reject);
+                outMsg(POPUP, "Plan", "Over budget", name + ": " + reject);
+                return false;
+            }
+            Watchdog::start();
+            const auto r = RunData::get(name, true);
+            r->restarts = 0;
+            return r->start(itr->second);
         }
 
         void stopPlan() {
-            ifr::logger::log("Plan", "stopPlan");
-            RunData::reset();
+            std::unique_lock<std::recursive_mutex> lock(mtx);
+            stopPlan(currentPlans);
+        }
+
+        void stopPlan(const std::string &name) {
+            ifr::logger::log("Plan", "stopPlan", name);
+            if (const auto r = RunData::get(name))r->reset();
+        }
+
+        bool isRunning() {
+            std::unique_lock<std::recursive_mutex> lock(mtx);
+            return isRunning(currentPlans);
         }
 
-        bool isRunning() { return RunData::running; }
+        bool isRunning(const std::string &name) {
+            const auto r = RunData::get(name);
+            return r && r->running;
+        }
+
+        int getState() {
+            std::unique_lock<std::recursive_mutex> lock(mtx);
+            return getState(currentPlans);
+        }
 
-        int getState() { return RunData::state; }
+        int getState(const std::string &name) {
+            const auto r = RunData::get(name);
+            return r ? r->state : 0;
+        }
+
+        std::vector<std::string> getRunningPlans() {
+            std::vector<std::string> vec;
+            for (const auto &r: RunData::getRunning())vec.push_back(r->name);
+            return vec;
+        }
+
+        std::string getTaskLatencyJson(const std::string &name) {
+            StringBuffer buf;
+            Writer<StringBuffer> w(buf);
+
+            w.StartObject();
+            if (const auto r = RunData::get(name)) {
+                std::unique_lock<std::recursive_mutex> lock(r->state_mtx);
+                w.Key("tasks"), w.StartObject();
+                for (const auto &e: r->stats)w.Key(e.first), (*e.second)(w);
+                w.EndObject();
+                w.Key("shadows"), w.StartObject();
+                for (const auto &e: r->shadows)w.Key(e.first), w.String(e.second);
+                w.EndObject();
+            }
+            w.EndObject();
+            w.Flush();
+
+            return buf.GetString();
+        }
 
         void setExitOnReset(bool eor) { exitOnReset = eor; }
 
+        void setBudgetCapacity(double cpu, double memory) {
+            std::unique_lock<std::recursive_mutex> lock(mtx);
+            Budget::capacityCpu = cpu;
+            Budget::capacityMemory = memory;
+        }
+
+        std::string checkPlanBudget(const std::string &name) {
+            std::unique_lock<std::recursive_mutex> lock(mtx);
+            const auto itr = plans.find(name);
+            if (itr == plans.end() || !itr->second.loaded)return "plan not found: " + name;
+            return Budget::admit({&itr->second});
+        }
+
+        std::string getPlanUsageJson() {
+            std::unique_lock<std::recursive_mutex> lock(mtx);
+            StringBuffer buf;
+            Writer<StringBuffer> w(buf);
+
+            w.StartObject();
+            w.Key("capacity"), TaskBudget{Budget::getCpuCapacity(), Budget::getMemoryCapacity()}(w);
+            w.Key("rss"), w.Double(Budget::readRssMB());
+            w.Key("plans"), w.StartObject();
+            std::unique_lock<std::mutex> lock_u(Budget::usage_mtx);
+            for (auto &p: Budget::threads) {
+                const auto plan = plans.find(p.first);
+                w.Key(p.first), w.StartObject();
+                for (auto &e: p.second) {
+                    double cpu = 0;
+                    for (auto itr = e.second.begin(); itr != e.second.end();) {
+                        const auto usage = Budget::sample(*itr);
+                        if (usage < 0) {
+                            Budget::samples.erase(*itr);
+                            itr = e.second.erase(itr);
+                        } else cpu += usage, itr++;
+                    }
+                    TaskBudget budget;
+                    if (plan != plans.end()) {
+                        const auto task = plan->second.tasks.find(e.first);
+                        if (task != plan->second.tasks.end())budget = Budget::getBudget(e.first, task->second);
+                    }
+                    w.Key(e.first), w.StartObject();
+                    w.Key("budget"), budget(w);
+                    w.Key("cpu"), w.Double(cpu);
+                    w.Key("threads"), w.Uint((unsigned) e.second.size());
+                    w.Key("over"), w.Bool(budget.cpu > 0 && cpu > budget.cpu);
+                    w.EndObject();
+                }
+                w.EndObject();
+            }
+            lock_u.unlock();
+            w.EndObject();
+            w.EndObject();
+            w.Flush();
+
+            return buf.GetString();
+        }
+
+        void setWatchdogDeadline(int state, double seconds) {
+            if (state < 0 || state > 4)return;
+            Watchdog::deadlines[state] = (int64_t) (seconds * 1e9);
+        }
+
+        void setWatchdogRestarts(int max) { Watchdog::maxRestarts = max; }
+
+        void Tools::heartbeat() {
+            if (Stats::current)Stats::current->beat = Stats::now();
+        }
+
+        void Tools::registerWorker(const std::string &task) {
+            for (const auto &r: RunData::getRunning()) {
+                std::unique_lock<std::recursive_mutex> lock(r->state_mtx);
+                if (!r->runningTasks.count(task))continue;
+                Stats::current = r->stats[task];
+                lock.unlock();
+                Budget::registerThread(r->name, task);
+                return;
+            }
+        }
+
         void registerMsgOut(const MsgOutter &o) {
             hasOutter = true;
             outter = o;
         }
 
     }
-} // ifr
\ No newline at end of file
+} // ifr
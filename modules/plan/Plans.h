@@ -15,11 +15,15 @@
 #include <vector>
 #include <atomic>
 #include <thread>
+#include <memory>
+#include <cstdlib>
 #include "set"
 #include "map"
 #include "config/config.h"
+#include "config/schema.h"
 #include "tools/tools.hpp"
 #include "logger/logger.hpp"
+#include "msg/msg.hpp"
 
 
 #define COMMON_LOOP_WAIT 500 //通用的循环等待时长 (ms) 即每到此值一次就需要尽快退出等待并判断state
@@ -101,6 +105,45 @@ namespace ifr {
 
         };
 
+        /**
+         * 任务的资源预算
+         * @details 所有数值小于等于0时表示不限制
+         */
+        struct TaskBudget {
+            /**CPU份额 (核心数, 包括任务自行创建的工作线程) */
+            double cpu = 0;
+            /**内存预算 (MB) */
+            double memory = 0;
+
+            /**@return 是否未设置任何预算*/
+            [[nodiscard]] bool empty() const { return cpu <= 0 && memory <= 0; }
+
+            /**
+             * 使用另一个预算覆盖此预算 (仅覆盖设置过的值)
+             * @param o 覆盖的预算
+             * @return 覆盖后的预算
+             */
+            [[nodiscard]] TaskBudget override(const TaskBudget &o) const {
+                return {o.cpu > 0 ? o.cpu : cpu, o.memory > 0 ? o.memory : memory};
+            }
+
+            static auto schema() {
+                using Config::Schema::field;
+                return std::make_tuple(field("cpu", &TaskBudget::cpu), field("memory", &TaskBudget::memory));
+            }
+
+            template<class T>
+            void operator()(rapidjson::Writer<T> &jout) const { Config::Schema::write(jout, *this); }
+
+            static TaskBudget read(json_in &jin) {
+                TaskBudget t;
+                if (!jin.IsObject())return t;
+                if (jin.HasMember("cpu") && jin["cpu"].IsNumber())t.cpu = jin["cpu"].GetDouble();
+                if (jin.HasMember("memory") && jin["memory"].IsNumber())t.memory = jin["memory"].GetDouble();
+                return t;
+            }
+        };
+
         /**任务的描述信息*/
         struct TaskDescription {
             /**任务所属的组别 */
@@ -115,6 +158,9 @@ namespace ifr {
 
             std::string extra;
 
+            /**任务的默认资源预算 */
+            TaskBudget budget;
+
 
             template<class T>
             void operator()(rapidjson::Writer<T> &jout) const {
@@ -134,6 +180,7 @@ namespace ifr {
                     jout.EndObject();
                 }
                 jout.Key("extra"), jout.String(extra);
+                jout.Key("budget"), budget(jout);
                 jout.EndObject();
             }
 
@@ -148,6 +195,8 @@ namespace ifr {
                     for (auto &m: jin["args"].GetObj())t.args[m.name.GetString()] = TaskArgDescription::read(m.value);
                 if (jin["extra"].IsString())
                     t.extra = jin["extra"].GetString();
+                if (jin.HasMember("budget"))
+                    t.budget = TaskBudget::read(jin["budget"]);
                 return t;
             }
 
@@ -159,17 +208,13 @@ namespace ifr {
             std::string channel;
 
 
-            template<class T>
-            void operator()(rapidjson::Writer<T> &jout) const {
-                jout.StartObject();
-                jout.Key("channel"), jout.String(channel);
-                jout.EndObject();
+            static auto schema() {
+                using Config::Schema::field;
+                return std::make_tuple(field("channel", &TaskIOInfo::channel).required());
             }
 
-
-            static TaskIOInfo read(json_in &jin) {
-                return {jin["channel"].GetString()};
-            }
+            template<class T>
+            void operator()(rapidjson::Writer<T> &jout) const { Config::Schema::write(jout, *this); }
         };
 
         /**一个任务的数据 */
@@ -182,38 +227,41 @@ namespace ifr {
             /**任务参数 (参数名-数据) */
             std::map<std::string, std::string> args;
 
+            /**资源预算, 覆盖任务描述中的默认预算 */
+            TaskBudget budget;
 
-            template<class T>
-            void operator()(rapidjson::Writer<T> &jout) const {
-                jout.StartObject();
-                jout.Key("enable"), jout.Bool(enable);
-                jout.Key("io");
-                {
-                    jout.StartObject();
-                    for (const auto &e: io)jout.Key(e.first), e.second(jout);
-                    jout.EndObject();
-                }
-                jout.Key("args");
-                {
-                    jout.StartObject();
-                    for (const auto &e: args)jout.Key(e.first), jout.String(e.second);
-                    jout.EndObject();
-                }
-                jout.EndObject();
+            /**
+             * 影子任务: 被比较的任务名称, 为空表示普通任务
+             * @details 影子任务的输入使用被比较任务同名IO的频道, 输出写入无人订阅的镜像频道, 用于比较不同实现的耗时
+             */
+            std::string shadow;
+
+
+            static auto schema() {
+                using Config::Schema::field;
+                return std::make_tuple(
+                        field("enable", &TaskInfo::enable).required(),
+                        field("io", &TaskInfo::io).required(),
+                        field("args", &TaskInfo::args),
+                        field("budget", &TaskInfo::budget),
+                        field("shadow", &TaskInfo::shadow)
+                );
             }
 
-
-            static TaskInfo read(json_in &jin) {
-                TaskInfo t = {
-                        jin["enable"].GetBool(),
-                };
-                for (auto &m: jin["io"].GetObj())t.io[m.name.GetString()] = TaskIOInfo::read(m.value);
-                if (jin["args"].IsObject())
-                    for (auto &m: jin["args"].GetObj())t.args[m.name.GetString()] = m.value.GetString();
-                return t;
-            }
+            template<class T>
+            void operator()(rapidjson::Writer<T> &jout) const { Config::Schema::write(jout, *this); }
         };
 
+        /**
+         * 影子任务的镜像输出频道
+         * @param channel 原频道
+         * @param task 影子任务名称
+         * @return 镜像频道
+         */
+        inline std::string shadowChannel(const std::string &channel, const std::string &task) {
+            return channel + "@shadow:" + task;
+        }
+
         /**流程信息*/
         struct PlanInfo {
             PlanInfo() : loaded(false) {};
@@ -226,34 +274,162 @@ namespace ifr {
             std::map<const std::string, TaskInfo> tasks;
 
 
-            template<class T>
-            void operator()(rapidjson::Writer<T> &jout) const {
-                jout.StartObject();
-                jout.Key("name"), jout.String(name);
-                jout.Key("description"), jout.String(description);
-                jout.Key("tasks");
-                {
-                    jout.StartObject();
-                    for (const auto &e: tasks)jout.Key(e.first), e.second(jout);
-                    jout.EndObject();
-                }
-                jout.EndObject();
+            /**检查计划名称是否合格 (用作文件名)*/
+            static bool checkName(const std::string &str) {
+                return std::all_of(str.begin(), str.end(), [](const auto &x) {
+                    return (('a' <= x && x <= 'z') || ('A' <= x && x <= 'Z') || ('0' <= x && x <= '9') || x == '_' ||
+                            x == ' ' || x == '-');
+                });
             }
 
-            static PlanInfo read(json_in &jin) {
+            static auto schema() {
+                using Config::Schema::field;
+                return std::make_tuple(
+                        field("name", &PlanInfo::name).required().check([](const std::string &s) {
+                            return !s.empty() && checkName(s);
+                        }, "bad plan name"),
+                        field("description", &PlanInfo::description).required(),
+                        field("tasks", &PlanInfo::tasks).required()
+                );
+            }
+
+            template<class T>
+            void operator()(rapidjson::Writer<T> &jout) const { Config::Schema::write(jout, *this); }
+
+            /**
+             * @brief 从json文本读取
+             * @param json json文本
+             * @param error 失败的原因
+             * @return 计划信息, 失败时未加载(loaded=false)
+             */
+            static PlanInfo read(std::string_view json, std::string &error) {
                 PlanInfo t;
-                t.name = jin["name"].GetString();
-                t.description = jin["description"].GetString();
-                for (auto &m: jin["tasks"].GetObj())t.tasks[m.name.GetString()] = TaskInfo::read(m.value);
-                t.loaded = true;
+                if (Config::Schema::read(json, t, error))t.loaded = true;
+                else t = {};
                 return t;
             }
-
         };
 
         /**全部任务的描述信息*/
         typedef std::map<std::string, TaskDescription> TaskDescriptions;
 
+        /**一个已转换的任务参数*/
+        struct TaskArgValue {
+            /**值类型*/
+            TaskArgType type{};
+            /**原始字符串*/
+            std::string str;
+            /**数字值 (NUMBER)*/
+            double number = 0;
+            /**整数值 (NUMBER, 向零取整)*/
+            int64_t integer = 0;
+            /**布尔值 (BOOL)*/
+            bool boolean = false;
+
+            /**
+             * 按类型转换参数
+             * @param type 值类型
+             * @param str 原始字符串
+             * @return 转换后的参数
+             * @throw std::invalid_argument 无法转换
+             */
+            static TaskArgValue parse(TaskArgType type, const std::string &str) {
+                TaskArgValue v{type, str};
+                switch (type) {
+                    case NUMBER: {
+                        const char *begin = str.c_str();
+                        char *end = nullptr;
+                        v.number = std::strtod(begin, &end);
+                        if (end == begin || *end != '\0')
+                            throw std::invalid_argument("not a number: \"" + str + "\"");
+                        v.integer = (int64_t) v.number;
+                        v.boolean = v.number != 0;
+                        break;
+                    }
+                    case BOOL: {
+                        if (str == "true" || str == "1")v.boolean = true;
+                        else if (str == "false" || str == "0" || str.empty())v.boolean = false;
+                        else throw std::invalid_argument("not a bool: \"" + str + "\"");
+                        v.number = (double) (v.integer = v.boolean);
+                        break;
+                    }
+                    default:
+                        break;
+                }
+                return v;
+            }
+        };
+
+        /**
+         * 已转换的任务参数
+         * @details 在计划启动时根据任务描述校验并转换, 参数按任务描述中参数名的顺序排列,
+         * @details 任务在初始化阶段通过 index 获取下标后, 即可O(1)访问, 无需查找及转换
+         */
+        class TaskArgs {
+        private:
+            std::shared_ptr<const std::map<std::string, size_t>> indexes;//参数名 - 下标
+            std::vector<TaskArgValue> values;//参数值
+            std::map<const std::string, std::string> extras;//任务描述中不存在的参数 (原样保留)
+        public:
+            TaskArgs() : indexes(std::make_shared<std::map<std::string, size_t>>()) {}
+
+            /**
+             * 根据任务描述校验并转换参数
+             * @param task 任务名称
+             * @param description 任务描述
+             * @param args 计划中设置的参数 (未设置的参数使用默认值)
+             * @return 转换后的参数
+             * @throw PlanError 参数无法转换
+             */
+            static TaskArgs parse(const std::string &task, const TaskDescription &description,
+                                  const std::map<std::string, std::string> &args) {
+                TaskArgs t;
+                auto indexes = std::make_shared<std::map<std::string, size_t>>();
+                t.values.reserve(description.args.size());
+                for (const auto &e: description.args) {
+                    const auto itr = args.find(e.first);
+                    const auto &str = itr == args.end() ? e.second.defaultValue : itr->second;
+                    try {
+                        t.values.push_back(TaskArgValue::parse(e.second.type, str));
+                    } catch (std::exception &err) {
+                        throw PlanError("Bad arg " + task + "." + e.first + ": " + err.what());
+                    }
+                    (*indexes)[e.first] = t.values.size() - 1;
+                }
+                for (const auto &e: args)if (!indexes->count(e.first))t.extras.insert(e);
+                t.indexes = indexes;
+                return t;
+            }
+
+            /**
+             * 获取参数下标
+             * @param name 参数名
+             * @return 下标
+             * @throw PlanError 参数不存在
+             */
+            [[nodiscard]] size_t index(const std::string &name) const {
+                const auto itr = indexes->find(name);
+                if (itr == indexes->end())throw PlanError("No such arg: " + name);
+                return itr->second;
+            }
+
+            /**@return 下标对应的参数*/
+            const TaskArgValue &operator[](size_t i) const { return values[i]; }
+
+            /**@return 参数名对应的参数 (需要查找, 应在初始化阶段使用)*/
+            const TaskArgValue &operator[](const std::string &name) const { return values[index(name)]; }
+
+            /**@return 参数数量*/
+            [[nodiscard]] size_t size() const { return values.size(); }
+
+            /**@return 字符串形式的参数, 用于兼容旧的任务运行体*/
+            [[nodiscard]] std::map<const std::string, std::string> toMap() const {
+                auto map = extras;
+                for (const auto &e: *indexes)map[e.first] = values[e.second].str;
+                return map;
+            }
+        };
+
         /**
          * 任务运行体
          *
@@ -273,6 +449,20 @@ namespace ifr {
                                    const int *,
                                    const std::function<void(const int)>)> Task;
 
+        /**
+         * 任务运行体 (已转换参数)
+         *
+         * 阶段同 Task, 参数在计划启动时已校验并转换, 转换失败时计划不会启动
+         *
+         * @param arg1 每个IO对应的数据
+         * @param arg2 已转换的参数
+         * @param arg3 阶段数字, 会随着状态不同而改变, 只读
+         * @param arg4 阶段完成的回调函数, 要传入完成的阶段数字
+         */
+        typedef std::function<void(const std::map<const std::string, TaskIOInfo> &, const TaskArgs &,
+                                   const int *,
+                                   const std::function<void(const int)> &)> TypedTask;
+
         /**
          * 初始化操作, 包括读取流程等
          */
@@ -287,6 +477,15 @@ namespace ifr {
          */
         void registerTask(const std::string &name, const TaskDescription &description, const Task &registerTask);
 
+        /**
+         * 注册一个任务 (已转换参数)
+         * @param name 任务名称
+         * @param description 任务说明
+         * @param registerTask 运行体
+         */
+        void registerTypedTask(const std::string &name, const TaskDescription &description,
+                               const TypedTask &registerTask);
+
         /***
          * 获取全部任务的描述信息
          * @return json
@@ -301,10 +500,18 @@ namespace ifr {
 
         /**
          * 获取流程状态
+         * @details 当前选中计划的状态, 及所有运行中计划的阶段
          * @return json
          */
         std::string getPlanStateJson();
 
+        /**
+         * 获取指定计划的状态
+         * @param name 计划名称
+         * @return json
+         */
+        std::string getPlanStateJson(const std::string &name);
+
         /**@return 计划列表*/
         std::vector<std::string> getPlanList();
 
@@ -335,21 +542,95 @@ namespace ifr {
          */
         void usePlanInfo(const std::string &name);
 
-        /**启动计划*/
+        /**启动当前选中的计划*/
         bool startPlan();
 
-        /**停止计划*/
+        /**
+         * 启动指定计划
+         * @details 每个计划拥有独立的运行实例, 可以与其他计划同时运行,
+         * @details 计划之间通过相同的频道名共享数据 (被多个运行中计划使用的频道会被标记为 Msg 共享频道)
+         * @param name 计划名称
+         * @return 是否成功启动
+         */
+        bool startPlan(const std::string &name);
+
+        /**停止当前选中的计划*/
         void stopPlan();
 
-        /**@return 是否正在运行计划*/
+        /**
+         * 停止指定计划
+         * @param name 计划名称
+         */
+        void stopPlan(const std::string &name);
+
+        /**@return 当前选中的计划是否正在运行*/
         bool isRunning();
 
-        /**@return 当前状态*/
+        /**
+         * @param name 计划名称
+         * @return 指定计划是否正在运行
+         */
+        bool isRunning(const std::string &name);
+
+        /**@return 当前选中计划的状态*/
         int getState();
 
+        /**
+         * @param name 计划名称
+         * @return 指定计划的状态
+         */
+        int getState(const std::string &name);
+
+        /**@return 所有运行中的计划*/
+        std::vector<std::string> getRunningPlans();
+
+        /**
+         * 获取计划中每个任务的单帧耗时
+         * @details 单帧耗时为任务线程从接收输入(Msg pop)到发布输出(Msg push)的时间, 同时给出影子任务与被比较任务的对应关系
+         * @param name 计划名称
+         * @return json
+         */
+        std::string getTaskLatencyJson(const std::string &name);
+
+        /**
+         * 设置看门狗在指定阶段的超时时间
+         * @details 阶段1/3/4: 未完成当前阶段的任务超过此时间没有心跳; 阶段2: 运行中的任务超过此时间没有心跳
+         * @details 默认: 阶段1 = 30s, 阶段2 = 不检测, 阶段3/4 = 10s
+         * @param state 阶段
+         * @param seconds 超时时间(秒), 小于等于0表示不检测
+         */
+        void setWatchdogDeadline(int state, double seconds);
+
+        /**
+         * 设置看门狗自动重启计划的次数上限 (默认3次, 手动启动计划时重新计数)
+         * @param max 次数上限
+         */
+        void setWatchdogRestarts(int max);
+
         /**重置时退出程序*/
         void setExitOnReset(bool exitOnReset);
 
+        /**
+         * 设置资源容量, 启动计划时所有启用任务的预算之和不得超过此容量
+         * @param cpu 可用CPU核心数 (小于等于0: 使用硬件线程数)
+         * @param memory 可用内存, 单位MB (小于等于0: 使用系统当前可用内存)
+         */
+        void setBudgetCapacity(double cpu, double memory);
+
+        /**
+         * 检查计划能否在资源预算内启动
+         * @param name 计划名称
+         * @return 错误信息, 为空表示通过
+         */
+        std::string checkPlanBudget(const std::string &name);
+
+        /**
+         * 获取运行中任务的资源占用
+         * @details 按线程(TID)统计CPU占用, 内存仅能按进程统计
+         * @return json
+         */
+        std::string getPlanUsageJson();
+
 
         enum msgType {
             /**日志*/
@@ -369,6 +650,21 @@ namespace ifr {
         void registerMsgOut(const MsgOutter &outter);
 
         namespace Tools {
+            /**
+             * 将当前线程登记为任务的工作线程, 用于资源统计
+             * @details 任务运行体所在线程会自动登记, 任务自行创建的线程需要调用此函数
+             * @details 若多个运行中的计划都包含此任务, 则登记到第一个计划
+             * @param task 任务名称
+             */
+            void registerWorker(const std::string &task);
+
+            /**
+             * 发送心跳, 用于看门狗检测
+             * @details 任务线程收发Msg消息及完成阶段时会自动发送心跳, 长时间不收发消息的任务需要定期调用此函数
+             * @details 仅在任务运行主体所在线程及已登记的工作线程中有效
+             */
+            void heartbeat();
+
             /**
              * 等待状态开始
              * @param state 当前状态
@@ -0,0 +1,334 @@
+#ifndef COMMON_MODULES_RECORDER_HPP
+#define COMMON_MODULES_RECORDER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <charconv>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <initializer_list>
+#include "tools/ext_funcs.h"
+
+#if __OS__ == __OS_Linux__
+
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+#endif
+
+/**
+ * 飞行记录仪模块
+ *
+ * 固定大小的内存环形缓冲区, 记录最近的日志、计划事件及Msg频道统计;
+ * 进程崩溃(SIGSEGV/SIGABRT等)时由信号处理器写入文件, 只使用异步信号安全的函数
+ */
+namespace ifr {
+    namespace Recorder {
+        static const constexpr size_t slot_amount = 1 << 11;//记录数量 (2的幂)
+        static const constexpr size_t text_size = 232;//每条记录的最大长度
+        static const constexpr size_t max_channels = 64;//统计的Msg频道数量上限
+        static const constexpr size_t channel_name_size = 48;//频道名称最大长度(含结尾0)
+        static const constexpr size_t path_size = 256;//输出文件路径最大长度(含结尾0)
+
+        /**记录类别*/
+        enum Kind : uint8_t {
+            USER = 0,//用户自定义
+            LOG = 1,//日志
+            PLAN = 2,//计划事件
+        };
+
+        /**一条记录*/
+        struct Slot {
+            std::atomic<uint64_t> seq{0};//写入序号+1, 0为正在写入
+            int64_t ts;//时间 (ns, system_clock)
+            uint8_t kind;//类别
+            uint8_t level;//日志级别, 与logger::Level一致
+            uint16_t len;//长度
+            char text[text_size];
+        };
+        static_assert(sizeof(Slot) == 256, "Slot should be 256 bytes");
+
+        /**一个Msg频道的统计, 由发布者/订阅者更新*/
+        struct Channel {
+            char name[channel_name_size];
+            std::atomic<uint64_t> pushes{0}, pops{0};//发布/接收次数
+            std::atomic<int64_t> last_push{0}, last_pop{0};//最后一次发布/接收的时间 (ns)
+        };
+
+        inline std::atomic_bool enabled_{false};//是否记录 (install后开启)
+        inline Slot slots[slot_amount];
+        inline std::atomic<uint64_t> head{0};//已写入的记录总数
+        inline Channel channels[max_channels];
+        inline std::atomic<size_t> channel_count{0};
+        inline std::mutex channel_mtx;//访问锁: 注册频道
+        inline char dump_path[path_size];//崩溃时的输出文件
+        inline std::atomic_flag dumping = ATOMIC_FLAG_INIT;//是否正在输出 (只输出一次)
+
+        /**@return 当前时间 (ns, system_clock)*/
+        inline int64_t now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+        /**@return 是否正在记录*/
+        inline bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief 获取频道的统计
+         * @details 加锁, 应在注册发布者/订阅者时调用并保存结果; 同名频道共用一个统计
+         * @param name 频道名称
+         * @return 统计, 超出数量上限时为空
+         */
+        inline Channel *channel(std::string_view name) {
+            std::unique_lock<std::mutex> lock(channel_mtx);
+            const auto n = channel_count.load(std::memory_order_relaxed);
+            name = name.substr(0, channel_name_size - 1);
+            for (size_t i = 0; i < n; i++)if (name == channels[i].name)return &channels[i];
+            if (n >= max_channels)return nullptr;
+            std::memcpy(channels[n].name, name.data(), name.size());
+            channels[n].name[name.size()] = 0;
+            channel_count.store(n + 1, std::memory_order_release);
+            return &channels[n];
+        }
+
+        /**记录一次发布, 未开启记录或统计为空时不做任何事*/
+        inline void pushed(Channel *c) {
+            if (!c || !enabled())return;
+            c->pushes.fetch_add(1, std::memory_order_relaxed), c->last_push.store(now(), std::memory_order_relaxed);
+        }
+
+        /**记录一次接收, 未开启记录或统计为空时不做任何事*/
+        inline void popped(Channel *c) {
+            if (!c || !enabled())return;
+            c->pops.fetch_add(1, std::memory_order_relaxed), c->last_pop.store(now(), std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief 记录一条文本
+         * @details 各部分依次拼接, 超出长度的部分被截断; 多个线程可同时写入
+         * @param kind 类别
+         * @param level 级别
+         * @param parts 文本
+         */
+        inline void record(Kind kind, uint8_t level, std::initializer_list<std::string_view> parts) {
+            if (!enabled())return;
+            const auto i = head.fetch_add(1, std::memory_order_relaxed);
+            auto &s = slots[i & (slot_amount - 1)];
+            s.seq.store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            s.ts = now(), s.kind = kind, s.level = level;
+            size_t len = 0;
+            for (const auto &p: parts) {
+                const auto n = std::min(p.size(), text_size - len);
+                std::memcpy(s.text + len, p.data(), n), len += n;
+            }
+            s.len = (uint16_t) len;
+            s.seq.store(i + 1, std::memory_order_release);
+        }
+
+        /**固定长度的文本缓冲区, 用于不分配内存地拼接记录*/
+        struct Text {
+            char buf[text_size];
+            size_t len = 0;
+
+            inline Text &add(std::string_view s) {
+                const auto n = std::min(s.size(), text_size - len);
+                std::memcpy(buf + len, s.data(), n), len += n;
+                return *this;
+            }
+
+            template<class T>
+            inline Text &num(T v) {
+                len = std::to_chars(buf + len, buf + text_size, v).ptr - buf;
+                return *this;
+            }
+
+            inline operator std::string_view() const { return {buf, len}; }
+        };
+
+#if __OS__ == __OS_Linux__
+        namespace Signal {
+            /**写入文件的缓冲区, 只使用write*/
+            struct Out {
+                int fd;
+                char buf[4096];
+                size_t len = 0;
+
+                void flush() {
+                    for (size_t p = 0; p < len;) {
+                        const auto n = ::write(fd, buf + p, len - p);
+                        if (n <= 0)break;
+                        p += (size_t) n;
+                    }
+                    len = 0;
+                }
+
+                Out &add(const char *s, size_t n) {
+                    if (len + n > sizeof(buf))flush();
+                    if (n > sizeof(buf))n = sizeof(buf);
+                    std::memcpy(buf + len, s, n), len += n;
+                    return *this;
+                }
+
+                Out &add(const char *s) { return add(s, std::strlen(s)); }
+
+                Out &num(int64_t v) {
+                    char tmp[24];
+                    const auto e = std::to_chars(tmp, tmp + sizeof(tmp), v).ptr;//不分配内存, 不依赖locale
+                    return add(tmp, e - tmp);
+                }
+
+                /**时间: 秒.毫秒 (UTC)*/
+                Out &time(int64_t ns) {
+                    char ms[4] = {(char) ('0' + ns / 100000000 % 10), (char) ('0' + ns / 10000000 % 10),
+                                  (char) ('0' + ns / 1000000 % 10), 0};
+                    return num(ns / 1000000000).add(".").add(ms, 3);
+                }
+            };
+
+            inline const char *kindName(uint8_t k) {
+                static const char *const names[] = {"user", "log", "plan"};
+                return k < sizeof(names) / sizeof(names[0]) ? names[k] : "unknown";
+            }
+
+            inline const char *levelName(uint8_t l) {
+                static const char *const names[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "OFF"};
+                return l < sizeof(names) / sizeof(names[0]) ? names[l] : "?";
+            }
+        }
+
+        /**
+         * @brief 将所有记录写入文件描述符
+         * @details 异步信号安全: 只读取原子变量及固定数组, 只调用write; 正在写入的记录被跳过
+         * @param fd 文件描述符
+         * @param reason 原因, 写在第一行
+         */
+        inline void dumpTo(int fd, const char *reason) {
+            Signal::Out out{fd};
+            out.add("# ifr flight recorder: ").add(reason).add(", pid ").num(getpid()).add("\n");
+            const auto h = head.load(std::memory_order_acquire);
+            for (auto i = h > slot_amount ? h - slot_amount : 0; i < h; i++) {
+                const auto &s = slots[i & (slot_amount - 1)];
+                if (s.seq.load(std::memory_order_acquire) != i + 1)continue;
+                out.time(s.ts).add(" ").add(Signal::kindName(s.kind)).add(" ");
+                if (s.kind == LOG)out.add(Signal::levelName(s.level)).add(" ");
+                out.add(s.text, std::min<size_t>(s.len, text_size)).add("\n");
+            }
+            const auto n = std::min(channel_count.load(std::memory_order_acquire), max_channels);
+            for (size_t i = 0; i < n; i++) {
+                const auto &c = channels[i];
+                out.add("msg ").add(c.name);
+                out.add(" push=").num((int64_t) c.pushes.load(std::memory_order_relaxed));
+                out.add(" pop=").num((int64_t) c.pops.load(std::memory_order_relaxed));
+                out.add(" last_push=").time(c.last_push.load(std::memory_order_relaxed));
+                out.add(" last_pop=").time(c.last_pop.load(std::memory_order_relaxed)).add("\n");
+            }
+            out.flush();
+        }
+
+        /**
+         * @brief 将所有记录写入文件 (覆盖)
+         * @details 异步信号安全
+         * @return 是否成功
+         */
+        inline bool dump(const char *path, const char *reason = "manual") {
+            const int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0)return false;
+            dumpTo(fd, reason);
+            ::close(fd);
+            return true;
+        }
+
+        namespace Signal {
+            static const constexpr int signals[] = {SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL};
+            inline struct sigaction previous[sizeof(signals) / sizeof(signals[0])];
+
+            inline const char *signalName(int sig) {
+                switch (sig) {
+                    case SIGSEGV:return "SIGSEGV";
+                    case SIGABRT:return "SIGABRT";
+                    case SIGBUS:return "SIGBUS";
+                    case SIGFPE:return "SIGFPE";
+                    case SIGILL:return "SIGILL";
+                    default:return "signal";
+                }
+            }
+
+            /**输出后恢复原有的处理器并重新发送信号, 保留默认行为(如生成core)*/
+            inline void handler(int sig) {
+                if (!dumping.test_and_set())dump(dump_path, signalName(sig));
+                for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++)
+                    if (signals[i] == sig)sigaction(sig, &previous[i], nullptr);
+                raise(sig);
+            }
+        }
+
+        /**
+         * @brief 为当前线程设置备用信号栈
+         * @details 备用信号栈是线程属性: 未设置的线程栈溢出(SIGSEGV)时无法执行处理器;
+         * 已设置(包括由其他代码设置)时不做任何事, 线程退出时释放
+         */
+        inline void altStack() {
+            thread_local struct Holder {
+                stack_t ss{};
+
+                ~Holder() {
+                    if (!ss.ss_sp)return;
+                    stack_t off{};
+                    off.ss_flags = SS_DISABLE;
+                    sigaltstack(&off, nullptr);
+                    std::free(ss.ss_sp);
+                }
+            } holder;
+            stack_t cur{};
+            if (holder.ss.ss_sp || (sigaltstack(nullptr, &cur) == 0 && !(cur.ss_flags & SS_DISABLE)))return;
+            const size_t size = std::max<size_t>(SIGSTKSZ, 64 << 10);
+            holder.ss.ss_sp = std::malloc(size), holder.ss.ss_size = size, holder.ss.ss_flags = 0;
+            if (holder.ss.ss_sp && sigaltstack(&holder.ss, nullptr) != 0)std::free(holder.ss.ss_sp), holder.ss.ss_sp = nullptr;
+        }
+
+        /**
+         * @brief 开始记录并安装崩溃信号处理器
+         * @details 处理SIGSEGV/SIGABRT/SIGBUS/SIGFPE/SIGILL; 只应调用一次
+         * @details 为调用线程设置备用信号栈, 其他线程需自行调用altStack (Plan的任务线程自动调用)
+         * @param path 崩溃时输出的文件
+         */
+        inline void install(const std::string &path) {
+            const auto n = std::min(path.size(), path_size - 1);
+            std::memcpy(dump_path, path.data(), n), dump_path[n] = 0;
+            enabled_ = true;
+            altStack();
+            for (size_t i = 0; i < sizeof(Signal::signals) / sizeof(Signal::signals[0]); i++) {
+                struct sigaction sa{};
+                sa.sa_handler = Signal::handler;
+                sigemptyset(&sa.sa_mask);
+                sa.sa_flags = SA_ONSTACK;
+                sigaction(Signal::signals[i], &sa, &Signal::previous[i]);
+            }
+        }
+
+#else
+
+        /**当前系统不支持崩溃输出, 不做任何事*/
+        inline void dumpTo(int, const char *) {}
+
+        /**当前系统不支持崩溃输出, 不做任何事*/
+        inline bool dump(const char *, const char * = "manual") { return false; }
+
+        /**当前系统不支持崩溃输出, 不开启记录*/
+        inline void install(const std::string &) {}
+
+        /**当前系统不支持崩溃输出, 不做任何事*/
+        inline void altStack() {}
+
+#endif
+
+        /**开启/关闭记录 (不安装信号处理器)*/
+        inline void setEnabled(bool enable) { enabled_ = enable; }
+    }
+}
+#endif //COMMON_MODULES_RECORDER_HPP
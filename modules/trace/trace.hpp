@@ -0,0 +1,272 @@
+#ifndef COMMON_MODULES_TRACE_HPP
+#define COMMON_MODULES_TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "rapidjson/writer.h"
+#include "rapidjson/stringbuffer.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+/**
+ * 运行轨迹模块
+ *
+ * 每个线程一个环形缓冲区, 记录开始/结束/瞬时事件及计数器采样, 可导出为Chrome trace-event格式(Perfetto可直接打开)
+ */
+namespace ifr {
+    namespace Trace {
+        static const constexpr size_t ring_size = 1 << 13;//每个线程的事件数量 (2的幂)
+        static const constexpr size_t name_size = 38;//事件名称最大长度(含结尾0)
+        static const constexpr size_t max_dead = 16;//保留的已退出线程缓冲区数量
+
+        /**事件类别*/
+        enum Category : uint8_t {
+            USER = 0,//用户自定义
+            TIME = 1,//TimeWatcher检查点
+            MSG = 2,//Msg推送/接收
+            PLAN = 3,//计划阶段变化
+        };
+
+        /**@return 类别名称*/
+        inline const char *categoryName(uint8_t c) {
+            static const char *const names[] = {"user", "time", "msg", "plan"};
+            return c < sizeof(names) / sizeof(names[0]) ? names[c] : "unknown";
+        }
+
+        /**一个事件, 字段含义与trace-event一致*/
+        struct Event {
+            int64_t ts;//时间 (ns)
+            int64_t dur;//持续时间 (ns), 仅'X'有效
+            double value;//计数值, 仅'C'有效
+            char ph;//类型: B=开始, E=结束, X=完整区间, i=瞬时, C=计数器
+            uint8_t cat;//类别
+            char name[name_size];
+        };
+        static_assert(sizeof(Event) == 64, "Event should fill one cache line");
+
+        /**一个线程的环形缓冲区, 仅由所属线程写入*/
+        struct Ring {
+            std::atomic<uint64_t> head{0};//已写入的事件总数
+            std::unique_ptr<Event[]> events = std::make_unique<Event[]>(ring_size);
+            const long tid;//线程ID
+            std::string thread;//线程名称
+            std::atomic_bool alive{true};//线程是否存活
+            std::mutex name_mtx;//访问锁: thread
+
+            explicit Ring(long tid) : tid(tid) {}
+        };
+
+        inline std::atomic_bool enabled{true};//是否记录事件
+        inline std::mutex rings_mtx;//访问锁: rings
+        inline std::vector<std::shared_ptr<Ring>> rings;//所有缓冲区
+
+        /**@return 当前时间 (ns, steady_clock)*/
+        inline int64_t now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        static const constexpr int64_t now_ts = INT64_MIN;//record的时间参数: 在开启记录时才读取当前时间
+
+        /**@return 当前线程的ID*/
+        inline long currentTid() {
+#if defined(__linux__)
+            return (long) syscall(SYS_gettid);
+#else
+            return (long) (std::hash<std::thread::id>()(std::this_thread::get_id()) & 0x7fffffff);
+#endif
+        }
+
+        /**线程局部的缓冲区持有者, 线程退出时将缓冲区标记为已退出*/
+        struct Holder {
+            std::shared_ptr<Ring> ring;
+
+            ~Holder() { if (ring)ring->alive.store(false, std::memory_order_relaxed); }
+        };
+
+        /**
+         * @brief 获取当前线程的缓冲区
+         * @details 首次调用时创建并注册(加锁), 同时清理多余的已退出线程的缓冲区
+         */
+        inline Ring &local() {
+            thread_local Holder holder;
+            if (holder.ring) [[likely]] return *holder.ring;
+            holder.ring = std::make_shared<Ring>(currentTid());
+            std::unique_lock<std::mutex> lock(rings_mtx);
+            size_t dead = 0;
+            for (const auto &r: rings)if (!r->alive.load(std::memory_order_relaxed))dead++;
+            for (auto itr = rings.begin(); dead > max_dead && itr != rings.end();) {
+                if (!(*itr)->alive.load(std::memory_order_relaxed))itr = rings.erase(itr), dead--;
+                else ++itr;
+            }
+            rings.push_back(holder.ring);
+            return *holder.ring;
+        }
+
+        /**
+         * @brief 记录一个事件
+         * @details 名称由a和b拼接, 超出长度的部分被截断
+         * @param ph 类型
+         * @param cat 类别
+         * @param a 名称前半部分
+         * @param b 名称后半部分
+         * @param ts 时间 (ns), 为now_ts时在开启记录的情况下读取当前时间
+         * @param dur 持续时间 (ns)
+         * @param value 计数值
+         */
+        inline void record(char ph, uint8_t cat, std::string_view a, std::string_view b = {},
+                           int64_t ts = now_ts, int64_t dur = 0, double value = 0) {
+            if (!enabled.load(std::memory_order_relaxed))return;
+            if (ts == now_ts)ts = now();
+            auto &r = local();
+            const auto h = r.head.load(std::memory_order_relaxed);
+            auto &e = r.events[h & (ring_size - 1)];
+            e.ts = ts, e.dur = dur, e.value = value, e.ph = ph, e.cat = cat;
+            const auto la = std::min(a.size(), name_size - 1);
+            const auto lb = std::min(b.size(), name_size - 1 - la);
+            std::memcpy(e.name, a.data(), la);
+            std::memcpy(e.name + la, b.data(), lb);
+            e.name[la + lb] = 0;
+            r.head.store(h + 1, std::memory_order_release);
+        }
+
+        /**记录区间开始*/
+        inline void begin(uint8_t cat, std::string_view name) { record('B', cat, name); }
+
+        /**记录区间结束*/
+        inline void end(uint8_t cat, std::string_view name) { record('E', cat, name); }
+
+        /**记录瞬时事件*/
+        inline void instant(uint8_t cat, std::string_view a, std::string_view b = {}) { record('i', cat, a, b); }
+
+        /**
+         * @brief 记录一个已结束的区间
+         * @param start 开始时间 (ns)
+         * @param end 结束时间 (ns)
+         */
+        inline void complete(uint8_t cat, std::string_view a, std::string_view b, int64_t start, int64_t end) {
+            record('X', cat, a, b, start, end - start);
+        }
+
+        /**记录计数器采样*/
+        inline void counter(uint8_t cat, std::string_view name, double value) {
+            record('C', cat, name, {}, now_ts, 0, value);
+        }
+
+        /**设置当前线程在轨迹中显示的名称*/
+        inline void setThreadName(const std::string &name) {
+            auto &r = local();
+            std::unique_lock<std::mutex> lock(r.name_mtx);
+            r.thread = name;
+        }
+
+        /**开启/关闭记录*/
+        inline void setEnabled(bool enable) { enabled = enable; }
+
+        /**区间记录器: 析构时记录一个完整区间*/
+        class Scope {
+            const uint8_t cat;
+            const std::string_view name;
+            const int64_t start;
+        public:
+            Scope(uint8_t cat, std::string_view name) : cat(cat), name(name),
+                                                        start(enabled.load(std::memory_order_relaxed) ? now() : 0) {}
+
+            ~Scope() { if (start)complete(cat, name, {}, start, now()); }//开始时未开启记录则不记录
+        };
+
+#define IFR_TRACE_CAT2(a, b) a##b
+#define IFR_TRACE_CAT(a, b) IFR_TRACE_CAT2(a, b)
+/**记录当前作用域为一个区间, name需在作用域内有效*/
+#define IFR_TRACE_SCOPE(name) ifr::Trace::Scope IFR_TRACE_CAT(_ifr_trace_scope_, __LINE__)(ifr::Trace::USER, name)
+
+        /**
+         * @brief 复制一个缓冲区中指定时间之后的事件
+         * @details 不加锁: 复制后重新读取写入位置, 丢弃复制期间可能被覆盖的事件
+         * @param r 缓冲区
+         * @param since 起始时间 (ns)
+         * @param out 输出
+         */
+        inline void snapshot(const Ring &r, int64_t since, std::vector<Event> &out) {
+            const auto h1 = r.head.load(std::memory_order_acquire);
+            const auto first = h1 > ring_size ? h1 - ring_size : 0;
+            std::vector<Event> tmp(h1 - first);
+            for (auto i = first; i < h1; i++)tmp[i - first] = r.events[i & (ring_size - 1)];
+            const auto h2 = r.head.load(std::memory_order_acquire);
+            const auto valid = h2 >= ring_size ? h2 - ring_size + 1 : 0;//正在写入的位置覆盖了这之前的事件
+            for (auto i = std::max(first, valid); i < h1; i++) {
+                const auto &e = tmp[i - first];
+                if (e.ts >= since)out.push_back(e);
+            }
+        }
+
+        /**
+         * @brief 导出最近一段时间内的事件
+         * @details Chrome trace-event JSON格式: {"traceEvents":[...],"displayTimeUnit":"ms"}, 时间单位为微秒
+         * @param seconds 时长 (s)
+         * @return json
+         */
+        inline std::string dump(double seconds) {
+            std::vector<std::shared_ptr<Ring>> all;
+            {
+                std::unique_lock<std::mutex> lock(rings_mtx);
+                all = rings;
+            }
+            const auto since = now() - (int64_t) (seconds * 1e9);
+
+            rapidjson::StringBuffer buf;
+            rapidjson::Writer<rapidjson::StringBuffer> w(buf);
+            w.StartObject();
+            w.Key("traceEvents"), w.StartArray();
+            std::vector<Event> events;
+            for (const auto &r: all) {
+                events.clear();
+                snapshot(*r, since, events);
+                if (events.empty())continue;
+                std::string thread;
+                {
+                    std::unique_lock<std::mutex> lock(r->name_mtx);
+                    thread = r->thread.empty() ? "thread-" + std::to_string(r->tid) : r->thread;
+                }
+                w.StartObject();
+                w.Key("name"), w.String("thread_name");
+                w.Key("ph"), w.String("M");
+                w.Key("pid"), w.Int(1);
+                w.Key("tid"), w.Int64(r->tid);
+                w.Key("args"), w.StartObject(), w.Key("name"), w.String(thread), w.EndObject();
+                w.EndObject();
+                for (const auto &e: events) {
+                    w.StartObject();
+                    w.Key("name"), w.String(e.name);
+                    w.Key("cat"), w.String(categoryName(e.cat));
+                    w.Key("ph"), w.String(&e.ph, 1);
+                    w.Key("ts"), w.Double((double) e.ts / 1e3);
+                    w.Key("pid"), w.Int(1);
+                    w.Key("tid"), w.Int64(r->tid);
+                    if (e.ph == 'X')w.Key("dur"), w.Double((double) e.dur / 1e3);
+                    else if (e.ph == 'i')w.Key("s"), w.String("t");
+                    else if (e.ph == 'C')w.Key("args"), w.StartObject(), w.Key("value"), w.Double(e.value), w.EndObject();
+                    w.EndObject();
+                }
+            }
+            w.EndArray();
+            w.Key("displayTimeUnit"), w.String("ms");
+            w.EndObject();
+            w.Flush();
+            return buf.GetString();
+        }
+    }
+}
+#endif //COMMON_MODULES_TRACE_HPP